@@ -11,6 +11,8 @@
 
 #include "bin_selection.h"
 
+#include "core.h"
+
 #include <inttypes.h>
 
 namespace sofs18
@@ -115,6 +117,10 @@ namespace sofs18
         if (id >= 1000)
             return false;
 
+        /* the binary versions would corrupt a disk with blocks of another size */
+        if (BlockSize != 512)
+            return false;
+
         /* return state */
         return selected_bin_ids[id];
     }
@@ -63,6 +63,8 @@ namespace sofs18
      *  \brief Check if given ID is activated.
      *  \details IDs covered by the current configuration represent binary functions 
      *    to be used.
+     *    The prebuilt binary modules assume 512-byte blocks,
+     *    so nothing is selected if the block size is another one.
      *  \param id ID of the function to be checked
      */
     bool soBinSelected(uint32_t id);
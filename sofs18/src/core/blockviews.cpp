@@ -107,6 +107,12 @@ namespace sofs18
         printf("   Properly unmounted: %s\n", (sbp->mntstat == 1) ? "yes" : "no");
         printf("   Number of mounts: %u\n", sbp->mntcnt);
         printf("   Total number of blocks in the device: %u\n", sbp->ntotal);
+        if (BlockSize > BlockSizeStampOffset)
+        {
+            uint32_t bs;
+            memcpy(&bs, (char *)buf + BlockSizeStampOffset, sizeof(bs));
+            printf("   Block size: %u\n", bs);
+        }
         printf("\n");
 
         /* ----------------------------------------------------- */
@@ -320,6 +326,32 @@ namespace sofs18
             printf("ctime = %s\n", timebuf);
         }
 
+        /* print the root of the tree of extents */
+        if ((ip->mode & INODE_EXTENTS) != 0 and not not_in_use)
+        {
+            uint32_t count = ip->d[0] & 0xFFFF;
+            uint32_t depth = ip->d[0] >> 16;
+            printf("extents: depth = %u, {", depth);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (i > 0)
+                    printf(" ");
+                if (depth == 0)
+                {
+                    SOExtent *e = (SOExtent *)&ip->d[1] + i;
+                    printf("%u-%u:%u", e->fbn, e->fbn + e->len - 1, e->bn);
+                }
+                else
+                {
+                    SOExtentIndex *x = (SOExtentIndex *)&ip->d[1] + i;
+                    printf("%u:(%u)", x->fbn, x->child);
+                }
+            }
+            printf("}\n");
+            printf("----------------\n");
+            return;
+        }
+
         /* print direct references */
         printf("d[*] = {");
         for (int i = 0; i < N_DIRECT; i++) {
@@ -10,6 +10,7 @@
 
 #include "exception.h"
 #include "probing.h"
+#include "stats.h"
 #include "bin_selection.h"
 #include "superblock.h"
 #include "inode.h"
@@ -28,8 +29,19 @@
 
 /** @{ */
 
-/** \brief block size (in bytes) */
-#define BlockSize 512U 
+/** \brief block size (in bytes), as set at configuration time (\c SOFS18_BLOCK_SIZE) */
+#ifndef SOFS18_BLOCK_SIZE
+#define SOFS18_BLOCK_SIZE 512
+#endif
+#define BlockSize ((uint32_t)SOFS18_BLOCK_SIZE)
+
+static_assert(SOFS18_BLOCK_SIZE >= 512 and SOFS18_BLOCK_SIZE <= 65536
+        and (SOFS18_BLOCK_SIZE & (SOFS18_BLOCK_SIZE - 1)) == 0,
+        "SOFS18_BLOCK_SIZE must be a power of 2 between 512 and 65536");
+
+/** \brief offset within block 0 where the block size is stamped,
+ *      if blocks are larger than the superblock */
+#define BlockSizeStampOffset (sizeof(SOSuperBlock))
 
 /** \brief number of inodes per block */
 #define InodesPerBlock (BlockSize / sizeof(SOInode))
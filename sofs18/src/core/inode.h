@@ -24,6 +24,10 @@ namespace sofs18
     /** \brief flag signaling inode is free (it corresponds to the sticky bit) */
 #define INODE_FREE 0001000
 
+    /** \brief flag signaling the block map of the inode is a tree of extents 
+     *  (it corresponds to the set-group-ID bit) */
+#define INODE_EXTENTS 0002000
+
     /** \brief number of direct block references in the inode */
 #define N_DIRECT 4
 
@@ -67,6 +71,35 @@ namespace sofs18
         uint32_t i2[N_DOUBLE_INDIRECT];
     };
 
+    /** \brief number of words of the block map of an inode (\c d, \c i1 and \c i2) */
+#define N_MAP_WORDS (N_DIRECT + N_INDIRECT + N_DOUBLE_INDIRECT)
+
+    /**
+     * \brief A run of consecutive file blocks stored in consecutive data blocks
+     * \details In an inode flagged with \c INODE_EXTENTS, the words of the block map
+     *  hold the root node of a tree of extents; the other nodes are data blocks.
+     *  Every node starts with a header word, whose low half is the number of entries 
+     *  and whose high half is the depth of the node.
+     *  The entries of a leaf (depth 0) are extents,
+     *  those of other nodes are \c SOExtentIndex; both are sorted by file block number.
+     */
+    struct SOExtent {
+        /** \brief first file block of the run */
+        uint32_t fbn;
+        /** \brief data block of the first file block */
+        uint32_t bn;
+        /** \brief number of blocks of the run */
+        uint32_t len;
+    };
+
+    /** \brief An entry of an inner node of a tree of extents */
+    struct SOExtentIndex {
+        /** \brief lowest file block of the subtree */
+        uint32_t fbn;
+        /** \brief block holding the child node */
+        uint32_t child;
+    };
+
     /** @} */
 
 };
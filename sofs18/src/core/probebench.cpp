@@ -0,0 +1,168 @@
+/**
+ *  \defgroup probebench probebench
+ *  \ingroup tools
+ *  \brief The \b sofs18 probing overhead benchmark program.
+ *
+ *  \details
+ *      It measures the cost of a disabled probe, when called as a plain function
+ *      (the way probes used to be compiled), when tested inline by the \c soProbe macro
+ *      and when compiled out.<br/>
+ *      If a storage device is given, it also measures the cost per block of
+ *      \c soReadRawBlock, served by the block cache, whose probe is a \c soProbeHot one;
+ *      compare builds with \c SOFS_PROBE_LEVEL set to 1 and 2.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "rawdisk.h"
+#include "core.h"
+
+/*
+ * print help message
+ */
+static void printUsage(char *cmd_name)
+{
+    printf("Sinopsis: %s [ OPTIONS ] [ supp-file ]\n"
+           "  OPTIONS:\n"
+           "  -n num     --- number of calls (default: 10000000)\n"
+           "  -h         --- print this help\n", cmd_name);
+}
+
+/* print error message */
+static void printError(int errcode, char *cmd_name)
+{
+    fprintf(stderr, "%s: error #%d - %s.\n", cmd_name, errcode,
+        strerror(errcode));
+}
+
+/* current time in nanoseconds */
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* keep the compiler from hoisting the probe test out of the loops */
+#define BARRIER() asm volatile("" ::: "memory")
+
+/* The main function */
+
+using namespace sofs18;
+
+int main(int argc, char *argv[])
+{
+    /* process command line options */
+    int opt;
+    uint32_t n = 10000000;
+
+    while ((opt = getopt(argc, argv, "n:h")) != -1)
+    {
+        switch (opt)
+        {
+            case 'n':
+            {
+                n = atol(optarg);
+                break;
+            }
+            case 'h':
+            {
+                printUsage(basename(argv[0]));
+                return EXIT_SUCCESS;
+            }
+            default:
+            {
+                fprintf(stderr, "%s: Wrong option.\n", basename(argv[0]));
+                printUsage(basename(argv[0]));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    if ((argc - optind) > 1)
+    {
+        fprintf(stderr, "%s: Wrong number of mandatory arguments.\n", basename(argv[0]));
+        printUsage(basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    if (n == 0)
+    {
+        fprintf(stderr, "%s: Number of calls must be positive.\n", basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    /* probing on, but not for the IDs used below */
+    soProbeOpen(stdout, 0, 0);
+
+    printf("SOFS_PROBE_LEVEL %d, %" PRIu32 " calls\n", SOFS_PROBE_LEVEL, n);
+
+    /* a disabled probe, called as a function */
+    double t0 = now();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        (soProbe)(SOPROBE_GREEN, 751, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, i, argv);
+        BARRIER();
+    }
+    printf("%-24s %8.2f ns/call\n", "function call", (now() - t0) / n);
+
+    /* a disabled probe, tested inline */
+    t0 = now();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        SOFS_PROBE_CHECKED(SOPROBE_GREEN, 751, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, i, argv);
+        BARRIER();
+    }
+    printf("%-24s %8.2f ns/call\n", "inline test", (now() - t0) / n);
+
+    /* a compiled out probe */
+    t0 = now();
+    for (uint32_t i = 0; i < n; i++)
+    {
+        SOFS_PROBE_NONE(SOPROBE_GREEN, 751, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, i, argv);
+        BARRIER();
+    }
+    printf("%-24s %8.2f ns/call\n", "compiled out", (now() - t0) / n);
+
+    if (optind == argc)
+        return EXIT_SUCCESS;
+
+    /* per block cost of a cached raw read */
+    try
+    {
+        uint32_t nb;
+        soOpenRawDisk(argv[optind], &nb);
+        /* a span of blocks that fits in the cache */
+        SORawCacheStats st;
+        soRawCacheGetStats(&st);
+        uint32_t span = (st.size < 64) ? st.size : 64;
+        if (span == 0 or span > nb)
+            span = (nb < 64) ? nb : 64;
+
+        char buf[BlockSize];
+        for (uint32_t i = 0; i < span; i++)
+            soReadRawBlock(i, buf);
+
+        t0 = now();
+        for (uint32_t i = 0; i < n; i++)
+            soReadRawBlock(i % span, buf);
+        printf("%-24s %8.2f ns/block\n", "soReadRawBlock (cached)", (now() - t0) / n);
+
+        soCloseRawDisk();
+    }
+    catch (SOException & err)
+    {
+        printError(err.en, basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -26,6 +26,17 @@ namespace sofs18
     static FILE * fp = NULL;
     static bool probe_ids[1000] = {false};
 
+    /* probe_ids, if there is an output stream; all false otherwise */
+    bool soProbeVisible[1000] = {false};
+
+    /* *************************************** */
+
+    static void soProbeRefresh()
+    {
+        for (uint32_t i = 0; i <= 999; i++)
+            soProbeVisible[i] = (fp != NULL) and probe_ids[i];
+    }
+
     /* *************************************** */
 
     static void soAdjustRange(uint32_t & lower, uint32_t & upper)
@@ -58,6 +69,8 @@ namespace sofs18
             probe_ids[i] = false;
         for (uint32_t i = lower; i <= upper; i++)
             probe_ids[i] = true;
+
+        soProbeRefresh();
     }
 
     /* *************************************** */
@@ -73,6 +86,8 @@ namespace sofs18
 
         /* set output stream */
         fp = NULL;
+
+        soProbeRefresh();
     }
 
     /* *************************************** */
@@ -88,6 +103,8 @@ namespace sofs18
 
         /* set output stream */
         fp = fs;
+
+        soProbeRefresh();
     }
 
     /* *************************************** */
@@ -106,6 +123,8 @@ namespace sofs18
             probe_ids[i] = false;
         for (uint32_t i = lower; i <= upper; i++)
             probe_ids[i] = true;
+
+        soProbeRefresh();
     }
 
     /* *************************************** */
@@ -122,6 +141,8 @@ namespace sofs18
         /* set probing range */
         for (uint32_t i = lower; i <= upper; i++)
             probe_ids[i] = true;
+
+        soProbeRefresh();
     }
 
     /* *************************************** */
@@ -138,11 +159,13 @@ namespace sofs18
         /* set hidden range */
         for (uint32_t i = lower; i <= upper; i++)
             probe_ids[i] = false;
+
+        soProbeRefresh();
     }
 
     /* *************************************** */
 
-    void soProbe(uint32_t id, const char *fmt, ...)
+    void (soProbe)(uint32_t id, const char *fmt, ...)
     {
         /* do nothing, if out of active range */
         if ((fp == NULL) or (id > 999) or (probe_ids[id] == false))
@@ -158,7 +181,7 @@ namespace sofs18
 
     /* *************************************** */
 
-    void soProbe(const char *color, uint32_t id, const char *fmt, ...)
+    void (soProbe)(const char *color, uint32_t id, const char *fmt, ...)
     {
         /* do nothing, if out of active range */
         if ((fp == NULL) or (id > 999) or (probe_ids[id] == false))
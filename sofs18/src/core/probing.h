@@ -11,6 +11,14 @@
  *  Upon activating the probing system, 
  *      one can set, add or remove ranges of IDs that must be logged or displayed.
  *
+ *  Calls go through the \c soProbe and \c soProbeHot macros,
+ *  which test the ID inline, so a disabled probe costs a predicted branch
+ *  and its arguments are not even evaluated.
+ *  How much is compiled in is set by \c SOFS_PROBE_LEVEL:
+ *  0 removes every probe, 1 removes only the \c soProbeHot ones
+ *  (meant for functions called per block),
+ *  and 2 (the default) keeps them all.
+ *
  *  \author Artur Pereira - 2008-2009, 2016-2018
  *  \author Miguel Oliveira e Silva - 2009, 2017
  *  \author António Rui Borges - 2010-2015
@@ -111,7 +119,7 @@ namespace sofs18
      *  \param [in] id the probing ID of the message
      *  \param [in] fmt the format string (as in \e fprintf)
      */
-    void soProbe(uint32_t id, const char *fmt, ...);
+    void (soProbe)(uint32_t id, const char *fmt, ...);
 
     /* *************************************** */
 
@@ -127,7 +135,34 @@ namespace sofs18
      *  \param [in] id the probing ID of the message
      *  \param [in] fmt the format string (as in \e fprintf)
      */
-    void soProbe(const char *color, uint32_t id, const char *fmt, ...);
+    void (soProbe)(const char *color, uint32_t id, const char *fmt, ...);
+
+    /* *************************************** */
+
+    /** \brief visibility of every probing ID, for the inline test only; not to be changed directly */
+    extern bool soProbeVisible[1000];
+
+    /**
+     *  \brief Check if a probing ID is visible
+     *  \param [in] id the probing ID
+     *  \return true if messages with the given ID are to be displayed
+     */
+    inline __attribute__((always_inline)) bool soProbeEnabled(uint32_t id)
+    {
+        return __builtin_expect(id <= 999 and soProbeVisible[id], 0);
+    }
+
+    /** \brief \c soProbeEnabled, given the leading arguments of a \c soProbe call without color */
+    inline __attribute__((always_inline)) bool soProbeWanted(uint32_t id, const char *)
+    {
+        return soProbeEnabled(id);
+    }
+
+    /** \brief \c soProbeEnabled, given the leading arguments of a \c soProbe call with color */
+    inline __attribute__((always_inline)) bool soProbeWanted(const char *, uint32_t id)
+    {
+        return soProbeEnabled(id);
+    }
 
     /* *************************************** */
 
@@ -135,4 +170,40 @@ namespace sofs18
 
 };
 
+/* *************************************** */
+
+/** \brief amount of probing compiled in: 0 none, 1 all but \c soProbeHot, 2 all */
+#ifndef SOFS_PROBE_LEVEL
+#define SOFS_PROBE_LEVEL 2
+#endif
+
+/* a probe that compiles to nothing, but still type checks its arguments */
+#define SOFS_PROBE_NONE(a, b, ...) \
+    do { if (0) (::sofs18::soProbe)(a, b, ##__VA_ARGS__); } while (0)
+
+/* a probe whose ID is tested inline, the message being built only if it is visible */
+#define SOFS_PROBE_CHECKED(a, b, ...) \
+    do { if (::sofs18::soProbeWanted(a, b)) (::sofs18::soProbe)(a, b, ##__VA_ARGS__); } while (0)
+
+/**
+ *  \brief Print a probing message if its ID is visible
+ *  \details Takes the same arguments as the \c soProbe functions;
+ *      the color and the ID may be evaluated twice
+ */
+#if SOFS_PROBE_LEVEL >= 1
+#define soProbe(a, b, ...) SOFS_PROBE_CHECKED(a, b, ##__VA_ARGS__)
+#else
+#define soProbe(a, b, ...) SOFS_PROBE_NONE(a, b, ##__VA_ARGS__)
+#endif
+
+/**
+ *  \brief Same as \c soProbe, for functions on the per block path
+ *  \details Compiled in only if \c SOFS_PROBE_LEVEL is 2
+ */
+#if SOFS_PROBE_LEVEL >= 2
+#define soProbeHot(a, b, ...) SOFS_PROBE_CHECKED(a, b, ##__VA_ARGS__)
+#else
+#define soProbeHot(a, b, ...) SOFS_PROBE_NONE(a, b, ##__VA_ARGS__)
+#endif
+
 #endif				/* __SOFS18_PROBING__ */
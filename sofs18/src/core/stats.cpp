@@ -0,0 +1,210 @@
+/*
+ *  \brief Operation counters and latency histograms
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include <string>
+
+#include "stats.h"
+#include "exception.h"
+
+/* *************************************** */
+
+namespace sofs18
+{
+    static const char *names[SOSTAT_COUNT] = {
+        "raw.read", "raw.write",
+        "sb.save", "it.open", "it.save", "filt.open", "fblt.open",
+        "dz.read", "dz.write",
+        "alloc.inode", "free.inode", "alloc.block", "free.block",
+        "soMknod", "soLink", "soUnlink", "soMkdir", "soRmdir",
+        "soRead", "soWrite", "soRename", "soTruncate", "soReaddir",
+        "soSymlink", "soReadlink", "soStatFS", "soStat", "soAccess",
+        "soChmod", "soChown", "soUtime", "soOpen", "soClose", "soFsync",
+        "soPunchHole",
+    };
+
+    static SOStat stats[SOSTAT_COUNT];
+
+    /* on, unless SOFS18_STATS is 0 */
+    static bool soStatDefault()
+    {
+        const char *env = getenv("SOFS18_STATS");
+        return env == NULL or atoi(env) != 0;
+    }
+
+    static bool enabled = soStatDefault();
+
+    /* *************************************** */
+
+    uint64_t soStatNow(void)
+    {
+        if (not enabled)
+            return 0;
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    /* *************************************** */
+
+    void soStatRecord(SOStatID id, uint64_t start, uint32_t units)
+    {
+        /* start is 0 if statistics were off when the operation started */
+        if (start == 0 or not enabled or (unsigned)id >= SOSTAT_COUNT)
+            return;
+
+        uint64_t ns = soStatNow() - start;
+        SOStat & s = stats[id];
+        s.count++;
+        s.units += units;
+        s.total += ns;
+        if (ns > s.max)
+            s.max = ns;
+
+        /* bucket i holds latencies in [2^i, 2^(i+1)) */
+        uint32_t i = (ns == 0) ? 0 : 63 - __builtin_clzll(ns);
+        if (i >= SOSTAT_BUCKETS)
+            i = SOSTAT_BUCKETS - 1;
+        s.hist[i]++;
+    }
+
+    /* *************************************** */
+
+    void soStatEnable(bool on)
+    {
+        enabled = on;
+    }
+
+    /* *************************************** */
+
+    void soStatReset(void)
+    {
+        memset(stats, 0, sizeof(stats));
+    }
+
+    /* *************************************** */
+
+    const SOStat *soStatGet(SOStatID id)
+    {
+        if ((unsigned)id >= SOSTAT_COUNT)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        return &stats[id];
+    }
+
+    /* *************************************** */
+
+    const char *soStatName(SOStatID id)
+    {
+        if ((unsigned)id >= SOSTAT_COUNT)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        return names[id];
+    }
+
+    /* *************************************** */
+
+    /* append printf-like formatted text to str */
+    static void soStatAppend(std::string & str, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+    static void soStatAppend(std::string & str, const char *fmt, ...)
+    {
+        char line[256];
+        va_list ap;
+        va_start(ap, fmt);
+        vsnprintf(line, sizeof(line), fmt, ap);
+        va_end(ap);
+        str += line;
+    }
+
+    /* *************************************** */
+
+    /* lower bound of histogram bucket i, in a human readable form */
+    static void soStatBucketLabel(uint32_t i, char *label, size_t size)
+    {
+        uint64_t ns = (uint64_t)1 << i;
+        if (i == 0)
+            snprintf(label, size, "0ns");
+        else if (ns < 1000)
+            snprintf(label, size, "%" PRIu64 "ns", ns);
+        else if (ns < 1000000)
+            snprintf(label, size, "%" PRIu64 "us", ns / 1000);
+        else if (ns < 1000000000)
+            snprintf(label, size, "%" PRIu64 "ms", ns / 1000000);
+        else
+            snprintf(label, size, "%" PRIu64 "s", ns / 1000000000);
+    }
+
+    /* *************************************** */
+
+    /* build the report */
+    static std::string soStatReport()
+    {
+        std::string str;
+        soStatAppend(str, "%-12s %10s %10s %10s %10s\n",
+                "operation", "count", "units", "avg(us)", "max(us)");
+
+        for (uint32_t id = 0; id < SOSTAT_COUNT; id++)
+        {
+            SOStat & s = stats[id];
+            if (s.count == 0)
+                continue;
+
+            soStatAppend(str, "%-12s %10" PRIu64 " %10" PRIu64 " %10.2f %10.2f\n",
+                    names[id], s.count, s.units,
+                    (double)s.total / s.count / 1000, (double)s.max / 1000);
+
+            /* non-empty buckets, labelled by their lower bound */
+            str += "   ";
+            for (uint32_t i = 0; i < SOSTAT_BUCKETS; i++)
+            {
+                if (s.hist[i] == 0)
+                    continue;
+                char label[16];
+                soStatBucketLabel(i, label, sizeof(label));
+                soStatAppend(str, " %s:%" PRIu64, label, s.hist[i]);
+            }
+            str += "\n";
+        }
+
+        return str;
+    }
+
+    /* *************************************** */
+
+    size_t soStatFormat(char *buf, size_t size)
+    {
+        std::string str = soStatReport();
+        if (buf != NULL and size > 0)
+        {
+            size_t n = (str.size() < size) ? str.size() : size - 1;
+            memcpy(buf, str.data(), n);
+            buf[n] = '\0';
+        }
+        return str.size();
+    }
+
+    /* *************************************** */
+
+    void soStatPrint(FILE *fp)
+    {
+        if (fp == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        fputs(soStatReport().c_str(), fp);
+    }
+
+    /* *************************************** */
+
+};
+
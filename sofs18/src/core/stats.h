@@ -0,0 +1,184 @@
+/**
+ *  \file
+ *  \brief Per-layer operation counters and latency histograms.
+ *
+ *  Every instrumented operation (raw transfers, DAL opens and saves,
+ *  allocations and syscalls) is counted, and its latency accumulated
+ *  into a histogram with power-of-2 buckets.
+ *  Collecting is cheap (two reads of the monotonic clock per operation)
+ *  and can be turned off by setting environment variable \c SOFS18_STATS to 0.
+ *
+ *  \remarks Counters are not protected against concurrent updates;
+ *      callers are expected to be serialized, as in \b sofsmount.
+ */
+
+#ifndef __SOFS18_STATS__
+#define __SOFS18_STATS__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <inttypes.h>
+
+namespace sofs18
+{
+    /**
+     * \defgroup stats stats
+     * \brief Operation counters and latency histograms
+     * \ingroup core
+     */
+
+    /** @{ */
+
+    /* *************************************** */
+
+    /** \brief Instrumented operations */
+    enum SOStatID
+    {
+        SOSTAT_RAW_READ = 0,        ///< raw disk reads (single, range and vector)
+        SOSTAT_RAW_WRITE,           ///< raw disk writes (single, range and vector)
+        SOSTAT_SB_SAVE,             ///< superblock saves
+        SOSTAT_IT_OPEN,             ///< inode opens
+        SOSTAT_IT_SAVE,             ///< inode saves
+        SOSTAT_FILT_OPEN,           ///< free inode list table opens
+        SOSTAT_FBLT_OPEN,           ///< free block list table opens
+        SOSTAT_DZ_READ,             ///< data block reads
+        SOSTAT_DZ_WRITE,            ///< data block writes
+        SOSTAT_ALLOC_INODE,         ///< inode allocations
+        SOSTAT_FREE_INODE,          ///< inode releases
+        SOSTAT_ALLOC_BLOCK,         ///< data block allocations
+        SOSTAT_FREE_BLOCK,          ///< data block releases
+        SOSTAT_SYS_MKNOD,           ///< soMknod calls
+        SOSTAT_SYS_LINK,            ///< soLink calls
+        SOSTAT_SYS_UNLINK,          ///< soUnlink calls
+        SOSTAT_SYS_MKDIR,           ///< soMkdir calls
+        SOSTAT_SYS_RMDIR,           ///< soRmdir calls
+        SOSTAT_SYS_READ,            ///< soRead calls; units are bytes requested
+        SOSTAT_SYS_WRITE,           ///< soWrite calls; units are bytes requested
+        SOSTAT_SYS_RENAME,          ///< soRename calls
+        SOSTAT_SYS_TRUNCATE,        ///< soTruncate calls
+        SOSTAT_SYS_READDIR,         ///< soReaddir calls
+        SOSTAT_SYS_SYMLINK,         ///< soSymlink calls
+        SOSTAT_SYS_READLINK,        ///< soReadlink calls
+        SOSTAT_SYS_STATFS,          ///< soStatFS calls
+        SOSTAT_SYS_STAT,            ///< soStat calls
+        SOSTAT_SYS_ACCESS,          ///< soAccess calls
+        SOSTAT_SYS_CHMOD,           ///< soChmod calls
+        SOSTAT_SYS_CHOWN,           ///< soChown calls
+        SOSTAT_SYS_UTIME,           ///< soUtime and soUtimens calls
+        SOSTAT_SYS_OPEN,            ///< soOpen and soOpendir calls
+        SOSTAT_SYS_CLOSE,           ///< soClose and soClosedir calls
+        SOSTAT_SYS_FSYNC,           ///< soFsync calls
+        SOSTAT_SYS_PUNCH,           ///< soPunchHole calls; units are bytes requested
+        SOSTAT_COUNT                ///< number of instrumented operations
+    };
+
+    /** \brief number of histogram buckets; bucket \c i counts latencies in [2^i, 2^(i+1)) ns */
+#define SOSTAT_BUCKETS 40
+
+    /** \brief Counters of an instrumented operation */
+    struct SOStat
+    {
+        uint64_t count;     ///< number of calls
+        uint64_t units;     ///< number of units (e.g. blocks) processed
+        uint64_t total;     ///< accumulated latency, in ns
+        uint64_t max;       ///< maximum latency, in ns
+        uint64_t hist[SOSTAT_BUCKETS];  ///< latency histogram
+    };
+
+    /* *************************************** */
+
+    /**
+     *  \brief Get the current time, for later use in \c soStatRecord
+     *  \return the value of the monotonic clock, in ns, or 0 if statistics are off
+     */
+    uint64_t soStatNow(void);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Account for an operation
+     *  \param [in] id the operation
+     *  \param [in] start the time the operation started, as returned by \c soStatNow
+     *  \param [in] units the number of units processed
+     */
+    void soStatRecord(SOStatID id, uint64_t start, uint32_t units = 1);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Turn statistics collecting on or off
+     *  \param [in] on true to collect statistics
+     */
+    void soStatEnable(bool on);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Clear all counters
+     */
+    void soStatReset(void);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Get the counters of an operation
+     *  \param [in] id the operation
+     *  \return pointer to the counters
+     */
+    const SOStat *soStatGet(SOStatID id);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Get the name of an operation
+     *  \param [in] id the operation
+     *  \return the name
+     */
+    const char *soStatName(SOStatID id);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Format a report of the operations called at least once
+     *  \details Works like \e snprintf: the report is truncated to fit in the buffer
+     *  \param [out] buf the buffer where to put the report
+     *  \param [in] size the size of the buffer
+     *  \return the length the full report would have
+     */
+    size_t soStatFormat(char *buf, size_t size);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Print a report of the operations called at least once
+     *  \param [in] fp the output stream
+     */
+    void soStatPrint(FILE *fp);
+
+    /* *************************************** */
+
+    /**
+     *  \brief Scoped accounting of an operation
+     *  \details The operation is accounted for when the object goes out of scope,
+     *      even if an exception is thrown
+     */
+    class SOStatTimer
+    {
+    public:
+        SOStatTimer(SOStatID id, uint32_t units = 1)
+            : id(id), units(units), start(soStatNow()) {}
+        ~SOStatTimer() { soStatRecord(id, start, units); }
+
+    private:
+        SOStatID id;
+        uint32_t units;
+        uint64_t start;
+    };
+
+    /* *************************************** */
+
+    /** @} */
+
+};
+
+#endif				/* __SOFS18_STATS__ */
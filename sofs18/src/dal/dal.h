@@ -45,6 +45,20 @@ namespace sofs18
      */
     void soCloseDisk();
 
+    /* ***************************************** */
+
+    /**
+     * \brief Flush the disk at sofs18 abstraction level
+     *
+     * Spill the reference pools back to the free lists tables,
+     * rewrite the free block list table from the free block map, if it owns it,
+     * write back dirty inode table blocks, flush the superblock,
+     * and then write back every block still pending at raw level, 
+     * so that the device reflects all operations done so far.
+     * The disk remains open.
+     */
+    void soSyncDisk();
+
     /* ***************************************** */
     /* ***************************************** */
 
@@ -60,7 +74,8 @@ namespace sofs18
     /**
      * \brief Close the superblock dealer
      *
-     * Save superblock to disk and close dealer
+     * Save superblock to disk, flagged as properly unmounted,
+     * and close dealer
      * Do nothing if not loaded
      */
     void soSBClose();
@@ -70,12 +85,66 @@ namespace sofs18
     /**
      * \brief Save superblock to disk
      *
+     * The superblock is only marked as dirty and written at the next commit point,
+     * which is reached after a given number of saves or milliseconds
+     * (see \c soSBSetCommitPolicy), on \c soSBFlush, and on \c soSBClose.
+     * The first save after a write flags the disk copy as not properly unmounted
+     * (\c mntstat at 0), so a crash before the next commit point can be detected.
+     *
      * Do nothing if not loaded
      */
     void soSBSave();
 
     /* ***************************************** */
 
+    /**
+     * \brief Write the superblock to disk, if dirty
+     *
+     * The disk copy keeps \c mntstat at 0, since the disk is still in use.
+     * Do nothing if not loaded
+     */
+    void soSBFlush();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Set the commit policy of the superblock
+     *
+     * A dirty superblock is written once \c ops saves or \c ms milliseconds
+     * have gone by since the last write; time is only checked on saves.
+     * A value of 0 disables the corresponding criterion;
+     * <tt>ops = 1</tt> makes every save go to disk.
+     * If never called, the values are taken from the environment variables
+     * \c SOFS18_SB_COMMIT_OPS and \c SOFS18_SB_COMMIT_MS,
+     * defaulting to 64 saves and 1000 milliseconds.
+     *
+     * \param ops number of saves between writes
+     * \param ms number of milliseconds between writes
+     */
+    void soSBSetCommitPolicy(uint32_t ops, uint32_t ms);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Counters of the superblock dealer
+     */
+    struct SOSBStats
+    {
+        uint64_t saves;         ///< calls to \c soSBSave on a loaded superblock
+        uint64_t writes;        ///< superblock writes to disk
+        uint64_t elided;        ///< saves that did not cause a write
+    };
+
+    /* ***************************************** */
+
+    /**
+     * \brief Get the counters of the superblock dealer
+     * \param st pointer to the location where counters are to be stored
+     */
+    void soSBGetStats(SOSBStats * st);
+
+    /* ***************************************** */
+
     /**
      * \brief Get a pointer to the superblock
      *
@@ -88,10 +157,46 @@ namespace sofs18
     /* ***************************************** */
     /* ***************************************** */
 
+    /**
+     * \brief Open (load) a window of contiguous FILT blocks
+     *
+     * The blocks are loaded from disk with a single transfer
+     * and handed out as one array of <tt>cnt * ReferencesPerBlock</tt> references.
+     * Since the table is circular, a range of references crossing its end
+     * requires two windows, opened one after the other.
+     * Throws an error if a window is opened.
+     *
+     * \param[in] bn relative number of the first block of the window
+     * \param[in] cnt number of blocks of the window
+     * \return pointer to the references of the window
+     */
+    uint32_t * soFILTOpenBlocks(uint32_t bn, uint32_t cnt);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Save the open FILT window to disk, with a single transfer.
+     *
+     * Throws an error if no window is open.
+     */
+    void soFILTSaveBlocks();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Close the open FILT window.
+     *
+     * Throws an error if no window is open.
+     */
+    void soFILTCloseBlocks();
+
+    /* ***************************************** */
+
     /**
      * \brief Open (load) a FILT block
      *
      * A FILT block is loaded from disk.
+     * Same as opening a window of one block.
      * Throws an error if a block is opened.
      *
      * \param[in] bn relative number of block to be open
@@ -137,6 +242,55 @@ namespace sofs18
 
     /* ***************************************** */
 
+    /**
+     * \brief Write back saved inodes
+     *
+     * Saving an inode only marks its inode table block as dirty;
+     * this function writes every dirty block to disk.
+     * Open inodes remain open.
+     */
+    void soITFlush();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Set the number of inode table blocks kept in memory
+     *
+     * Blocks holding open inodes are always kept in memory;
+     * this is the number of blocks kept when their inodes are all closed,
+     * so that reopening them requires no disk access.
+     * If never called, the size is taken from the environment variable
+     * \c SOFS18_ITCACHE_BLOCKS, defaulting to 32 blocks.
+     *
+     * \param nblocks number of blocks
+     */
+    void soITSetCacheSize(uint32_t nblocks);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Counters of the inode table block cache
+     */
+    struct SOITCacheStats
+    {
+        uint64_t hits;          ///< opens served without disk access
+        uint64_t misses;        ///< opens that required loading a block
+        uint64_t writebacks;    ///< dirty blocks written to disk
+        uint32_t size;          ///< configured number of blocks
+        uint32_t used;          ///< number of blocks in memory
+        uint32_t dirty;         ///< number of dirty blocks in memory
+    };
+
+    /* ***************************************** */
+
+    /**
+     * \brief Get the counters of the inode table block cache
+     * \param st pointer to the location where counters are to be stored
+     */
+    void soITGetCacheStats(SOITCacheStats * st);
+
+    /* ***************************************** */
+
     /**
      * \brief open inode
      *
@@ -177,6 +331,8 @@ namespace sofs18
      * \brief Save an open inode to disk
      *
      * The inode is not closed.
+     * Its inode table block is only marked as dirty;
+     * it reaches the disk on eviction, on \c soITFlush, or on \c soITClose.
      *
      * \param ih inode handler
      */
@@ -219,10 +375,46 @@ namespace sofs18
     /* ***************************************** */
     /* ***************************************** */
 
+    /**
+     * \brief Open (load) a window of contiguous FBLT blocks
+     *
+     * The blocks are loaded from disk with a single transfer
+     * and handed out as one array of <tt>cnt * ReferencesPerBlock</tt> references.
+     * Since the table is circular, a range of references crossing its end
+     * requires two windows, opened one after the other.
+     * Throws an error if a window is opened.
+     *
+     * \param[in] bn relative number of the first block of the window
+     * \param[in] cnt number of blocks of the window
+     * \return pointer to the references of the window
+     */
+    uint32_t * soFBLTOpenBlocks(uint32_t bn, uint32_t cnt);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Save the open FBLT window to disk, with a single transfer.
+     *
+     * Throws an error if no window is open.
+     */
+    void soFBLTSaveBlocks();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Close the open FBLT window.
+     *
+     * Throws an error if no window is open.
+     */
+    void soFBLTCloseBlocks();
+
+    /* ***************************************** */
+
     /**
      * \brief Open (load) a FBLT block
      *
      * A FBLT block is loaded from disk.
+     * Same as opening a window of one block.
      * Throws an error if a block is opened.
      *
      * \param[in] bn relative number of block to be open
@@ -250,6 +442,255 @@ namespace sofs18
     /* ***************************************** */
     /* ***************************************** */
 
+    /**
+     * \brief Kinds of reference pools
+     */
+    enum SORPKind
+    {
+        SORP_INODE = 0,         ///< inode references, backed by the FILT
+        SORP_BLOCK = 1          ///< data block references, backed by the FBLT
+    };
+
+    /* ***************************************** */
+
+    /**
+     * \brief Take references from the retrieval pool (RP)
+     *
+     * The reference pools are an in-memory level between the superblock caches
+     * and the free lists tables, with a capacity not bound by the superblock layout.
+     * An empty retrieval pool is refilled with up to \c capacity references
+     * from the head of the table; if the table is empty, the insertion pool is taken over.
+     * References are handed out in table order.
+     *
+     * \param[in] k kind of pool
+     * \param[out] refs where to put the references
+     * \param[in] n number of references wanted
+     * \return number of references taken, less than \c n only if the table and both pools ran dry
+     */
+    uint32_t soRPTake(SORPKind k, uint32_t * refs, uint32_t n);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Put references in the insertion pool
+     *
+     * Once it holds \c capacity references, the insertion pool is spilled
+     * to the tail of the table, as much of it as fits.
+     *
+     * \param[in] k kind of pool
+     * \param[in] refs the references
+     * \param[in] n number of references
+     */
+    void soRPPut(SORPKind k, const uint32_t * refs, uint32_t n);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Spill the reference pools back to the tables
+     *
+     * References of a retrieval pool go back before the head of the table,
+     * those of an insertion pool after its tail,
+     * so the disk holds every free reference again.
+     */
+    void soRPFlush();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Spill the reference pools and release their memory
+     */
+    void soRPClose();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Set the capacity of the reference pools
+     *
+     * A capacity of 0 makes every take and put go through to the table.
+     * If never called, the values are taken from the environment variables
+     * \c SOFS18_RP_INODES and \c SOFS18_RP_BLOCKS, defaulting to 1024 references.
+     *
+     * \param inodes capacity of the inode pools
+     * \param blocks capacity of the data block pools
+     */
+    void soRPSetCapacity(uint32_t inodes, uint32_t blocks);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Get the number of references held in the pools of a kind
+     */
+    uint32_t soRPCount(SORPKind k);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Copy the references held in the pools of a kind
+     *
+     * \param[in] k kind of pool
+     * \param[out] refs where to put the references; room for \c soRPCount(k) is required
+     */
+    void soRPCopy(SORPKind k, uint32_t * refs);
+
+    /* ***************************************** */
+    /* ***************************************** */
+
+    /**
+     * \brief Result of a consistency check of the free block map
+     */
+    struct SOFBMReport
+    {
+        uint32_t free;          ///< number of distinct free blocks in the free lists
+        uint32_t dzFree;        ///< number of free blocks according to the superblock
+        uint32_t duplicates;    ///< references appearing more than once in the free lists
+        uint32_t outOfRange;    ///< references in the free lists beyond the data zone
+        uint32_t mismatches;    ///< blocks on which the maintained map disagrees with the free lists
+    };
+
+    /* ***************************************** */
+
+    /**
+     * \brief Give the free lists back, if taken over, and drop the free block map (FBM)
+     *
+     * The FBM is an in-memory bitmap of the data zone, with a bit set per free block.
+     * It is built from the free lists (FBLT, superblock caches and reference pools) the first time
+     * it is queried, so a disk that never queries it pays nothing.
+     */
+    void soFBMClose();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Mark a block of the data zone as free or in use in the FBM
+     *
+     * Must be called whenever a block enters or leaves the free lists.
+     * Does nothing if the map is not built yet.
+     *
+     * \param[in] bn number of the block
+     * \param[in] free true if the block became free
+     */
+    void soFBMSet(uint32_t bn, bool free);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Check if a block of the data zone is free, according to the FBM
+     *
+     * \param[in] bn number of the block
+     * \return true if the block is free
+     */
+    bool soFBMIsFree(uint32_t bn);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Find a run of contiguous free blocks
+     *
+     * The search starts at block \c from, wrapping around at the end of the data zone,
+     * and stops at the first run of at least \c len blocks.
+     * If there is none, the longest run found is returned instead.
+     *
+     * \param[in] from number of the block where the search starts
+     * \param[in] len wanted length of the run
+     * \param[out] runlen length of the run found, if not \c NULL
+     * \return number of the first block of the run, or NullReference if no block is free
+     */
+    uint32_t soFBMFindRun(uint32_t from, uint32_t len, uint32_t * runlen);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Get the number of free blocks, according to the FBM
+     */
+    uint32_t soFBMCount();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Check the FBM against the free lists and the superblock
+     *
+     * A fresh map is built from the free lists and compared with the maintained one,
+     * which becomes the fresh one if it was not built yet.
+     *
+     * \param[out] rep where to put the result
+     */
+    void soFBMCheck(SOFBMReport * rep);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Make the FBM take over the free lists
+     *
+     * The reference pools are spilled, the map is built, and the free block list table
+     * and superblock caches are emptied.
+     * From then on, data blocks are allocated and freed with \c soFBMTake and \c soFBMGive,
+     * and the table is only rewritten from the map on \c soFBMFlush and \c soFBMRelease,
+     * which the superblock dealer calls before every write of the superblock to disk.
+     * Does nothing if already done.
+     */
+    void soFBMAcquire();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Check if the FBM has taken over the free lists
+     */
+    bool soFBMOwned();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Allocate data blocks from the FBM, as close to a given block as possible
+     *
+     * Blocks are taken from the run of free blocks starting at \c hint, if \c hint is free,
+     * and otherwise from the first run after it long enough for the remaining blocks
+     * (see \c soFBMFindRun), as many times as needed.
+     * The superblock free block count is updated.
+     * Throws \c EPERM if the map has not taken over the free lists.
+     *
+     * \param[in] hint number of the block wanted first
+     * \param[in] n number of blocks wanted
+     * \param[out] refs where to put the numbers of the blocks allocated
+     * \return number of blocks allocated, less than \c n only if the map ran out of free blocks
+     */
+    uint32_t soFBMTake(uint32_t hint, uint32_t n, uint32_t * refs);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Free data blocks into the FBM
+     *
+     * The superblock free block count is updated.
+     * Throws \c EINVAL, and frees nothing, if a block is out of range or already free,
+     * and \c EPERM if the map has not taken over the free lists.
+     *
+     * \param[in] refs numbers of the blocks
+     * \param[in] n number of blocks
+     */
+    void soFBMGive(const uint32_t * refs, uint32_t n);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Rewrite the free block list table from the FBM, if it has taken over the free lists
+     *
+     * The free blocks are written in ascending order from the start of the table,
+     * so the disk reflects the map; the map keeps the free lists.
+     */
+    void soFBMFlush();
+
+    /* ***************************************** */
+
+    /**
+     * \brief Give the free lists back, rewritten from the FBM
+     *
+     * The map stays built and is kept up to date as before \c soFBMAcquire.
+     */
+    void soFBMRelease();
+
+    /* ***************************************** */
+    /* ***************************************** */
+
     /**
      * \brief Read a block of the data zone
      *
@@ -268,6 +709,34 @@ namespace sofs18
      */
     void soWriteDataBlock(uint32_t bn, void *buf);
 
+    /* ***************************************** */
+
+    /**
+     * \brief Read a set of blocks of the data zone into consecutive buffers
+     * \details Block \c bns[i] is read into <tt>buf + i * BlockSize</tt>;
+     *  runs of adjacent block numbers cost a single vectored read.
+     *
+     * \param[in] bns array with the numbers of the blocks to be read
+     * \param[in] n number of blocks to be read
+     * \param[in] buf pointer to the buffer where the data must be read into;
+     *      it must be at least <tt>n * BlockSize</tt> bytes long
+     */
+    void soReadDataBlocks(const uint32_t * bns, uint32_t n, void *buf);
+
+    /* ***************************************** */
+
+    /**
+     * \brief Write a set of blocks of the data zone from consecutive buffers
+     * \details Block \c bns[i] is written from <tt>buf + i * BlockSize</tt>;
+     *  runs of adjacent block numbers cost a single vectored write.
+     *
+     * \param[in] bns array with the numbers of the blocks to be written
+     * \param[in] n number of blocks to be written
+     * \param[in] buf pointer to the buffer where the data must be written from;
+     *      it must be at least <tt>n * BlockSize</tt> bytes long
+     */
+    void soWriteDataBlocks(const uint32_t * bns, uint32_t n, void *buf);
+
     /* ***************************************** */
     /** @} close group dal */
     /* ***************************************** */
@@ -1,24 +1,92 @@
 #include "dal.h"
-#include "bin_dal.h"
 
 #include "rawdisk.h"
 #include "core.h"
 
+#include <errno.h>
 #include <inttypes.h>
+#include <sys/uio.h>
+
+#include <vector>
 
 namespace sofs18
 {
 
     void soReadDataBlock(uint32_t bn, void *buf)
     {
-        bin::soReadDataBlock(bn, buf);
+        soProbeHot(SOPROBE_GREEN, 561, "%s(%u, %p)\n", __FUNCTION__, bn, buf);
+
+        SOStatTimer timer(SOSTAT_DZ_READ);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        if (bn >= sb->dz_total)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soReadRawBlock(sb->dz_start + bn, buf);
     }
 
     /* ***************************************** */
 
     void soWriteDataBlock(uint32_t bn, void *buf)
     {
-        bin::soWriteDataBlock(bn, buf);
+        soProbeHot(SOPROBE_GREEN, 562, "%s(%u, %p)\n", __FUNCTION__, bn, buf);
+
+        SOStatTimer timer(SOSTAT_DZ_WRITE);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        if (bn >= sb->dz_total)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soWriteRawBlock(sb->dz_start + bn, buf);
+    }
+
+    /* ***************************************** */
+
+    /* block bns[i] of the data zone to or from buf + i * BlockSize, in a vectored transfer */
+    static void soTransferDataBlocks(const uint32_t * bns, uint32_t n, void *buf, 
+            bool writing, const char *funcname)
+    {
+        if (bns == NULL or buf == NULL)
+            throw SOException(EINVAL, funcname);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        std::vector<uint32_t> raw(n);
+        std::vector<struct iovec> iov(n);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (bns[i] >= sb->dz_total)
+                throw SOException(EINVAL, funcname);
+            raw[i] = sb->dz_start + bns[i];
+            iov[i].iov_base = (char *)buf + (size_t)i * BlockSize;
+            iov[i].iov_len = BlockSize;
+        }
+
+        if (writing)
+            soWriteRawBlockV(raw.data(), n, iov.data());
+        else
+            soReadRawBlockV(raw.data(), n, iov.data());
+    }
+
+    /* ***************************************** */
+
+    void soReadDataBlocks(const uint32_t * bns, uint32_t n, void *buf)
+    {
+        soProbeHot(SOPROBE_GREEN, 563, "%s(%p, %u, %p)\n", __FUNCTION__, bns, n, buf);
+
+        SOStatTimer timer(SOSTAT_DZ_READ, n);
+
+        soTransferDataBlocks(bns, n, buf, false, __FUNCTION__);
+    }
+
+    /* ***************************************** */
+
+    void soWriteDataBlocks(const uint32_t * bns, uint32_t n, void *buf)
+    {
+        soProbeHot(SOPROBE_GREEN, 564, "%s(%p, %u, %p)\n", __FUNCTION__, bns, n, buf);
+
+        SOStatTimer timer(SOSTAT_DZ_WRITE, n);
+
+        soTransferDataBlocks(bns, n, buf, true, __FUNCTION__);
     }
 
     /* ***************************************** */
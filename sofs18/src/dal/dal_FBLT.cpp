@@ -1,29 +1,89 @@
 #include "dal.h"
-#include "bin_dal.h"
 
+#include "rawdisk.h"
+#include "core.h"
+
+#include <errno.h>
 #include <inttypes.h>
 
+#include <vector>
+
 namespace sofs18
 {
     /* ***************************************** */
 
+    static uint32_t obn = NullReference;    ///< first block of the open window
+    static uint32_t ocnt = 0;               ///< number of blocks of the open window
+    static std::vector<uint32_t> ref;       ///< contents of the open window
+
+    /* ***************************************** */
+
+    uint32_t * soFBLTOpenBlocks(uint32_t bn, uint32_t cnt)
+    {
+        soProbe(SOPROBE_GREEN, 544, "%s(%u, %u)\n", __FUNCTION__, bn, cnt);
+
+        SOStatTimer timer(SOSTAT_FBLT_OPEN, cnt);
+
+        if (obn != NullReference)
+            throw SOException(EPERM, __FUNCTION__);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        if (cnt == 0 or bn >= sb->fblt_size or cnt > sb->fblt_size - bn)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        ref.resize((size_t)cnt * ReferencesPerBlock);
+        soReadRawBlocks(sb->fblt_start + bn, cnt, ref.data());
+        obn = bn;
+        ocnt = cnt;
+
+        return ref.data();
+    }
+
+    /* ***************************************** */
+
+    void soFBLTSaveBlocks()
+    {
+        soProbe(SOPROBE_GREEN, 545, "%s()\n", __FUNCTION__);
+
+        if (obn == NullReference)
+            throw SOException(EPERM, __FUNCTION__);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        soWriteRawBlocks(sb->fblt_start + obn, ocnt, ref.data());
+    }
+
+    /* ***************************************** */
+
+    void soFBLTCloseBlocks()
+    {
+        soProbe(SOPROBE_GREEN, 546, "%s()\n", __FUNCTION__);
+
+        if (obn == NullReference)
+            throw SOException(EPERM, __FUNCTION__);
+
+        obn = NullReference;
+        ocnt = 0;
+    }
+
+    /* ***************************************** */
+
     uint32_t * soFBLTOpenBlock(uint32_t bn)
     {
-        return bin::soFBLTOpenBlock(bn);
+        return soFBLTOpenBlocks(bn, 1);
     }
 
     /* ***************************************** */
 
     void soFBLTSaveBlock()
     {
-        bin::soFBLTSaveBlock();
+        soFBLTSaveBlocks();
     }
 
     /* ***************************************** */
 
     void soFBLTCloseBlock()
     {
-        bin::soFBLTCloseBlock();
+        soFBLTCloseBlocks();
     }
 
     /* ***************************************** */
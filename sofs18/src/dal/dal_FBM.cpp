@@ -0,0 +1,457 @@
+/*
+ *  \brief The free block map
+ *
+ *  An in-memory bitmap of the data zone, one bit per block, set if the block is free.
+ *  It is an index over the free lists, not a replacement:
+ *  it is built, on first use, from the references in the free block list table
+ *  (between fblt_head and fblt_tail), in the two superblock caches
+ *  and in the block reference pools,
+ *  and is kept up to date by the allocation and release dispatchers.
+ *  Moving references between the caches, the pools and the table does not change it.
+ *
+ *  The map can also take over the free lists (see soFBMAcquire): they are emptied,
+ *  blocks are allocated and freed on the map only, and the table is rewritten
+ *  from the map, in ascending order, on flush, on release and whenever
+ *  the superblock is written to disk.
+ */
+
+#include "dal.h"
+
+#include "rawdisk.h"
+#include "core.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* maximum number of FBLT blocks read through a single window while building */
+#define FBM_WINDOW 64
+
+    static bool built = false;
+    static uint32_t nbits = 0;                  ///< number of blocks of the data zone
+    static std::vector<uint64_t> words;         ///< the bitmap, bits beyond nbits being 0
+    static bool owned = false;                  ///< true if the map has taken over the free lists
+    static bool listsDirty = false;             ///< true if the table does not reflect the map
+
+    /* ***************************************** */
+
+    static inline bool soFBMTest(const std::vector<uint64_t> & map, uint32_t bn)
+    {
+        return (map[bn / 64] >> (bn % 64)) & 1;
+    }
+
+    /* ***************************************** */
+
+    /* add ref to map, counting duplicates and references out of range */
+    static void soFBMAdd(std::vector<uint64_t> & map, uint32_t ref, SOFBMReport * rep)
+    {
+        if (ref >= nbits)
+        {
+            if (rep != NULL)
+                rep->outOfRange++;
+            return;
+        }
+        if (soFBMTest(map, ref))
+        {
+            if (rep != NULL)
+                rep->duplicates++;
+            return;
+        }
+        map[ref / 64] |= (uint64_t)1 << (ref % 64);
+    }
+
+    /* ***************************************** */
+
+    /* build a map from the free lists */
+    static void soFBMScan(std::vector<uint64_t> & map, SOFBMReport * rep)
+    {
+        SOSuperBlock *sb = soSBGetPointer();
+        nbits = sb->dz_total;
+        map.assign((nbits + 63) / 64, 0);
+
+        /* retrieval cache, from idx on, and insertion cache, up to idx */
+        for (uint32_t i = sb->brcache.idx; i < BLOCK_REFERENCE_CACHE_SIZE; i++)
+            soFBMAdd(map, sb->brcache.ref[i], rep);
+        for (uint32_t i = 0; i < sb->bicache.idx; i++)
+            soFBMAdd(map, sb->bicache.ref[i], rep);
+
+        /* the in-memory reference pools */
+        std::vector<uint32_t> pooled(soRPCount(SORP_BLOCK));
+        soRPCopy(SORP_BLOCK, pooled.data());
+        for (uint32_t r : pooled)
+            soFBMAdd(map, r, rep);
+
+        /* the table, from head to tail, which may wrap around */
+        uint32_t tableSize = sb->fblt_size * ReferencesPerBlock;
+        uint32_t pos = sb->fblt_head;
+        uint32_t left = (tableSize == 0) ? 0 : (sb->fblt_tail + tableSize - sb->fblt_head) % tableSize;
+        while (left > 0)
+        {
+            uint32_t bn = pos / ReferencesPerBlock;
+            uint32_t off = pos % ReferencesPerBlock;
+            uint32_t cnt = sb->fblt_size - bn;
+            if (cnt > FBM_WINDOW)
+                cnt = FBM_WINDOW;
+            uint32_t chunk = cnt * ReferencesPerBlock - off;
+            if (chunk > left)
+                chunk = left;
+            cnt = (off + chunk + ReferencesPerBlock - 1) / ReferencesPerBlock;
+
+            uint32_t *ref = soFBLTOpenBlocks(bn, cnt);
+            for (uint32_t i = 0; i < chunk; i++)
+                soFBMAdd(map, ref[off + i], rep);
+            soFBLTCloseBlocks();
+
+            pos = (pos + chunk) % tableSize;
+            left -= chunk;
+        }
+    }
+
+    /* ***************************************** */
+
+    static void soFBMLoad()
+    {
+        if (built)
+            return;
+
+        soFBMScan(words, NULL);
+        built = true;
+    }
+
+    /* ***************************************** */
+
+    void soFBMClose()
+    {
+        soProbe(SOPROBE_GREEN, 571, "%s()\n", __FUNCTION__);
+
+        soFBMRelease();
+
+        built = false;
+        nbits = 0;
+        words.clear();
+        words.shrink_to_fit();
+    }
+
+    /* ***************************************** */
+
+    void soFBMSet(uint32_t bn, bool free)
+    {
+        /* nothing to keep up to date until the map is used */
+        if (not built)
+            return;
+
+        if (bn >= nbits)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        if (free)
+            words[bn / 64] |= (uint64_t)1 << (bn % 64);
+        else
+            words[bn / 64] &= ~((uint64_t)1 << (bn % 64));
+    }
+
+    /* ***************************************** */
+
+    bool soFBMIsFree(uint32_t bn)
+    {
+        soProbeHot(SOPROBE_GREEN, 572, "%s(%u)\n", __FUNCTION__, bn);
+
+        soFBMLoad();
+        if (bn >= nbits)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        return soFBMTest(words, bn);
+    }
+
+    /* ***************************************** */
+
+    /* first block at or after bn whose bit equals free, or nbits if none */
+    static uint32_t soFBMNext(uint32_t bn, bool free)
+    {
+        if (bn >= nbits)
+            return nbits;
+
+        uint64_t flip = free ? 0 : ~(uint64_t)0;
+        uint32_t w = bn / 64;
+        uint64_t x = (words[w] ^ flip) & (~(uint64_t)0 << (bn % 64));
+        while (x == 0)
+        {
+            if (++w == words.size())
+                return nbits;
+            x = words[w] ^ flip;
+        }
+
+        uint32_t r = w * 64 + __builtin_ctzll(x);
+        return (r < nbits) ? r : nbits;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soFBMFindRun(uint32_t from, uint32_t len, uint32_t * runlen)
+    {
+        soProbe(SOPROBE_GREEN, 573, "%s(%u, %u, %p)\n", __FUNCTION__, from, len, runlen);
+
+        soFBMLoad();
+        if (len == 0)
+            throw SOException(EINVAL, __FUNCTION__);
+        if (from >= nbits)
+            from = 0;
+
+        /* from the given block to the end, then from the start, keeping the longest run */
+        uint32_t best = NullReference, bestlen = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            uint32_t pos = (pass == 0) ? from : 0;
+            uint32_t end = (pass == 0) ? nbits : from;
+            while (pos < end)
+            {
+                uint32_t s = soFBMNext(pos, true);
+                if (s >= end)
+                    break;
+                uint32_t e = soFBMNext(s, false);
+                if (e - s > bestlen)
+                {
+                    best = s;
+                    bestlen = e - s;
+                    if (bestlen >= len)
+                    {
+                        if (runlen != NULL)
+                            *runlen = bestlen;
+                        return best;
+                    }
+                }
+                pos = e;
+            }
+        }
+
+        if (runlen != NULL)
+            *runlen = bestlen;
+        return best;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soFBMCount()
+    {
+        soProbe(SOPROBE_GREEN, 574, "%s()\n", __FUNCTION__);
+
+        soFBMLoad();
+
+        uint32_t n = 0;
+        for (uint64_t w : words)
+            n += __builtin_popcountll(w);
+        return n;
+    }
+
+    /* ***************************************** */
+
+    void soFBMCheck(SOFBMReport * rep)
+    {
+        soProbe(SOPROBE_GREEN, 575, "%s(%p)\n", __FUNCTION__, rep);
+
+        if (rep == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        memset(rep, 0, sizeof(SOFBMReport));
+
+        /* the lists are only meaningful once rewritten from the map */
+        soFBMFlush();
+
+        /* a fresh map, straight from the lists */
+        std::vector<uint64_t> fresh;
+        soFBMScan(fresh, rep);
+        for (uint64_t w : fresh)
+            rep->free += __builtin_popcountll(w);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        rep->dzFree = sb->dz_free;
+
+        /* blocks on which the maintained map disagrees with the lists */
+        if (built)
+        {
+            for (size_t i = 0; i < fresh.size(); i++)
+                rep->mismatches += __builtin_popcountll(fresh[i] ^ words[i]);
+        }
+        else
+        {
+            words.swap(fresh);
+            built = true;
+        }
+    }
+
+    /* ***************************************** */
+    void soFBMAcquire()
+    {
+        soProbe(SOPROBE_GREEN, 576, "%s()\n", __FUNCTION__);
+
+        if (owned)
+            return;
+
+        /* every free reference in the table and caches */
+        soRPFlush();
+        soFBMLoad();
+
+        /* empty the free lists */
+        SOSuperBlock *sb = soSBGetPointer();
+        memset(sb->brcache.ref, 0xFF, sizeof(sb->brcache.ref));
+        sb->brcache.idx = BLOCK_REFERENCE_CACHE_SIZE;
+        memset(sb->bicache.ref, 0xFF, sizeof(sb->bicache.ref));
+        sb->bicache.idx = 0;
+        sb->fblt_head = sb->fblt_tail = 0;
+
+        /* set first, so the table is rewritten before the superblock gets to disk */
+        owned = true;
+        listsDirty = true;
+        soSBSave();
+    }
+
+    /* ***************************************** */
+
+    bool soFBMOwned()
+    {
+        return owned;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soFBMTake(uint32_t hint, uint32_t n, uint32_t * refs)
+    {
+        soProbe(SOPROBE_GREEN, 577, "%s(%u, %u, %p)\n", __FUNCTION__, hint, n, refs);
+
+        if (not owned)
+            throw SOException(EPERM, __FUNCTION__);
+        if (refs == NULL and n > 0)
+            throw SOException(EINVAL, __FUNCTION__);
+        if (hint >= nbits)
+            hint = 0;
+
+        uint32_t got = 0;
+        uint32_t pos = hint;
+        while (got < n)
+        {
+            /* the run starting right at pos, else the first one long enough */
+            uint32_t s, len;
+            if (pos < nbits and soFBMTest(words, pos))
+            {
+                s = pos;
+                len = soFBMNext(pos, false) - pos;
+            }
+            else
+            {
+                s = soFBMFindRun(pos, n - got, &len);
+                if (s == NullReference)
+                    break;
+            }
+
+            uint32_t cnt = (len < n - got) ? len : n - got;
+            for (uint32_t i = 0; i < cnt; i++)
+            {
+                words[(s + i) / 64] &= ~((uint64_t)1 << ((s + i) % 64));
+                refs[got++] = s + i;
+            }
+            pos = s + cnt;
+        }
+
+        if (got > 0)
+        {
+            SOSuperBlock *sb = soSBGetPointer();
+            sb->dz_free -= got;
+            listsDirty = true;
+            soSBSave();
+        }
+
+        return got;
+    }
+
+    /* ***************************************** */
+
+    void soFBMGive(const uint32_t * refs, uint32_t n)
+    {
+        soProbe(SOPROBE_GREEN, 578, "%s(%p, %u)\n", __FUNCTION__, refs, n);
+
+        if (not owned)
+            throw SOException(EPERM, __FUNCTION__);
+        if (refs == NULL and n > 0)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        /* all or nothing: a block out of range or already free fails the whole call */
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (refs[i] >= nbits or soFBMTest(words, refs[i]))
+                throw SOException(EINVAL, __FUNCTION__);
+        }
+
+        for (uint32_t i = 0; i < n; i++)
+            words[refs[i] / 64] |= (uint64_t)1 << (refs[i] % 64);
+
+        if (n > 0)
+        {
+            SOSuperBlock *sb = soSBGetPointer();
+            sb->dz_free += n;
+            listsDirty = true;
+            soSBSave();
+        }
+    }
+
+    /* ***************************************** */
+
+    void soFBMFlush()
+    {
+        soProbe(SOPROBE_GREEN, 579, "%s()\n", __FUNCTION__);
+
+        if (not owned or not listsDirty)
+            return;
+
+        /* the free blocks, in ascending order, from the start of the table */
+        SOSuperBlock *sb = soSBGetPointer();
+        uint32_t tableSize = sb->fblt_size * ReferencesPerBlock;
+        uint32_t bn = 0;
+        uint32_t pos = 0;
+        uint32_t next = soFBMNext(0, true);
+        while (next < nbits and bn < sb->fblt_size)
+        {
+            uint32_t cnt = sb->fblt_size - bn;
+            if (cnt > FBM_WINDOW)
+                cnt = FBM_WINDOW;
+            uint32_t *ref = soFBLTOpenBlocks(bn, cnt);
+            uint32_t i;
+            for (i = 0; i < cnt * ReferencesPerBlock and next < nbits; i++)
+            {
+                ref[i] = next;
+                next = soFBMNext(next + 1, true);
+            }
+            for (uint32_t j = i; j < cnt * ReferencesPerBlock; j++)
+                ref[j] = NullReference;
+            soFBLTSaveBlocks();
+            soFBLTCloseBlocks();
+
+            pos += i;
+            bn += cnt;
+        }
+
+        sb->fblt_head = 0;
+        sb->fblt_tail = pos % tableSize;
+        listsDirty = false;
+        soSBSave();
+    }
+
+    /* ***************************************** */
+
+    void soFBMRelease()
+    {
+        soProbe(SOPROBE_GREEN, 580, "%s()\n", __FUNCTION__);
+
+        if (not owned)
+            return;
+
+        soFBMFlush();
+        owned = false;
+    }
+
+    /* ***************************************** */
+};
@@ -1,28 +1,89 @@
 #include "dal.h"
-#include "bin_dal.h"
 
+#include "rawdisk.h"
+#include "core.h"
+
+#include <errno.h>
 #include <inttypes.h>
 
+#include <vector>
+
 namespace sofs18
 {
+    /* ***************************************** */
+
+    static uint32_t obn = NullReference;    ///< first block of the open window
+    static uint32_t ocnt = 0;               ///< number of blocks of the open window
+    static std::vector<uint32_t> ref;       ///< contents of the open window
+
+    /* ***************************************** */
+
+    uint32_t * soFILTOpenBlocks(uint32_t bn, uint32_t cnt)
+    {
+        soProbe(SOPROBE_GREEN, 524, "%s(%u, %u)\n", __FUNCTION__, bn, cnt);
+
+        SOStatTimer timer(SOSTAT_FILT_OPEN, cnt);
+
+        if (obn != NullReference)
+            throw SOException(EPERM, __FUNCTION__);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        if (cnt == 0 or bn >= sb->filt_size or cnt > sb->filt_size - bn)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        ref.resize((size_t)cnt * ReferencesPerBlock);
+        soReadRawBlocks(sb->filt_start + bn, cnt, ref.data());
+        obn = bn;
+        ocnt = cnt;
+
+        return ref.data();
+    }
+
+    /* ***************************************** */
+
+    void soFILTSaveBlocks()
+    {
+        soProbe(SOPROBE_GREEN, 525, "%s()\n", __FUNCTION__);
+
+        if (obn == NullReference)
+            throw SOException(EPERM, __FUNCTION__);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        soWriteRawBlocks(sb->filt_start + obn, ocnt, ref.data());
+    }
+
+    /* ***************************************** */
+
+    void soFILTCloseBlocks()
+    {
+        soProbe(SOPROBE_GREEN, 526, "%s()\n", __FUNCTION__);
+
+        if (obn == NullReference)
+            throw SOException(EPERM, __FUNCTION__);
+
+        obn = NullReference;
+        ocnt = 0;
+    }
+
+    /* ***************************************** */
 
     uint32_t * soFILTOpenBlock(uint32_t bn)
     {
-        return bin::soFILTOpenBlock(bn);
+        return soFILTOpenBlocks(bn, 1);
     }
 
     /* ***************************************** */
 
     void soFILTSaveBlock()
     {
-        bin::soFILTSaveBlock();
+        soFILTSaveBlocks();
     }
 
     /* ***************************************** */
 
     void soFILTCloseBlock()
     {
-        bin::soFILTCloseBlock();
+        soFILTCloseBlocks();
     }
 
     /* ***************************************** */
@@ -1,63 +1,363 @@
+/*
+ *  \brief The inode table dealer
+ *
+ *  Open inodes live in a cache of inode table blocks.
+ *  A block is pinned while some of its inodes are open,
+ *  and unpinned blocks are recycled in LRU order.
+ *  Saving an inode only marks its block dirty;
+ *  dirty blocks are written back on eviction, on flush and on close.
+ */
+
 #include "dal.h"
-#include "bin_dal.h"
 
+#include "rawdisk.h"
 #include "core.h"
 
+#include <errno.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unordered_map>
+#include <vector>
 
 namespace sofs18
 {
     /* ************************************** */
 
+    /* maximum number of simultaneously open inodes */
+#define IT_POOL_SIZE 2000
+
+    /* default number of unpinned inode table blocks kept in memory */
+#define IT_CACHE_DEFAULT_SIZE 32
+
+    /* a cached block of the inode table */
+    struct SOITBlock
+    {
+        uint32_t bn;        ///< relative number of the block within the inode table
+        uint32_t refcnt;    ///< number of open inodes within the block
+        bool dirty;         ///< true if the block differs from the disk
+        uint64_t stamp;     ///< time of last use, for LRU replacement
+        SOInode inode[InodesPerBlock];
+    };
+
+    /* an open inode */
+    struct SOITSlot
+    {
+        uint32_t usecount;  ///< number of opens not yet closed; 0 means free slot
+        uint32_t in;        ///< inode number
+        SOITBlock *blk;     ///< block holding the inode
+    };
+
+    static bool itOpen = false;
+    static SOITSlot pool[IT_POOL_SIZE];
+    static std::unordered_map<uint32_t, int> openInodes;    ///< inode number to handler
+    static uint32_t nfree = 0;                              ///< number of free slots in pool
+
+    static std::vector<SOITBlock *> blocks;                 ///< cached blocks
+    static std::unordered_map<uint32_t, SOITBlock *> cachedBlocks; ///< block number to block
+    static uint32_t capacity = 0;
+    static bool capacity_set = false;
+    static uint64_t tick = 0;             ///< logical clock, for LRU replacement
+
+    static SOITCacheStats stats;
+
+    /* ************************************** */
+
+    /* write back block b, if dirty */
+    static void soITWriteBack(SOITBlock * b)
+    {
+        if (b->dirty)
+        {
+            SOSuperBlock *sb = soSBGetPointer();
+            soWriteRawBlock(sb->it_start + b->bn, b->inode);
+            b->dirty = false;
+            stats.writebacks++;
+        }
+    }
+
+    /* ************************************** */
+
+    /* get block bn into the cache, loading it if necessary */
+    static SOITBlock *soITGetBlock(uint32_t bn)
+    {
+        auto it = cachedBlocks.find(bn);
+        if (it != cachedBlocks.end())
+        {
+            stats.hits++;
+            it->second->stamp = ++tick;
+            return it->second;
+        }
+        stats.misses++;
+
+        /* pick a free slot, or the least recently used unpinned block */
+        SOITBlock *b = NULL;
+        if (blocks.size() >= capacity)
+        {
+            for (SOITBlock *c : blocks)
+            {
+                if (c->refcnt == 0 and (b == NULL or c->stamp < b->stamp))
+                    b = c;
+            }
+        }
+
+        if (b != NULL)
+        {
+            soITWriteBack(b);
+            if (b->bn != NullReference)
+                cachedBlocks.erase(b->bn);
+        }
+        else
+        {
+            /* every block is pinned: grow beyond capacity */
+            b = new SOITBlock;
+            blocks.push_back(b);
+        }
+
+        /* the slot is left empty if the read fails */
+        b->bn = NullReference;
+        b->refcnt = 0;
+        b->dirty = false;
+        b->stamp = 0;
+
+        SOSuperBlock *sb = soSBGetPointer();
+        soReadRawBlock(sb->it_start + bn, b->inode);
+        b->bn = bn;
+        b->stamp = ++tick;
+        cachedBlocks[bn] = b;
+
+        return b;
+    }
+
+    /* ************************************** */
+
+    /* release blocks beyond capacity that are no longer pinned */
+    static void soITShrink()
+    {
+        for (uint32_t i = 0; i < blocks.size() and blocks.size() > capacity; )
+        {
+            SOITBlock *b = blocks[i];
+            if (b->refcnt == 0)
+            {
+                soITWriteBack(b);
+                if (b->bn != NullReference)
+                    cachedBlocks.erase(b->bn);
+                delete b;
+                blocks[i] = blocks.back();
+                blocks.pop_back();
+            }
+            else
+                i++;
+        }
+    }
+
+    /* ************************************** */
+
     void soITOpen()
     {
-        bin::soITOpen();
+        soProbe(SOPROBE_GREEN, 531, "%s()\n", __FUNCTION__);
+
+        if (itOpen)
+            return;
+
+        /* set capacity, if not done explicitly */
+        if (not capacity_set)
+        {
+            const char *env = getenv("SOFS18_ITCACHE_BLOCKS");
+            capacity = (env != NULL) ? (uint32_t)atol(env) : IT_CACHE_DEFAULT_SIZE;
+        }
+
+        for (int i = 0; i < IT_POOL_SIZE; i++)
+        {
+            pool[i].usecount = 0;
+            pool[i].in = NullReference;
+            pool[i].blk = NULL;
+        }
+        nfree = IT_POOL_SIZE;
+        openInodes.clear();
+        blocks.reserve(capacity);
+
+        itOpen = true;
     }
 
     /* ***************************************** */
 
     void soITClose()
     {
-        bin::soITClose();
+        soProbe(SOPROBE_GREEN, 532, "%s()\n", __FUNCTION__);
+
+        if (not itOpen)
+            return;
+
+        /* inodes still open are saved too, since their blocks are cached */
+        soITFlush();
+
+        for (SOITBlock *b : blocks)
+            delete b;
+        blocks.clear();
+        cachedBlocks.clear();
+        openInodes.clear();
+
+        itOpen = false;
+    }
+
+    /* ************************************** */
+
+    void soITFlush()
+    {
+        soProbe(SOPROBE_GREEN, 538, "%s()\n", __FUNCTION__);
+
+        if (not itOpen)
+            return;
+
+        for (SOITBlock *b : blocks)
+            soITWriteBack(b);
     }
 
     /* ************************************** */
 
     int soITOpenInode(uint32_t in)
     {
-        return bin::soITOpenInode(in);
+        soProbe(SOPROBE_GREEN, 533, "%s(%u)\n", __FUNCTION__, in);
+
+        SOStatTimer timer(SOSTAT_IT_OPEN);
+
+        if (not itOpen)
+            throw SOException(EBADF, __FUNCTION__);
+
+        SOSuperBlock *sb = soSBGetPointer();
+        if (in >= sb->itotal)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        /* if already open, share the handler */
+        auto it = openInodes.find(in);
+        if (it != openInodes.end())
+        {
+            pool[it->second].usecount++;
+            pool[it->second].blk->stamp = ++tick;
+            stats.hits++;
+            return it->second;
+        }
+
+        if (nfree == 0)
+            throw SOException(ENFILE, __FUNCTION__);
+
+        int ih = 0;
+        while (pool[ih].usecount != 0)
+            ih++;
+
+        SOITBlock *b = soITGetBlock(in / InodesPerBlock);
+        b->refcnt++;
+
+        pool[ih].usecount = 1;
+        pool[ih].in = in;
+        pool[ih].blk = b;
+        openInodes[in] = ih;
+        nfree--;
+
+        return ih;
+    }
+
+    /* ************************************** */
+
+    void soITCheckHandler(int ih, const char * funcname)
+    {
+        if (not itOpen)
+            throw SOException(EBADF, funcname);
+
+        if (ih < 0 or ih >= IT_POOL_SIZE or pool[ih].usecount == 0)
+            throw SOException(EINVAL, funcname);
     }
 
     /* ************************************** */
 
     void soITSaveInode(int ih)
     {
-        bin::soITSaveInode(ih);
+        soProbeHot(SOPROBE_GREEN, 534, "%s(%d)\n", __FUNCTION__, ih);
+
+        SOStatTimer timer(SOSTAT_IT_SAVE);
+
+        soITCheckHandler(ih, __FUNCTION__);
+
+        pool[ih].blk->dirty = true;
     }
 
     /* ************************************** */
 
     void soITCloseInode(int ih)
     {
-        bin::soITCloseInode(ih);
+        soProbe(SOPROBE_GREEN, 535, "%s(%d)\n", __FUNCTION__, ih);
+
+        soITCheckHandler(ih, __FUNCTION__);
+
+        if (--pool[ih].usecount > 0)
+            return;
+
+        /* release the slot, unpinning its block */
+        SOITBlock *b = pool[ih].blk;
+        openInodes.erase(pool[ih].in);
+        pool[ih].in = NullReference;
+        pool[ih].blk = NULL;
+        nfree++;
+
+        if (--b->refcnt == 0 and blocks.size() > capacity)
+            soITShrink();
     }
 
     /* ************************************** */
 
     SOInode* soITGetInodePointer(int ih)
     {
-        return bin::soITGetInodePointer(ih);
+        soProbeHot(SOPROBE_GREEN, 536, "%s(%d)\n", __FUNCTION__, ih);
+
+        soITCheckHandler(ih, __FUNCTION__);
+
+        return &pool[ih].blk->inode[pool[ih].in % InodesPerBlock];
     }
 
     /* ************************************** */
 
     uint32_t soITGetInodeID(int ih)
     {
-        return bin::soITGetInodeID(ih);
+        soProbeHot(SOPROBE_GREEN, 537, "%s(%d)\n", __FUNCTION__, ih);
+
+        soITCheckHandler(ih, __FUNCTION__);
+
+        return pool[ih].in;
     }
 
     /* ************************************** */
 
-};
+    void soITSetCacheSize(uint32_t nblocks)
+    {
+        soProbe(SOPROBE_GREEN, 539, "%s(%u)\n", __FUNCTION__, nblocks);
+
+        capacity = nblocks;
+        capacity_set = true;
 
+        if (itOpen)
+            soITShrink();
+    }
+
+    /* ************************************** */
+
+    void soITGetCacheStats(SOITCacheStats * st)
+    {
+        if (st == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        *st = stats;
+        st->size = capacity;
+        st->used = blocks.size();
+        st->dirty = 0;
+        for (SOITBlock *b : blocks)
+        {
+            if (b->dirty)
+                st->dirty++;
+        }
+    }
+
+    /* ************************************** */
+
+};
 
@@ -3,16 +3,50 @@
 #include "rawdisk.h"
 #include "core.h"
 
+#include <errno.h>
+#include <string.h>
+
 #include <iostream>
 
 namespace sofs18
 {
 
+    /* check that the disk was formatted with the current block size */
+    static void soCheckBlockSize(uint32_t ntotal)
+    {
+        union { SOSuperBlock sb; char data[BlockSize]; } block0;
+        soReadRawBlock(0, &block0);
+
+        if (block0.sb.magic == MAGIC_NUMBER and block0.sb.ntotal != ntotal)
+            throw SOException(EMEDIUMTYPE, "soOpenDisk");
+
+        if (BlockSize > BlockSizeStampOffset)
+        {
+            uint32_t bs;
+            memcpy(&bs, block0.data + BlockSizeStampOffset, sizeof(bs));
+            if (bs != BlockSize)
+                throw SOException(EMEDIUMTYPE, "soOpenDisk");
+        }
+    }
+
     void soOpenDisk(const char * devname)
     {
         soProbe(SOPROBE_GREEN, 501, "%s(%s)\n", __FUNCTION__, devname);
 
-        soOpenRawDisk(devname);
+        uint32_t ntotal;
+        soOpenRawDisk(devname, &ntotal);
+
+        /* a disk formatted with a different block size does not conform */
+        try
+        {
+            soCheckBlockSize(ntotal);
+        }
+        catch (SOException & err)
+        {
+            soCloseRawDisk();
+            throw;
+        }
+
         soSBOpen();
         soITOpen();
     }
@@ -21,10 +55,23 @@ namespace sofs18
     {
         soProbe(SOPROBE_GREEN, 502, "%s()\n", __FUNCTION__);
 
+        soRPClose();
+        soFBMClose();
         soITClose();
         soSBClose();
         soCloseRawDisk();
     }
 
+    void soSyncDisk()
+    {
+        soProbe(SOPROBE_GREEN, 503, "%s()\n", __FUNCTION__);
+
+        soRPFlush();
+        soFBMFlush();
+        soITFlush();
+        soSBFlush();
+        soSyncRawDisk();
+    }
+
 };
 
@@ -0,0 +1,334 @@
+/*
+ *  \brief The reference pool dealer
+ *
+ *  An in-memory second level between the superblock reference caches
+ *  and the free inode and free block list tables.
+ *  References are taken from the head of a table, and put at its tail,
+ *  a whole pool at a time, so the tables are only touched once every
+ *  <tt>capacity</tt> references instead of once every cache full.
+ *  References held in the pools are still counted as free in the superblock;
+ *  on flush and on close they are spilled back to the tables:
+ *  the retrieval pool before the head, where they came from,
+ *  the insertion pool after the tail.
+ */
+
+#include "dal.h"
+
+#include "rawdisk.h"
+#include "core.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* default capacity of the pools, in references */
+#define RP_DEFAULT_CAPACITY 1024
+
+    struct SORefPool
+    {
+        std::vector<uint32_t> rref;     ///< retrieval pool, in table order
+        uint32_t rpos;                  ///< first reference of the retrieval pool not handed out
+        std::vector<uint32_t> iref;     ///< insertion pool, in release order
+        uint32_t capacity;
+    };
+
+    static SORefPool pool[2] = {
+        {std::vector<uint32_t>(), 0, std::vector<uint32_t>(), RP_DEFAULT_CAPACITY},
+        {std::vector<uint32_t>(), 0, std::vector<uint32_t>(), RP_DEFAULT_CAPACITY}
+    };
+    static bool capacitySet = false;
+    static bool configured = false;
+
+    /* ***************************************** */
+
+    /* the table of a kind of pool, as described in the superblock */
+    struct SORefTable
+    {
+        uint32_t size;          ///< number of references of the table
+        uint32_t *head;
+        uint32_t *tail;
+        uint32_t * (*open)(uint32_t bn, uint32_t cnt);
+        void (*save)();
+        void (*close)();
+    };
+
+    static SORefTable soRPTable(SORPKind k)
+    {
+        SOSuperBlock *sb = soSBGetPointer();
+        if (k == SORP_INODE)
+            return {(uint32_t)(sb->filt_size * ReferencesPerBlock), &sb->filt_head, &sb->filt_tail,
+                soFILTOpenBlocks, soFILTSaveBlocks, soFILTCloseBlocks};
+        else
+            return {(uint32_t)(sb->fblt_size * ReferencesPerBlock), &sb->fblt_head, &sb->fblt_tail,
+                soFBLTOpenBlocks, soFBLTSaveBlocks, soFBLTCloseBlocks};
+    }
+
+    /* ***************************************** */
+
+    /* take capacities from the environment, if not set explicitly */
+    static void soRPConfigure()
+    {
+        if (configured)
+            return;
+
+        if (not capacitySet)
+        {
+            const char *env = getenv("SOFS18_RP_INODES");
+            pool[SORP_INODE].capacity = (env != NULL) ? (uint32_t)atol(env) : RP_DEFAULT_CAPACITY;
+            env = getenv("SOFS18_RP_BLOCKS");
+            pool[SORP_BLOCK].capacity = (env != NULL) ? (uint32_t)atol(env) : RP_DEFAULT_CAPACITY;
+        }
+        configured = true;
+    }
+
+    /* ***************************************** */
+
+    /*
+     * copy n references between buf and the table, starting at position pos,
+     * crossing block boundaries and the end of the table if necessary;
+     * references copied out of the table are cleared there
+     */
+    static void soRPTableCopy(SORefTable & t, uint32_t pos, uint32_t * buf, uint32_t n, bool toTable)
+    {
+        for (uint32_t done = 0; done < n; )
+        {
+            uint32_t bn = pos / ReferencesPerBlock;
+            uint32_t off = pos % ReferencesPerBlock;
+            uint32_t chunk = n - done;
+            if (chunk > t.size - pos)
+                chunk = t.size - pos;
+            uint32_t cnt = (off + chunk + ReferencesPerBlock - 1) / ReferencesPerBlock;
+
+            uint32_t *ref = t.open(bn, cnt);
+            if (toTable)
+                memcpy(&ref[off], &buf[done], chunk * sizeof(uint32_t));
+            else
+            {
+                memcpy(&buf[done], &ref[off], chunk * sizeof(uint32_t));
+                memset(&ref[off], 0xFF, chunk * sizeof(uint32_t));
+            }
+            t.save();
+            t.close();
+
+            pos = (pos + chunk) % t.size;
+            done += chunk;
+        }
+    }
+
+    /* ***************************************** */
+
+    /* number of references in the table */
+    static uint32_t soRPTableUsed(SORefTable & t)
+    {
+        return (t.size == 0) ? 0 : (*t.tail + t.size - *t.head) % t.size;
+    }
+
+    /* ***************************************** */
+
+    /* take up to n references from the head of the table */
+    static uint32_t soRPTableTake(SORPKind k, uint32_t * buf, uint32_t n)
+    {
+        SORefTable t = soRPTable(k);
+        uint32_t used = soRPTableUsed(t);
+        if (n > used)
+            n = used;
+        if (n == 0)
+            return 0;
+
+        soRPTableCopy(t, *t.head, buf, n, false);
+        *t.head = (*t.head + n) % t.size;
+        if (*t.head == *t.tail)
+        {
+            *t.head = 0;
+            *t.tail = 0;
+        }
+        soSBSave();
+
+        return n;
+    }
+
+    /* ***************************************** */
+
+    /* put up to n references at the tail (or before the head) of the table */
+    static uint32_t soRPTablePut(SORPKind k, uint32_t * buf, uint32_t n, bool atHead)
+    {
+        SORefTable t = soRPTable(k);
+        uint32_t room = t.size - soRPTableUsed(t);
+        if (n > room)
+            n = room;
+        if (n == 0)
+            return 0;
+
+        if (atHead)
+        {
+            *t.head = (*t.head + t.size - n) % t.size;
+            soRPTableCopy(t, *t.head, buf, n, true);
+        }
+        else
+        {
+            soRPTableCopy(t, *t.tail, buf, n, true);
+            *t.tail = (*t.tail + n) % t.size;
+        }
+        soSBSave();
+
+        return n;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soRPTake(SORPKind k, uint32_t * refs, uint32_t n)
+    {
+        soProbe(SOPROBE_GREEN, 586, "%s(%d, %p, %u)\n", __FUNCTION__, k, refs, n);
+
+        if ((k != SORP_INODE and k != SORP_BLOCK) or (refs == NULL and n > 0))
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soRPConfigure();
+        SORefPool & p = pool[k];
+
+        uint32_t got = 0;
+        while (got < n)
+        {
+            /* refill the retrieval pool, from the table or else from the insertion pool */
+            if (p.rpos == p.rref.size())
+            {
+                uint32_t batch = (p.capacity > n - got) ? p.capacity : n - got;
+                p.rref.resize(batch);
+                p.rref.resize(soRPTableTake(k, p.rref.data(), batch));
+                p.rpos = 0;
+                if (p.rref.empty())
+                {
+                    if (p.iref.empty())
+                        break;
+                    p.rref.swap(p.iref);
+                }
+            }
+
+            uint32_t cnt = p.rref.size() - p.rpos;
+            if (cnt > n - got)
+                cnt = n - got;
+            memcpy(&refs[got], &p.rref[p.rpos], cnt * sizeof(uint32_t));
+            p.rpos += cnt;
+            got += cnt;
+        }
+
+        return got;
+    }
+
+    /* ***************************************** */
+
+    void soRPPut(SORPKind k, const uint32_t * refs, uint32_t n)
+    {
+        soProbe(SOPROBE_GREEN, 587, "%s(%d, %p, %u)\n", __FUNCTION__, k, refs, n);
+
+        if ((k != SORP_INODE and k != SORP_BLOCK) or (refs == NULL and n > 0))
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soRPConfigure();
+        SORefPool & p = pool[k];
+
+        p.iref.insert(p.iref.end(), refs, refs + n);
+
+        /* spill the whole pool once full; what does not fit in the table stays */
+        if (p.iref.size() > 0 and p.iref.size() >= p.capacity)
+        {
+            uint32_t cnt = soRPTablePut(k, p.iref.data(), p.iref.size(), false);
+            p.iref.erase(p.iref.begin(), p.iref.begin() + cnt);
+        }
+    }
+
+    /* ***************************************** */
+
+    void soRPFlush()
+    {
+        soProbe(SOPROBE_GREEN, 588, "%s()\n", __FUNCTION__);
+
+        for (int k = SORP_INODE; k <= SORP_BLOCK; k++)
+        {
+            SORefPool & p = pool[k];
+
+            if (p.rpos < p.rref.size())
+            {
+                uint32_t cnt = p.rref.size() - p.rpos;
+                p.rpos += soRPTablePut((SORPKind)k, &p.rref[p.rpos], cnt, true);
+            }
+            if (p.rpos == p.rref.size())
+            {
+                p.rref.clear();
+                p.rpos = 0;
+            }
+
+            if (not p.iref.empty())
+            {
+                uint32_t cnt = soRPTablePut((SORPKind)k, p.iref.data(), p.iref.size(), false);
+                p.iref.erase(p.iref.begin(), p.iref.begin() + cnt);
+            }
+        }
+    }
+
+    /* ***************************************** */
+
+    void soRPClose()
+    {
+        soProbe(SOPROBE_GREEN, 589, "%s()\n", __FUNCTION__);
+
+        soRPFlush();
+
+        for (int k = SORP_INODE; k <= SORP_BLOCK; k++)
+        {
+            pool[k].rref = std::vector<uint32_t>();
+            pool[k].rpos = 0;
+            pool[k].iref = std::vector<uint32_t>();
+        }
+        configured = false;
+    }
+
+    /* ***************************************** */
+
+    void soRPSetCapacity(uint32_t inodes, uint32_t blocks)
+    {
+        soProbe(SOPROBE_GREEN, 590, "%s(%u, %u)\n", __FUNCTION__, inodes, blocks);
+
+        pool[SORP_INODE].capacity = inodes;
+        pool[SORP_BLOCK].capacity = blocks;
+        capacitySet = true;
+        configured = true;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soRPCount(SORPKind k)
+    {
+        if (k != SORP_INODE and k != SORP_BLOCK)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        SORefPool & p = pool[k];
+        return p.rref.size() - p.rpos + p.iref.size();
+    }
+
+    /* ***************************************** */
+
+    void soRPCopy(SORPKind k, uint32_t * refs)
+    {
+        if (k != SORP_INODE and k != SORP_BLOCK)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        SORefPool & p = pool[k];
+        if (refs == NULL and p.rref.size() - p.rpos + p.iref.size() > 0)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        uint32_t n = p.rref.size() - p.rpos;
+        memcpy(refs, p.rref.data() + p.rpos, n * sizeof(uint32_t));
+        memcpy(refs + n, p.iref.data(), p.iref.size() * sizeof(uint32_t));
+    }
+
+    /* ***************************************** */
+};
+
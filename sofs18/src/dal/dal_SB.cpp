@@ -1,37 +1,230 @@
+/*
+ *  \brief The superblock dealer
+ *
+ *  Saving the superblock only marks it dirty;
+ *  it is written to disk at commit points:
+ *  every given number of saves, every given number of milliseconds,
+ *  on flush and on close.
+ *  While the disk copy is stale, its \c mntstat field is 0.
+ *  If the FBM has taken over the free lists, the free block list table
+ *  is rewritten from it at every commit point, ahead of the superblock.
+ */
+
 #include "dal.h"
-#include "bin_dal.h"
 
-#include <string.h>
+#include "rawdisk.h"
+#include "core.h"
+
+#include <errno.h>
 #include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 namespace sofs18
 {
     /* ***************************************** */
 
+    /* default commit policy */
+#define SB_COMMIT_DEFAULT_OPS 64
+#define SB_COMMIT_DEFAULT_MS 1000
+
+    /* block 0, holding the superblock */
+    static union
+    {
+        SOSuperBlock sb;
+        char data[BlockSize];
+    } block0;
+    static SOSuperBlock & sb = block0.sb;
+    static bool sbLoaded = false;
+
+    static bool dirty = false;          ///< true if the disk copy is stale
+    static bool unclean = false;        ///< true if the disk copy has mntstat at 0
+    static uint32_t pending = 0;        ///< saves since the last write
+    static uint64_t lastCommit = 0;     ///< time of the last write, in ms
+    static bool writing = false;        ///< true while a write is being prepared
+
+    static uint32_t commitOps = SB_COMMIT_DEFAULT_OPS;
+    static uint32_t commitMs = SB_COMMIT_DEFAULT_MS;
+    static bool policySet = false;
+
+    static SOSBStats stats;
+
+    /* ***************************************** */
+
+    /* monotonic time in milliseconds */
+    static uint64_t soSBNow()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+    /* ***************************************** */
+
+    /* write the superblock to disk, with the given mount status;
+     * it bypasses the write-back block cache, so a disk copy flagged as not properly unmounted
+     * gets there before any other block held dirty in the cache,
+     * and one flagged as properly unmounted only after all of them */
+    static void soSBWrite(uint8_t mntstat)
+    {
+        /* the table the superblock points to must match the map;
+         * the saves this does are folded into this write */
+        writing = true;
+        try
+        {
+            soFBMFlush();
+        }
+        catch (SOException & err)
+        {
+            writing = false;
+            throw;
+        }
+        writing = false;
+
+        if (mntstat != 0)
+            soSyncRawDisk();
+
+        sb.mntstat = mntstat;
+        soWriteRawBlocks(0, 1, &block0);
+        stats.writes++;
+
+        unclean = (mntstat == 0);
+        dirty = false;
+        pending = 0;
+        lastCommit = soSBNow();
+    }
+
+    /* ***************************************** */
+
+    /* load the superblock from disk */
+    static void soSBLoad()
+    {
+        soReadRawBlock(0, &block0);
+        if (sb.magic != MAGIC_NUMBER or sb.version != VERSION_NUMBER)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        sbLoaded = true;
+        dirty = false;
+        unclean = (sb.mntstat == 0);
+        pending = 0;
+        lastCommit = soSBNow();
+    }
+
+    /* ***************************************** */
+
     void soSBOpen()
     {
-        bin::soSBOpen();
+        soProbe(SOPROBE_GREEN, 511, "%s()\n", __FUNCTION__);
+
+        if (sbLoaded)
+            return;
+
+        /* set commit policy, if not done explicitly */
+        if (not policySet)
+        {
+            const char *env = getenv("SOFS18_SB_COMMIT_OPS");
+            commitOps = (env != NULL) ? (uint32_t)atol(env) : SB_COMMIT_DEFAULT_OPS;
+            env = getenv("SOFS18_SB_COMMIT_MS");
+            commitMs = (env != NULL) ? (uint32_t)atol(env) : SB_COMMIT_DEFAULT_MS;
+        }
+
+        soSBLoad();
     }
 
     /* ***************************************** */
 
     void soSBSave()
     {
-        bin::soSBSave();
+        soProbe(SOPROBE_GREEN, 512, "%s()\n", __FUNCTION__);
+
+        SOStatTimer timer(SOSTAT_SB_SAVE);
+
+        if (not sbLoaded)
+            return;
+
+        stats.saves++;
+        dirty = true;
+        pending++;
+
+        if (writing)
+            return;
+
+        /* before deferring any write, flag the disk copy as not properly unmounted */
+        if (not unclean)
+        {
+            soSBWrite(0);
+            return;
+        }
+
+        /* commit point reached? */
+        if ((commitOps != 0 and pending >= commitOps)
+                or (commitMs != 0 and soSBNow() - lastCommit >= commitMs))
+        {
+            soSBWrite(0);
+            return;
+        }
+
+        stats.elided++;
+    }
+
+    /* ***************************************** */
+
+    void soSBFlush()
+    {
+        soProbe(SOPROBE_GREEN, 515, "%s()\n", __FUNCTION__);
+
+        if (sbLoaded and dirty)
+            soSBWrite(0);
     }
 
     /* ***************************************** */
 
     void soSBClose()
     {
-        bin::soSBClose();
+        soProbe(SOPROBE_GREEN, 513, "%s()\n", __FUNCTION__);
+
+        if (not sbLoaded)
+            return;
+
+        /* the disk copy is up to date: flag it as properly unmounted */
+        if (dirty or unclean)
+            soSBWrite(1);
+
+        sbLoaded = false;
     }
 
     /* ***************************************** */
 
     SOSuperBlock * soSBGetPointer()
     {
-        return bin::soSBGetPointer();
+        soProbeHot(SOPROBE_GREEN, 514, "%s()\n", __FUNCTION__);
+
+        if (not sbLoaded)
+            soSBLoad();
+
+        return &sb;
+    }
+
+    /* ***************************************** */
+
+    void soSBSetCommitPolicy(uint32_t ops, uint32_t ms)
+    {
+        soProbe(SOPROBE_GREEN, 516, "%s(%u, %u)\n", __FUNCTION__, ops, ms);
+
+        commitOps = ops;
+        commitMs = ms;
+        policySet = true;
+    }
+
+    /* ***************************************** */
+
+    void soSBGetStats(SOSBStats * st)
+    {
+        if (st == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        *st = stats;
     }
 
     /* ***************************************** */
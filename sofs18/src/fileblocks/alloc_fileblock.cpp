@@ -13,6 +13,16 @@ namespace sofs18
 
     uint32_t soAllocFileBlock(int ih, uint32_t fbn)
     {
+        soDelallocMakeRoom(soDelallocWorstCase(ih, fbn, 1));
+
+        soExtentConvert(ih);
+        if (soIsExtentInode(ih))
+        {
+            uint32_t ref;
+            soExtentAllocFileBlocks(ih, fbn, 1, &ref);
+            return ref;
+        }
+
         if (soBinSelected(302))
             return bin::soAllocFileBlock(ih, fbn);
         else
@@ -0,0 +1,36 @@
+#include "fileblocks.h"
+#include "bin_fileblocks.h"
+#include "work_fileblocks.h"
+
+#include "core.h"
+
+#include <errno.h>
+
+namespace sofs18
+{
+
+    void soAllocFileBlocks(int ih, uint32_t fbn, uint32_t n, uint32_t *refs)
+    {
+        soDelallocMakeRoom(soDelallocWorstCase(ih, fbn, n));
+
+        soExtentConvert(ih);
+        if (soIsExtentInode(ih))
+            soExtentAllocFileBlocks(ih, fbn, n, refs);
+        else if (soBinSelected(304))
+        {
+            /* there is no binary version: allocate one file block at a time */
+            if (refs == NULL)
+                throw SOException(EINVAL, __FUNCTION__);
+            sofs18::soGetFileBlocks(ih, fbn, n, refs);
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (refs[i] == NullReference)
+                    refs[i] = bin::soAllocFileBlock(ih, fbn + i);
+            }
+        }
+        else
+            work::soAllocFileBlocks(ih, fbn, n, refs);
+    }
+
+};
+
@@ -0,0 +1,292 @@
+/*
+ *  \brief Delayed allocation of file blocks
+ *
+ *  A write to a file block of a regular file that has no data block yet
+ *  does not allocate one: the data is kept in memory, and enough free data blocks
+ *  are reserved for it, counting the blocks of references it may need.
+ *  Data blocks are only chosen when the file is flushed, a run of consecutive
+ *  file blocks at a time, so a file written sequentially gets contiguous blocks,
+ *  and file blocks truncated away before the flush never get one.
+ */
+
+#include "fileblocks.h"
+
+#include "core.h"
+#include "dal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* a file block waiting for a data block */
+    struct SODelayedBlock
+    {
+        uint32_t need;                  ///< data blocks reserved for it
+        std::vector<char> data;
+    };
+
+    /* file blocks waiting for a data block, by inode number and file block number */
+    static std::map<uint32_t, std::map<uint32_t, SODelayedBlock> > delayed;
+
+    static uint32_t limit = 0;          ///< maximum number of file blocks kept in memory
+    static bool limitSet = false;
+    static uint32_t count = 0;          ///< number of file blocks kept in memory
+    static uint32_t reserved = 0;       ///< number of free data blocks reserved for them
+    static bool flushing = false;       ///< true while data blocks are being placed
+
+    /* ***************************************** */
+
+    /* number of groups of span file blocks, counted from base, touched by [first, last] */
+    static uint32_t soGroups(uint32_t base, uint32_t span, uint32_t first, uint32_t last)
+    {
+        return (last - base) / span - (first - base) / span + 1;
+    }
+
+    uint32_t soDelallocWorstCase(int ih, uint32_t fbn, uint32_t n)
+    {
+        if (n == 0)
+            return 0;
+
+        /* every run may split a node at every level, and move the root down,
+         * maybe more than once before the blocks are placed */
+        soExtentConvert(ih);
+        if (soIsExtentInode(ih))
+            return n + (n + 1) / 2 * (soExtentDepth(ih) + 3);
+
+        /* a block of references for every one the range touches */
+        uint32_t RPB = ReferencesPerBlock;
+        uint32_t first = fbn;
+        uint32_t last = fbn + n - 1;
+        uint32_t need = n;
+
+        uint32_t base = N_DIRECT;
+        uint32_t end = base + N_INDIRECT * RPB;
+        if (first < end and last >= base)
+            need += soGroups(base, RPB, std::max(first, base), std::min(last, end - 1));
+
+        base = end;
+        end = base + N_DOUBLE_INDIRECT * RPB * RPB;
+        if (first < end and last >= base)
+        {
+            uint32_t lo = std::max(first, base);
+            uint32_t hi = std::min(last, end - 1);
+            need += soGroups(base, RPB, lo, hi) + soGroups(base, RPB * RPB, lo, hi);
+        }
+
+        return need;
+    }
+
+    /* ***************************************** */
+
+    void soDelallocSetLimit(uint32_t blocks)
+    {
+        soProbe(305, "%s(%u)\n", __FUNCTION__, blocks);
+
+        limit = blocks;
+        limitSet = true;
+    }
+
+    /* ***************************************** */
+
+    bool soDelallocWrite(int ih, uint32_t fbn, void *buf)
+    {
+        if (not limitSet)
+        {
+            const char *env = getenv("SOFS18_DELALLOC_BLOCKS");
+            limit = (env != NULL) ? (uint32_t)atol(env) : 0;
+            limitSet = true;
+        }
+        if (limit == 0)
+            return false;
+
+        uint32_t in = soITGetInodeID(ih);
+        auto it = delayed.find(in);
+
+        /* already waiting: just replace the data */
+        if (it != delayed.end())
+        {
+            auto bt = it->second.find(fbn);
+            if (bt != it->second.end())
+            {
+                memcpy(bt->second.data.data(), buf, BlockSize);
+                return true;
+            }
+        }
+
+        /* only new file blocks of regular files */
+        if ((soITGetInodePointer(ih)->mode & S_IFMT) != S_IFREG)
+            return false;
+        if (sofs18::soGetFileBlock(ih, fbn) != NullReference)
+            return false;
+
+        soProbe(306, "%s(%d, %u, %p)\n", __FUNCTION__, ih, fbn, buf);
+
+        /* make room, if the memory limit was reached */
+        if (count >= limit)
+        {
+            soFlushAllFileBlocks();
+            it = delayed.find(in);
+        }
+
+        /* reserve free space; without it, the block is allocated right away */
+        uint32_t need = soDelallocWorstCase(ih, fbn, 1);
+        if (soSBGetPointer()->dz_free < reserved + need)
+            return false;
+
+        if (it == delayed.end())
+            it = delayed.emplace(in, std::map<uint32_t, SODelayedBlock>()).first;
+        SODelayedBlock & blk = it->second[fbn];
+        blk.need = need;
+        blk.data.assign((char *)buf, (char *)buf + BlockSize);
+        count++;
+        reserved += need;
+
+        return true;
+    }
+
+    /* ***************************************** */
+
+    bool soDelallocRead(int ih, uint32_t fbn, void *buf)
+    {
+        if (count == 0)
+            return false;
+
+        auto it = delayed.find(soITGetInodeID(ih));
+        if (it == delayed.end())
+            return false;
+        auto bt = it->second.find(fbn);
+        if (bt == it->second.end())
+            return false;
+
+        memcpy(buf, bt->second.data.data(), BlockSize);
+        return true;
+    }
+
+    /* ***************************************** */
+
+    void soDelallocDiscard(int ih, uint32_t first, uint32_t last)
+    {
+        if (count == 0)
+            return;
+
+        auto it = delayed.find(soITGetInodeID(ih));
+        if (it == delayed.end())
+            return;
+
+        soProbe(307, "%s(%d, %u, %u)\n", __FUNCTION__, ih, first, last);
+
+        auto & blocks = it->second;
+        for (auto bt = blocks.lower_bound(first); bt != blocks.end() and bt->first <= last; )
+        {
+            reserved -= bt->second.need;
+            count--;
+            bt = blocks.erase(bt);
+        }
+        if (blocks.empty())
+            delayed.erase(it);
+    }
+
+    /* ***************************************** */
+
+    void soDelallocMakeRoom(uint32_t n)
+    {
+        if (reserved == 0 or flushing)
+            return;
+
+        /* free space is promised to the file blocks waiting; place them first */
+        if (soSBGetPointer()->dz_free < reserved + n)
+            soFlushAllFileBlocks();
+    }
+
+    /* ***************************************** */
+
+    void soFlushFileBlocks(int ih)
+    {
+        if (count == 0)
+            return;
+
+        auto it = delayed.find(soITGetInodeID(ih));
+        if (it == delayed.end())
+            return;
+
+        soProbe(308, "%s(%d)\n", __FUNCTION__, ih);
+
+        /* what was read ahead took these file blocks as holes */
+        soReadaheadDrop(ih);
+
+        auto & blocks = it->second;
+        std::vector<uint32_t> refs;
+        while (not blocks.empty())
+        {
+            /* the first run of consecutive file blocks */
+            auto first = blocks.begin();
+            auto last = first;
+            uint32_t n = 1;
+            for (auto next = std::next(last); next != blocks.end() and next->first == last->first + 1; ++next)
+            {
+                last = next;
+                n++;
+            }
+
+            /* place it in one go, then write it */
+            refs.resize(n);
+            flushing = true;
+            try
+            {
+                sofs18::soAllocFileBlocks(ih, first->first, n, refs.data());
+            }
+            catch (SOException & err)
+            {
+                flushing = false;
+                throw;
+            }
+            flushing = false;
+            uint32_t i = 0;
+            for (auto bt = first; i < n; i++)
+            {
+                soWriteDataBlock(refs[i], bt->second.data.data());
+                reserved -= bt->second.need;
+                count--;
+                bt = blocks.erase(bt);
+            }
+        }
+        delayed.erase(it);
+    }
+
+    /* ***************************************** */
+
+    void soFlushAllFileBlocks()
+    {
+        if (count == 0)
+            return;
+
+        soProbe(309, "%s()\n", __FUNCTION__);
+
+        while (not delayed.empty())
+        {
+            int ih = soITOpenInode(delayed.begin()->first);
+            try
+            {
+                soFlushFileBlocks(ih);
+            }
+            catch (SOException & err)
+            {
+                soITCloseInode(ih);
+                throw;
+            }
+            soITCloseInode(ih);
+        }
+    }
+
+    /* ***************************************** */
+};
+
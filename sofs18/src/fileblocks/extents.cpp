@@ -0,0 +1,731 @@
+/*
+ *  \brief Extent-mapped inodes
+ *
+ *  The block map of an inode flagged with INODE_EXTENTS is a tree of extents,
+ *  whose root lives in the words of d, i1 and i2 and whose other nodes are data blocks
+ *  (see SOExtent for the layout).
+ *  A leaf block holds (BlockSize - 4) / 12 extents and an inner block
+ *  (BlockSize - 4) / 8 entries, so a file written sequentially needs a handful of them,
+ *  and looking up a file block costs one block read per level of the tree.
+ *  Nodes are split when full, and the root is moved down into a new block when it is full;
+ *  empty nodes are freed, but nodes are never merged.
+ */
+
+#include "fileblocks.h"
+
+#include "freelists.h"
+#include "core.h"
+#include "dal.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    static_assert(offsetof(SOInode, i2) + sizeof(((SOInode *)0)->i2)
+            == offsetof(SOInode, d) + N_MAP_WORDS * sizeof(uint32_t),
+            "the block map words of an inode must be contiguous");
+
+    /* highest number of file blocks of a file, given its size is 32 bits wide */
+    static const uint32_t MaxFileBlocks = (uint32_t)(((uint64_t)UINT32_MAX + 1) / BlockSize);
+
+    static bool enabled = false;
+    static bool enabledSet = false;
+
+    /* a node of the tree */
+    struct SOExtentNode
+    {
+        uint32_t bn;        ///< block holding the node, or NullReference for the root
+        uint32_t *w;        ///< header word, followed by the entries
+        uint32_t nwords;    ///< number of words, header included
+    };
+
+    /* a step of an operation on the tree of an inode */
+    struct SOExtentOp
+    {
+        SOInode *ip;        ///< the inode
+        uint32_t hint;      ///< where new blocks of the tree are wanted
+    };
+
+    /* ***************************************** */
+
+    static inline uint32_t soCount(const SOExtentNode & n)
+    {
+        return n.w[0] & 0xFFFF;
+    }
+
+    static inline uint32_t soDepth(const SOExtentNode & n)
+    {
+        return n.w[0] >> 16;
+    }
+
+    static inline void soSetHeader(SOExtentNode & n, uint32_t count, uint32_t depth)
+    {
+        n.w[0] = (depth << 16) | count;
+    }
+
+    static inline SOExtent *soLeaf(const SOExtentNode & n)
+    {
+        return (SOExtent *)(n.w + 1);
+    }
+
+    static inline SOExtentIndex *soIndex(const SOExtentNode & n)
+    {
+        return (SOExtentIndex *)(n.w + 1);
+    }
+
+    static inline size_t soEntrySize(const SOExtentNode & n)
+    {
+        return (soDepth(n) == 0) ? sizeof(SOExtent) : sizeof(SOExtentIndex);
+    }
+
+    static inline uint32_t soCapacity(const SOExtentNode & n)
+    {
+        return (n.nwords - 1) * sizeof(uint32_t) / soEntrySize(n);
+    }
+
+    /* lowest file block of the subtree; the node must not be empty */
+    static inline uint32_t soFirstKey(const SOExtentNode & n)
+    {
+        return (soDepth(n) == 0) ? soLeaf(n)[0].fbn : soIndex(n)[0].fbn;
+    }
+
+    static inline SOExtentNode soRootNode(SOInode * ip)
+    {
+        SOExtentNode root = {NullReference, ip->d, N_MAP_WORDS};
+        return root;
+    }
+
+    /* ***************************************** */
+
+    void soExtentsSetEnabled(bool on)
+    {
+        soProbe(310, "%s(%d)\n", __FUNCTION__, on);
+
+        enabled = on;
+        enabledSet = true;
+    }
+
+    /* ***************************************** */
+
+    bool soIsExtentInode(int ih)
+    {
+        return (soITGetInodePointer(ih)->mode & INODE_EXTENTS) != 0;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soExtentDepth(int ih)
+    {
+        return soDepth(soRootNode(soITGetInodePointer(ih)));
+    }
+
+    /* ***************************************** */
+
+    void soExtentConvert(int ih)
+    {
+        if (not enabledSet)
+        {
+            const char *env = getenv("SOFS18_EXTENTS");
+            enabled = (env != NULL and atoi(env) != 0);
+            enabledSet = true;
+        }
+        if (not enabled)
+            return;
+
+        /* only regular files with no data block at all */
+        SOInode *ip = soITGetInodePointer(ih);
+        if ((ip->mode & INODE_EXTENTS) != 0 or (ip->mode & S_IFMT) != S_IFREG or ip->blkcnt != 0)
+            return;
+        for (uint32_t i = 0; i < N_MAP_WORDS; i++)
+        {
+            if (ip->d[i] != NullReference)
+                return;
+        }
+
+        soProbe(311, "%s(%d)\n", __FUNCTION__, ih);
+
+        ip->mode |= INODE_EXTENTS;
+        memset(ip->d, 0, N_MAP_WORDS * sizeof(uint32_t));
+        soITSaveInode(ih);
+    }
+
+    /* ***************************************** */
+
+    uint32_t soMaxFileSize(int ih)
+    {
+        soExtentConvert(ih);
+        if (soIsExtentInode(ih))
+            return (uint32_t)std::min((uint64_t)MaxFileBlocks * BlockSize, (uint64_t)UINT32_MAX);
+
+        uint64_t RPB = ReferencesPerBlock;
+        uint64_t nfb = N_DIRECT + N_INDIRECT * RPB + N_DOUBLE_INDIRECT * RPB * RPB;
+        return (uint32_t)std::min(nfb * BlockSize, (uint64_t)UINT32_MAX);
+    }
+
+    /* ***************************************** */
+
+    /*
+     * Find the extent holding file block fbn.
+     * If there is none, store in *next the first file block mapped after fbn,
+     * or NullReference, and return false.
+     */
+    static bool soFindExtent(SOInode * ip, uint32_t fbn, SOExtent * ext, uint32_t * next)
+    {
+        uint32_t buf[ReferencesPerBlock];
+        SOExtentNode n = soRootNode(ip);
+        uint32_t bound = NullReference;
+
+        while (soDepth(n) > 0)
+        {
+            SOExtentIndex *x = soIndex(n);
+            uint32_t c = soCount(n);
+            if (c == 0 or fbn < x[0].fbn)
+            {
+                *next = (c == 0) ? bound : x[0].fbn;
+                return false;
+            }
+
+            uint32_t i = 0;
+            while (i + 1 < c and x[i + 1].fbn <= fbn)
+                i++;
+            if (i + 1 < c)
+                bound = x[i + 1].fbn;
+
+            uint32_t child = x[i].child;
+            soReadDataBlock(child, buf);
+            n.bn = child;
+            n.w = buf;
+            n.nwords = ReferencesPerBlock;
+        }
+
+        SOExtent *e = soLeaf(n);
+        uint32_t c = soCount(n);
+        for (uint32_t i = 0; i < c; i++)
+        {
+            if (fbn < e[i].fbn)
+            {
+                *next = e[i].fbn;
+                return false;
+            }
+            if (fbn - e[i].fbn < e[i].len)
+            {
+                *ext = e[i];
+                return true;
+            }
+        }
+        *next = bound;
+        return false;
+    }
+
+    /* ***************************************** */
+
+    /* map file blocks [fbn, fbn + n) into refs; return the number of holes */
+    static uint32_t soExtentMap(SOInode * ip, uint32_t fbn, uint32_t n, uint32_t * refs)
+    {
+        uint32_t holes = 0;
+        for (uint32_t i = 0; i < n; )
+        {
+            uint32_t f = fbn + i;
+            SOExtent e;
+            uint32_t next;
+            if (soFindExtent(ip, f, &e, &next))
+            {
+                uint32_t cnt = std::min(n - i, e.fbn + e.len - f);
+                for (uint32_t k = 0; k < cnt; k++)
+                    refs[i + k] = e.bn + (f - e.fbn) + k;
+                i += cnt;
+            }
+            else
+            {
+                uint32_t cnt = (next == NullReference) ? n - i : std::min(n - i, next - f);
+                for (uint32_t k = 0; k < cnt; k++)
+                    refs[i + k] = NullReference;
+                i += cnt;
+                holes += cnt;
+            }
+        }
+        return holes;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soExtentGetFileBlock(int ih, uint32_t fbn)
+    {
+        soProbeHot(312, "%s(%d, %u)\n", __FUNCTION__, ih, fbn);
+
+        if (fbn >= MaxFileBlocks)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        SOExtent e;
+        uint32_t next;
+        if (soFindExtent(soITGetInodePointer(ih), fbn, &e, &next))
+            return e.bn + (fbn - e.fbn);
+        else
+            return NullReference;
+    }
+
+    /* ***************************************** */
+
+    void soExtentGetFileBlocks(int ih, uint32_t first, uint32_t count, uint32_t * out)
+    {
+        soProbeHot(322, "%s(%d, %u, %u, %p)\n", __FUNCTION__, ih, first, count, out);
+
+        if (out == NULL or first >= MaxFileBlocks or count > MaxFileBlocks - first)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soExtentMap(soITGetInodePointer(ih), first, count, out);
+    }
+
+    /* ***************************************** */
+
+    /* a new block for a node of the tree */
+    static uint32_t soAllocNode(SOExtentOp & op)
+    {
+        uint32_t bn = sofs18::soAllocDataBlockNear(op.hint);
+        op.hint = bn + 1;
+        op.ip->blkcnt++;
+        return bn;
+    }
+
+    /* ***************************************** */
+
+    /* true if ext extends an extent of leaf n */
+    static bool soMergeable(const SOExtentNode & n, const SOExtent & ext)
+    {
+        if (soDepth(n) != 0)
+            return false;
+
+        SOExtent *e = soLeaf(n);
+        uint32_t c = soCount(n);
+        for (uint32_t i = 0; i < c; i++)
+        {
+            if (e[i].fbn + e[i].len == ext.fbn and e[i].bn + e[i].len == ext.bn)
+                return true;
+            if (ext.fbn + ext.len == e[i].fbn and ext.bn + ext.len == e[i].bn)
+                return true;
+        }
+        return false;
+    }
+
+    /* ***************************************** */
+
+    /* merge ext with its neighbours in leaf n, if they are contiguous with it */
+    static bool soLeafMerge(SOExtentNode & n, const SOExtent & ext)
+    {
+        SOExtent *e = soLeaf(n);
+        uint32_t c = soCount(n);
+        uint32_t p = 0;
+        while (p < c and e[p].fbn < ext.fbn)
+            p++;
+
+        if (p > 0 and e[p - 1].fbn + e[p - 1].len == ext.fbn and e[p - 1].bn + e[p - 1].len == ext.bn)
+        {
+            e[p - 1].len += ext.len;
+            if (p < c and e[p - 1].fbn + e[p - 1].len == e[p].fbn
+                    and e[p - 1].bn + e[p - 1].len == e[p].bn)
+            {
+                e[p - 1].len += e[p].len;
+                memmove(&e[p], &e[p + 1], (c - p - 1) * sizeof(SOExtent));
+                soSetHeader(n, c - 1, 0);
+            }
+            return true;
+        }
+
+        if (p < c and ext.fbn + ext.len == e[p].fbn and ext.bn + ext.len == e[p].bn)
+        {
+            e[p].fbn = ext.fbn;
+            e[p].bn = ext.bn;
+            e[p].len += ext.len;
+            return true;
+        }
+
+        return false;
+    }
+
+    /* ***************************************** */
+
+    /* put an entry, extent or index, in its place in node n, which must have room for it */
+    static void soPutEntry(SOExtentNode & n, uint32_t fbn, const void *entry)
+    {
+        size_t s = soEntrySize(n);
+        char *base = (char *)(n.w + 1);
+        uint32_t c = soCount(n);
+        uint32_t p = 0;
+        while (p < c and *(uint32_t *)(base + p * s) < fbn)
+            p++;
+
+        memmove(base + (p + 1) * s, base + p * s, (c - p) * s);
+        memcpy(base + p * s, entry, s);
+        soSetHeader(n, c + 1, soDepth(n));
+    }
+
+    /* ***************************************** */
+
+    /* move the upper half of the entries of n into the empty node right */
+    static void soSplitNode(SOExtentNode & n, SOExtentNode & right)
+    {
+        size_t s = soEntrySize(n);
+        uint32_t c = soCount(n);
+        uint32_t half = c / 2;
+
+        memcpy(right.w + 1, (char *)(n.w + 1) + half * s, (c - half) * s);
+        soSetHeader(right, c - half, soDepth(n));
+        soSetHeader(n, half, soDepth(n));
+    }
+
+    /* ***************************************** */
+
+    /*
+     * Put an entry into node n, splitting it if it is full.
+     * The new right sibling, if any, is written and stored in *sib.
+     */
+    static void soPutOrSplit(SOExtentOp & op, SOExtentNode & n, uint32_t fbn, const void *entry,
+            SOExtentIndex * sib)
+    {
+        if (soCount(n) < soCapacity(n))
+        {
+            soPutEntry(n, fbn, entry);
+            return;
+        }
+
+        uint32_t buf[ReferencesPerBlock];
+        SOExtentNode right = {soAllocNode(op), buf, ReferencesPerBlock};
+        soSplitNode(n, right);
+        if (fbn < soFirstKey(right))
+            soPutEntry(n, fbn, entry);
+        else
+            soPutEntry(right, fbn, entry);
+        soWriteDataBlock(right.bn, buf);
+
+        sib->fbn = soFirstKey(right);
+        sib->child = right.bn;
+    }
+
+    /* ***************************************** */
+
+    /*
+     * Insert ext into the subtree of node n, which is written back by the caller.
+     * If n is split, its new right sibling is stored in *sib;
+     * the root is never split, so it must have room.
+     */
+    static void soInsert(SOExtentOp & op, SOExtentNode & n, const SOExtent & ext, SOExtentIndex * sib)
+    {
+        sib->child = NullReference;
+
+        if (soDepth(n) == 0)
+        {
+            if (not soLeafMerge(n, ext))
+                soPutOrSplit(op, n, ext.fbn, &ext, sib);
+            return;
+        }
+
+        SOExtentIndex *x = soIndex(n);
+        uint32_t c = soCount(n);
+        uint32_t i = 0;
+        while (i + 1 < c and x[i + 1].fbn <= ext.fbn)
+            i++;
+
+        uint32_t buf[ReferencesPerBlock];
+        SOExtentNode child = {x[i].child, buf, ReferencesPerBlock};
+        soReadDataBlock(child.bn, buf);
+
+        SOExtentIndex csib;
+        soInsert(op, child, ext, &csib);
+        soWriteDataBlock(child.bn, buf);
+
+        if (ext.fbn < x[i].fbn)
+            x[i].fbn = ext.fbn;
+        if (csib.child != NullReference)
+            soPutOrSplit(op, n, csib.fbn, &csib, sib);
+    }
+
+    /* ***************************************** */
+
+    /* insert ext into the tree of an inode */
+    static void soInsertExtent(SOExtentOp & op, const SOExtent & ext)
+    {
+        SOExtentNode root = soRootNode(op.ip);
+
+        /* a full root is moved down into a new block, and becomes its parent */
+        if (soCount(root) == soCapacity(root) and not soMergeable(root, ext))
+        {
+            uint32_t buf[ReferencesPerBlock];
+            SOExtentNode child = {soAllocNode(op), buf, ReferencesPerBlock};
+            buf[0] = root.w[0];
+            memcpy(buf + 1, root.w + 1, soCount(root) * soEntrySize(root));
+            soWriteDataBlock(child.bn, buf);
+
+            SOExtentIndex x = {soFirstKey(root), child.bn};
+            soSetHeader(root, 1, soDepth(root) + 1);
+            soIndex(root)[0] = x;
+        }
+
+        SOExtentIndex sib;
+        soInsert(op, root, ext, &sib);
+    }
+
+    /* ***************************************** */
+
+    void soExtentAllocFileBlocks(int ih, uint32_t fbn, uint32_t n, uint32_t * refs)
+    {
+        soProbe(313, "%s(%d, %u, %u, %p)\n", __FUNCTION__, ih, fbn, n, refs);
+
+        if (refs == NULL or n == 0 or fbn >= MaxFileBlocks or n > MaxFileBlocks - fbn)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        SOInode *ip = soITGetInodePointer(ih);
+
+        /* the holes of the range, and the runs they make */
+        uint32_t missing = soExtentMap(ip, fbn, n, refs);
+        if (missing == 0)
+            return;
+        uint32_t runs = 0;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (refs[i] == NullReference and (i == 0 or refs[i - 1] != NullReference))
+                runs++;
+        }
+
+        /* every run may split a node at every level, and move the root down */
+        SOSuperBlock *sb = soSBGetPointer();
+        uint32_t depth = soDepth(soRootNode(ip));
+        if (sb->dz_free < missing + runs * (depth + 2))
+            throw SOException(ENOSPC, __FUNCTION__);
+
+        /*
+         * data blocks right after the block of the previous file block, if any,
+         * otherwise in the part of the data zone matching the inode's place in the inode table,
+         * as for the classic format
+         */
+        uint32_t hint = NullReference;
+        if (fbn > 0)
+        {
+            uint32_t prev = soExtentGetFileBlock(ih, fbn - 1);
+            if (prev != NullReference)
+                hint = prev + 1;
+        }
+        if (hint == NullReference)
+            hint = (uint64_t)soITGetInodeID(ih) * sb->dz_total / sb->itotal;
+
+        std::vector<uint32_t> data(missing);
+        uint32_t got = 0;
+        try
+        {
+            while (got < missing)
+            {
+                uint32_t cnt = sofs18::soAllocDataBlocksNear(hint, missing - got, &data[got]);
+                if (cnt == 0)
+                    throw SOException(ENOSPC, __FUNCTION__);
+                got += cnt;
+                hint = data[got - 1] + 1;
+            }
+        }
+        catch (SOException & err)
+        {
+            /* the blocks already taken are in no tree yet */
+            if (got > 0)
+                sofs18::soFreeDataBlocks(data.data(), got);
+            throw;
+        }
+        ip->blkcnt += missing;
+
+        /* hand them out, and record every contiguous piece as an extent */
+        SOExtentOp op = {ip, hint};
+        uint32_t k = 0;
+        for (uint32_t i = 0; i < n; )
+        {
+            if (refs[i] != NullReference)
+            {
+                i++;
+                continue;
+            }
+
+            SOExtent ext = {fbn + i, data[k], 0};
+            while (i < n and refs[i] == NullReference and data[k] == ext.bn + ext.len)
+            {
+                refs[i++] = data[k++];
+                ext.len++;
+            }
+            soInsertExtent(op, ext);
+        }
+
+        soITSaveInode(ih);
+    }
+
+    /* ***************************************** */
+
+    /*
+     * Remove file blocks [first, last] from the subtree of node n,
+     * which is written back by the caller; the data blocks released are appended to freed.
+     * If an extent holds blocks on both sides of the range, the piece after it
+     * is stored in *tail, to be inserted again.
+     */
+    static void soRemove(SOExtentNode & n, uint32_t first, uint32_t last,
+            std::vector<uint32_t> & freed, SOExtent * tail)
+    {
+        uint32_t c = soCount(n);
+        uint32_t j = 0;
+
+        if (soDepth(n) == 0)
+        {
+            SOExtent *e = soLeaf(n);
+            for (uint32_t i = 0; i < c; i++)
+            {
+                SOExtent x = e[i];
+                uint32_t xlast = x.fbn + x.len - 1;
+                if (xlast < first or x.fbn > last)
+                {
+                    e[j++] = x;
+                    continue;
+                }
+
+                uint32_t a = std::max(x.fbn, first);
+                uint32_t b = std::min(xlast, last);
+                for (uint32_t f = a; f <= b; f++)
+                    freed.push_back(x.bn + (f - x.fbn));
+
+                bool head = (x.fbn < a);
+                if (head)
+                    e[j++] = {x.fbn, x.bn, a - x.fbn};
+                if (b < xlast)
+                {
+                    SOExtent t = {b + 1, x.bn + (b + 1 - x.fbn), xlast - b};
+                    if (head)
+                        *tail = t;
+                    else
+                        e[j++] = t;
+                }
+            }
+            soSetHeader(n, j, 0);
+            return;
+        }
+
+        SOExtentIndex *x = soIndex(n);
+        for (uint32_t i = 0; i < c; i++)
+        {
+            /* subtrees out of the range are skipped */
+            SOExtentIndex xi = x[i];
+            uint32_t xlast = (i + 1 < c) ? x[i + 1].fbn - 1 : UINT32_MAX;
+            if (xlast < first or xi.fbn > last)
+            {
+                x[j++] = xi;
+                continue;
+            }
+
+            uint32_t buf[ReferencesPerBlock];
+            SOExtentNode child = {xi.child, buf, ReferencesPerBlock};
+            soReadDataBlock(child.bn, buf);
+            soRemove(child, first, last, freed, tail);
+            if (soCount(child) == 0)
+            {
+                freed.push_back(child.bn);
+                continue;
+            }
+            soWriteDataBlock(child.bn, buf);
+            x[j].fbn = soFirstKey(child);
+            x[j].child = child.bn;
+            j++;
+        }
+        soSetHeader(n, j, soDepth(n));
+    }
+
+    /* ***************************************** */
+
+    void soExtentFreeFileBlocks(int ih, uint32_t first, uint32_t last)
+    {
+        soProbe(314, "%s(%d, %u, %u)\n", __FUNCTION__, ih, first, last);
+
+        if (first >= MaxFileBlocks or first > last)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        SOInode *ip = soITGetInodePointer(ih);
+        SOExtentNode root = soRootNode(ip);
+
+        std::vector<uint32_t> freed;
+        SOExtent tail = {0, 0, 0};
+        soRemove(root, first, last, freed, &tail);
+        if (soCount(root) == 0)
+            soSetHeader(root, 0, 0);
+
+        /* released first, so there is room for the nodes the tail may need */
+        if (not freed.empty())
+        {
+            sofs18::soFreeDataBlocks(freed.data(), freed.size());
+            ip->blkcnt -= freed.size();
+        }
+        if (tail.len > 0)
+        {
+            SOExtentOp op = {ip, tail.bn + tail.len};
+            soInsertExtent(op, tail);
+        }
+
+        /* with no extents left, the inode goes back to the classic format */
+        if (soCount(root) == 0)
+        {
+            ip->mode &= ~INODE_EXTENTS;
+            for (uint32_t i = 0; i < N_MAP_WORDS; i++)
+                ip->d[i] = NullReference;
+        }
+
+        soITSaveInode(ih);
+    }
+
+    /* ***************************************** */
+
+    /* give the extents of the subtree of node n consecutive data blocks, starting at *next */
+    static void soRelocate(SOExtentNode & n, uint32_t * next)
+    {
+        uint32_t c = soCount(n);
+
+        if (soDepth(n) == 0)
+        {
+            /* extents become contiguous with the previous one, unless there is a hole between them */
+            SOExtent *e = soLeaf(n);
+            uint32_t j = 0;
+            for (uint32_t i = 0; i < c; i++)
+            {
+                e[i].bn = *next;
+                *next += e[i].len;
+                if (j > 0 and e[j - 1].fbn + e[j - 1].len == e[i].fbn)
+                    e[j - 1].len += e[i].len;
+                else
+                    e[j++] = e[i];
+            }
+            soSetHeader(n, j, 0);
+            return;
+        }
+
+        SOExtentIndex *x = soIndex(n);
+        for (uint32_t i = 0; i < c; i++)
+        {
+            uint32_t buf[ReferencesPerBlock];
+            SOExtentNode child = {x[i].child, buf, ReferencesPerBlock};
+            soReadDataBlock(child.bn, buf);
+            soRelocate(child, next);
+            soWriteDataBlock(child.bn, buf);
+        }
+    }
+
+    /* ***************************************** */
+
+    void soExtentRelocate(int ih, uint32_t first)
+    {
+        soProbe(315, "%s(%d, %u)\n", __FUNCTION__, ih, first);
+
+        SOExtentNode root = soRootNode(soITGetInodePointer(ih));
+        soRelocate(root, &first);
+        soITSaveInode(ih);
+    }
+
+    /* ***************************************** */
+};
+
@@ -43,6 +43,27 @@ namespace sofs18
 
     /* *************************************************** */
 
+    /**
+     * \brief Get the data block numbers corresponding to a range of file blocks
+     *
+     *  \param ih inode handler
+     *  \param first first file block number
+     *  \param count number of file blocks
+     *  \param out array, with room for \c count references, where the data block
+     *      of every file block of the range is stored (\c NullReference for a hole)
+     *
+     *  \remarks
+     *
+     *  \li Assume \c ih is a valid handler of an inode in use
+     *  \li Error \c EINVAL must be thrown if the range is not valid
+     *  \li every block of references covering the range is read only once,
+     *      and none is read below a null reference
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     */
+    void soGetFileBlocks(int ih, uint32_t first, uint32_t count, uint32_t *out);
+
+    /* *************************************************** */
+
     /**
      * \brief Associate a data block to the given file block position
      *
@@ -61,6 +82,31 @@ namespace sofs18
 
     /* *************************************************** */
 
+    /**
+     * \brief Associate data blocks to a range of file block positions
+     *
+     *  \param ih inode handler
+     *  \param fbn first file block number
+     *  \param n number of file blocks
+     *  \param refs array, with room for \c n references, where the data block
+     *      of every file block of the range is stored
+     *
+     *  \remarks
+     *
+     *  \li Assume \c ih is a valid handler of an inode in use
+     *  \li Error \c EINVAL must be thrown if the range is not valid
+     *  \li file blocks already allocated keep their data blocks
+     *  \li all the data blocks needed, including blocks of references, are taken
+     *      from the free list at once, by \c soAllocDataBlocks, so the range gets
+     *      contiguous data blocks whenever the free list holds contiguous runs
+     *  \li if there are not enough free data blocks, error \c ENOSPC must be thrown
+     *      and nothing is changed
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     */
+    void soAllocFileBlocks(int ih, uint32_t fbn, uint32_t n, uint32_t *refs);
+
+    /* *************************************************** */
+
     /**
      * \brief Free all file blocks from the given position on 
      *
@@ -76,6 +122,26 @@ namespace sofs18
 
     /* *************************************************** */
 
+    /**
+     * \brief Free the file blocks of a range, leaving a hole
+     * \details Blocks of references left with no reference are freed too.
+     *
+     *  \param ih inode handler
+     *  \param first first file block number
+     *  \param last last file block number, included; it may go beyond the last valid one
+     *
+     *  \remarks
+     *
+     *  \li Assume \c ih is a valid handler of an inode in use
+     *  \li Error \c EINVAL must be thrown if \c first is not valid or greater than \c last
+     *  \li a block of references with no reference is skipped as a whole, without being read
+     *  \li the data blocks released are given back to the free lists at once, by \c soFreeDataBlocks
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     */
+    void soPunchFileBlocks(int ih, uint32_t first, uint32_t last);
+
+    /* *************************************************** */
+
     /**
      *  \brief Read a file block.
      *
@@ -119,6 +185,357 @@ namespace sofs18
      */
     void soWriteFileBlock(int ih, uint32_t fbn, void *buf);
 
+    /* *************************************************** */
+
+    /**
+     *  \brief Read a range of file blocks.
+     *
+     *  \param ih inode handler
+     *  \param fbn first file block number
+     *  \param n number of file blocks
+     *  \param buf pointer to the buffer where data must be read into;
+     *      it must be at least <tt>n * BlockSize</tt> bytes long
+     *
+     *  \remarks
+     *
+     *  \li Assume \c ih is a valid handler of an inode in use
+     *  \li Error \c EINVAL must be thrown if the range is not valid
+     *  \li the range is mapped once, by \c soGetFileBlocks;
+     *      every run of file blocks with data blocks is read with a single
+     *      call to \c soReadDataBlocks and every run of holes is zero-filled at once
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     */
+    void soReadFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Write a range of file blocks.
+     *
+     *  \param ih inode handler
+     *  \param fbn first file block number
+     *  \param n number of file blocks
+     *  \param buf pointer to the buffer containing data to be written;
+     *      it must be at least <tt>n * BlockSize</tt> bytes long
+     *
+     *  \remarks
+     *
+     *  \li Assume \c ih is a valid handler of an inode in use
+     *  \li Error \c EINVAL must be thrown if the range is not valid
+     *  \li the range is mapped once, by \c soGetFileBlocks;
+     *      missing data blocks are allocated in bulk, by \c soAllocFileBlocks,
+     *      unless delayed allocation keeps the file blocks in memory,
+     *      and every run is written with a single call to \c soWriteDataBlocks
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     */
+    void soWriteFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Set the maximum number of file blocks waiting for a data block
+     * \details With delayed allocation, a write to a file block of a regular file
+     *  that has no data block yet keeps the data in memory and reserves free space for it;
+     *  the data block is only chosen when the file is flushed.
+     *  Zero disables delayed allocation.
+     *  If not called, the limit is taken from the \c SOFS18_DELALLOC_BLOCKS
+     *  environment variable, defaulting to 0.
+     *
+     *  \param blocks the maximum number of file blocks kept in memory
+     */
+    void soDelallocSetLimit(uint32_t blocks);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Keep a written file block in memory, if delayed allocation applies
+     * \details Used by \c soWriteFileBlock.
+     *
+     *  \param ih inode handler
+     *  \param fbn file block number
+     *  \param buf pointer to the buffer containing data to be written
+     *
+     *  \return false, if the block must be written now
+     */
+    bool soDelallocWrite(int ih, uint32_t fbn, void *buf);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Read a file block kept in memory
+     * \details Used by \c soReadFileBlock.
+     *
+     *  \param ih inode handler
+     *  \param fbn file block number
+     *  \param buf pointer to the buffer where data must be read into
+     *
+     *  \return false, if the file block is not waiting for a data block
+     */
+    bool soDelallocRead(int ih, uint32_t fbn, void *buf);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Drop the file blocks kept in memory within a range
+     * \details Used by \c soFreeFileBlocks and \c soPunchFileBlocks; their reservation is released.
+     *
+     *  \param ih inode handler
+     *  \param first first file block number
+     *  \param last last file block number, included
+     */
+    void soDelallocDiscard(int ih, uint32_t first, uint32_t last);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Make sure an allocation of \c n data blocks does not eat reserved space
+     * \details Used by the file block allocation functions: if the free data blocks
+     *  not reserved are fewer than \c n, all file blocks kept in memory are flushed.
+     */
+    void soDelallocMakeRoom(uint32_t n);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Get the most data blocks the allocation of a range of file blocks may need
+     * \details Blocks of references are counted: for the classic block map, those
+     *  of the range; for an extent-mapped inode, what the tree may grow by for every run
+     *  of holes, one level deeper than now.
+     *  The inode is first given the extent format, if it applies (see \c soExtentConvert).
+     *
+     *  \param ih inode handler
+     *  \param fbn first file block number
+     *  \param n number of file blocks
+     */
+    uint32_t soDelallocWorstCase(int ih, uint32_t fbn, uint32_t n);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Give data blocks to the file blocks of an inode kept in memory, and write them
+     * \details Every run of consecutive file blocks is allocated at once,
+     *  by \c soAllocFileBlocks.
+     *
+     *  \param ih inode handler
+     */
+    void soFlushFileBlocks(int ih);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Flush the file blocks kept in memory of every inode
+     *
+     *  \remarks
+     *
+     *  \li must be called before the disk is closed.
+     */
+    void soFlushAllFileBlocks();
+
+    /* *************************************************** */
+
+    /**
+     * \brief Set the maximum readahead window
+     * \details When a regular file is read sequentially, the file blocks ahead
+     *  of the reader are prefetched with asynchronous reads; the window
+     *  starts at a few blocks and doubles every time it is topped up, up to this value,
+     *  and collapses as soon as the file is read elsewhere.
+     *  Zero disables readahead.
+     *  If not called, the maximum is taken from the \c SOFS18_READAHEAD_BLOCKS
+     *  environment variable, defaulting to 0.
+     *
+     *  \param blocks the maximum number of file blocks read ahead
+     */
+    void soReadaheadSetMax(uint32_t blocks);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Read the prefetched file blocks at the start of a range, and read ahead
+     * \details Used by \c soReadFileBlock and \c soReadFileBlocks;
+     *  the file blocks not returned must be read by the caller.
+     *
+     *  \param ih inode handler
+     *  \param fbn first file block number
+     *  \param n number of file blocks
+     *  \param buf pointer to the buffer, with room for \c n blocks, where data must be read into
+     *
+     *  \return the number of file blocks, from \c fbn on, read into \c buf
+     */
+    uint32_t soReadaheadRead(int ih, uint32_t fbn, uint32_t n, void *buf);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Drop what was read ahead of a file
+     * \details Used whenever the file blocks of an inode change.
+     *
+     *  \param ih inode handler
+     */
+    void soReadaheadDrop(int ih);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Drop what was read ahead of every file
+     *
+     *  \remarks
+     *
+     *  \li must be called before the disk is closed.
+     */
+    void soReadaheadDropAll();
+
+    /* *************************************************** */
+
+    /** \brief Readahead counters */
+    struct SOReadaheadStats
+    {
+        uint64_t issued;        ///< file blocks prefetched
+        uint64_t hits;          ///< file blocks read from prefetched data
+        uint64_t waste;         ///< file blocks prefetched and dropped without being read
+        uint64_t waits;         ///< reads that had to wait for a prefetch in flight
+        uint64_t collapses;     ///< windows collapsed by a non-sequential read
+    };
+
+    /**
+     * \brief Get the readahead counters
+     *
+     *  \param st pointer to the structure where the counters are copied into
+     */
+    void soReadaheadGetStats(SOReadaheadStats * st);
+
+    /**
+     * \brief Reset the readahead counters
+     */
+    void soReadaheadResetStats(void);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Enable or disable extent-mapped inodes
+     * \details When enabled, a regular file with no data block is given
+     *  the extent format (\c INODE_EXTENTS) on its first allocation;
+     *  files already mapped keep their format.
+     *  If not called, it is enabled if the \c SOFS18_EXTENTS environment variable
+     *  is set to a non-zero value.
+     *
+     *  \param on true to enable
+     */
+    void soExtentsSetEnabled(bool on);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Check if the block map of an inode is a tree of extents
+     *
+     *  \param ih inode handler
+     */
+    bool soIsExtentInode(int ih);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Get the depth of the tree of extents of an extent-mapped inode
+     * \details 0 if the extents are all held in the inode itself.
+     *
+     *  \param ih inode handler
+     */
+    uint32_t soExtentDepth(int ih);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Give the extent format to an inode, if it applies
+     * \details Used by the file block allocation functions:
+     *  the inode is converted if extent-mapped inodes are enabled
+     *  and it is a regular file with no data block.
+     *
+     *  \param ih inode handler
+     */
+    void soExtentConvert(int ih);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Get the maximum size of a file, in bytes
+     * \details The inode is first given the extent format, if it applies
+     *  (see \c soExtentConvert), as a write to it would do;
+     *  the size of an extent-mapped file is only bounded by the width of its size field.
+     *
+     *  \param ih inode handler
+     *
+     *  \return the maximum size
+     */
+    uint32_t soMaxFileSize(int ih);
+
+    /* *************************************************** */
+
+    /**
+     * \brief \c soGetFileBlock for an extent-mapped inode
+     *
+     *  \param ih inode handler
+     *  \param fbn file block number
+     *
+     *  \return the number of the corresponding block
+     */
+    uint32_t soExtentGetFileBlock(int ih, uint32_t fbn);
+
+    /* *************************************************** */
+
+    /**
+     * \brief \c soGetFileBlocks for an extent-mapped inode
+     * \details The tree is searched once per extent or hole of the range.
+     *
+     *  \param ih inode handler
+     *  \param first first file block number
+     *  \param count number of file blocks
+     *  \param out array, with room for \c count references, where the data block
+     *      of every file block of the range is stored (\c NullReference for a hole)
+     */
+    void soExtentGetFileBlocks(int ih, uint32_t first, uint32_t count, uint32_t *out);
+
+    /* *************************************************** */
+
+    /**
+     * \brief \c soAllocFileBlocks for an extent-mapped inode
+     * \details Every run of data blocks handed out contiguously 
+     *  is recorded as a single extent, merged with its neighbours when they are contiguous.
+     *
+     *  \param ih inode handler
+     *  \param fbn first file block number
+     *  \param n number of file blocks
+     *  \param refs array, with room for \c n references, where the data block
+     *      of every file block of the range is stored
+     */
+    void soExtentAllocFileBlocks(int ih, uint32_t fbn, uint32_t n, uint32_t *refs);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Free the file blocks of a range of an extent-mapped inode
+     * \details Subtrees out of the range are not visited, and empty nodes are freed.
+     *  If no extent is left, the inode goes back to the classic format.
+     *
+     *  \param ih inode handler
+     *  \param first first file block number
+     *  \param last last file block number, included
+     */
+    void soExtentFreeFileBlocks(int ih, uint32_t first, uint32_t last);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Move the data blocks of an extent-mapped inode to a run of blocks
+     * \details The data blocks, in file block order, become the run of consecutive blocks
+     *  starting at \c first; holes are kept, and extents no longer separated
+     *  by a hole within a node are merged.
+     *  Only the map is changed: copying the data, and taking and releasing the blocks,
+     *  is up to the caller. Blocks of the tree stay where they are.
+     *
+     *  \param ih inode handler
+     *  \param first first block of the run
+     */
+    void soExtentRelocate(int ih, uint32_t first);
+
     /* *************************************************** */
     /** @} close group fileblocks */
     /* *************************************************** */
@@ -13,11 +13,30 @@ namespace sofs18
 
     void soFreeFileBlocks(int ih, uint32_t ffbn)
     {
-        if (soBinSelected(303))
+        soDelallocDiscard(ih, ffbn, UINT32_MAX);
+        soReadaheadDrop(ih);
+
+        if (soIsExtentInode(ih))
+            soExtentFreeFileBlocks(ih, ffbn, UINT32_MAX);
+        else if (soBinSelected(303))
             bin::soFreeFileBlocks(ih, ffbn);
         else
             work::soFreeFileBlocks(ih, ffbn);
     }
 
+    /* ***************************************** */
+
+    void soPunchFileBlocks(int ih, uint32_t first, uint32_t last)
+    {
+        soDelallocDiscard(ih, first, last);
+        soReadaheadDrop(ih);
+
+        /* there is no binary version */
+        if (soIsExtentInode(ih))
+            soExtentFreeFileBlocks(ih, first, last);
+        else
+            work::soPunchFileBlocks(ih, first, last);
+    }
+
 };
 
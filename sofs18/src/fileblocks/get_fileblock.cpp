@@ -11,11 +11,32 @@ namespace sofs18
 
     uint32_t soGetFileBlock(int ih, uint32_t fbn)
     {
+        if (soIsExtentInode(ih))
+            return soExtentGetFileBlock(ih, fbn);
+
         if (soBinSelected(301))
             return bin::soGetFileBlock(ih, fbn);
         else
             return work::soGetFileBlock(ih, fbn);
     }
 
+    /* ***************************************** */
+
+    void soGetFileBlocks(int ih, uint32_t first, uint32_t count, uint32_t *out)
+    {
+        if (soIsExtentInode(ih))
+            soExtentGetFileBlocks(ih, first, count, out);
+        else if (soBinSelected(316))
+        {
+            /* there is no binary version: get one file block at a time */
+            if (out == NULL)
+                throw SOException(EINVAL, __FUNCTION__);
+            for (uint32_t i = 0; i < count; i++)
+                out[i] = bin::soGetFileBlock(ih, first + i);
+        }
+        else
+            work::soGetFileBlocks(ih, first, count, out);
+    }
+
 };
 
@@ -12,11 +12,38 @@ namespace sofs18
 
     void soReadFileBlock(int ih, uint32_t fbn, void *buf)
     {
-        if (soBinSelected(331))
+        if (soDelallocRead(ih, fbn, buf))
+            return;
+        if (soReadaheadRead(ih, fbn, 1, buf) == 1)
+            return;
+
+        /* the binary version does not know the extent format */
+        if (soBinSelected(331) and not soIsExtentInode(ih))
             bin::soReadFileBlock(ih, fbn, buf);
         else
             work::soReadFileBlock(ih, fbn, buf);
     }
 
+    /* ***************************************** */
+
+    void soReadFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf)
+    {
+        uint32_t got = soReadaheadRead(ih, fbn, n, buf);
+        if (got == n)
+            return;
+        fbn += got;
+        n -= got;
+        buf = (char *)buf + (size_t)got * BlockSize;
+
+        if (soBinSelected(333))
+        {
+            /* there is no binary version: read one file block at a time */
+            for (uint32_t i = 0; i < n; i++)
+                sofs18::soReadFileBlock(ih, fbn + i, (char *)buf + (size_t)i * BlockSize);
+        }
+        else
+            work::soReadFileBlocks(ih, fbn, n, buf);
+    }
+
 };
 
@@ -0,0 +1,335 @@
+/*
+ *  \brief Sequential readahead of file blocks
+ *
+ *  Reads of the file blocks of every regular file are watched:
+ *  when a read starts where the previous one ended, the file is taken as being
+ *  read sequentially, and the file blocks ahead of the reader are prefetched,
+ *  with asynchronous raw reads, so they are ready when asked for.
+ *  The number of file blocks kept ahead, the window, starts small and doubles
+ *  every time it is topped up, up to a maximum; a read elsewhere collapses it.
+ *  Mapping the blocks to prefetch reads the blocks of references involved,
+ *  which are then found in the block cache by the reader.
+ *  Any change to the file blocks of a file drops what was prefetched for it.
+ */
+
+#include "fileblocks.h"
+
+#include "core.h"
+#include "dal.h"
+#include "rawdisk.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* initial window, in file blocks */
+#define READAHEAD_MIN_WINDOW 4
+
+    /* maximum number of files followed at a time */
+#define READAHEAD_STREAMS 16
+
+    /* a run of prefetched file blocks */
+    struct SOReadChunk
+    {
+        uint32_t fbn;                   ///< first file block
+        uint32_t n;                     ///< number of file blocks
+        uint32_t served;                ///< file blocks handed out to readers
+        std::vector<uint32_t> bns;      ///< data block of every file block, NullReference for holes
+        std::vector<char> data;         ///< contents of the file blocks
+        std::vector<uint32_t> reqs;     ///< asynchronous reads not yet waited for
+    };
+
+    /* readahead state of a file */
+    struct SOReadStream
+    {
+        uint32_t prev;                  ///< first file block of the last read
+        uint32_t next;                  ///< file block right after the last read
+        uint32_t window;                ///< file blocks to keep ahead; 0 if access is not sequential
+        uint64_t tick;                  ///< time of last use, for eviction
+        std::deque<SOReadChunk> chunks; ///< prefetched runs, consecutive and in file block order
+    };
+
+    static std::map<uint32_t, SOReadStream> streams;   ///< by inode number
+    static uint32_t maxWindow = 0;      ///< maximum window, in file blocks; 0 disables readahead
+    static bool maxSet = false;
+    static uint64_t ticks = 0;
+    static SOReadaheadStats stats = {0, 0, 0, 0, 0};
+
+    /* ***************************************** */
+
+    void soReadaheadSetMax(uint32_t blocks)
+    {
+        soProbe(317, "%s(%u)\n", __FUNCTION__, blocks);
+
+        maxWindow = blocks;
+        maxSet = true;
+    }
+
+    /* ***************************************** */
+
+    /* wait for the reads of a chunk; false if any of them failed */
+    static bool soWaitChunk(SOReadChunk & c)
+    {
+        bool ok = true;
+        for (uint32_t req : c.reqs)
+        {
+            try
+            {
+                soWaitRaw(req);
+            }
+            catch (SOException & err)
+            {
+                ok = false;
+            }
+        }
+        c.reqs.clear();
+        return ok;
+    }
+
+    /* ***************************************** */
+
+    /* drop the first chunk of a stream */
+    static void soPopChunk(SOReadStream & s)
+    {
+        SOReadChunk & c = s.chunks.front();
+        soWaitChunk(c);
+        if (c.served < c.n)
+            stats.waste += c.n - c.served;
+        s.chunks.pop_front();
+    }
+
+    /* ***************************************** */
+
+    static void soDropChunks(SOReadStream & s)
+    {
+        while (not s.chunks.empty())
+            soPopChunk(s);
+    }
+
+    /* ***************************************** */
+
+    /* prefetch file blocks [fbn, fbn + n) of a file */
+    static void soPrefetch(int ih, SOReadStream & s, uint32_t fbn, uint32_t n)
+    {
+        soProbe(318, "%s(%d, %u, %u)\n", __FUNCTION__, ih, fbn, n);
+
+        s.chunks.emplace_back();
+        SOReadChunk & c = s.chunks.back();
+        c.fbn = fbn;
+        c.n = n;
+        c.served = 0;
+        c.bns.resize(n);
+        c.data.resize((size_t)n * BlockSize);
+        sofs18::soGetFileBlocks(ih, fbn, n, c.bns.data());
+
+        /* a single read per run of adjacent data blocks */
+        uint32_t dzStart = soSBGetPointer()->dz_start;
+        for (uint32_t i = 0, j; i < n; i = j)
+        {
+            for (j = i + 1; j < n; j++)
+            {
+                if (c.bns[i] == NullReference ? c.bns[j] != NullReference : c.bns[j] != c.bns[i] + (j - i))
+                    break;
+            }
+            char *p = c.data.data() + (size_t)i * BlockSize;
+            if (c.bns[i] == NullReference)
+                memset(p, 0, (size_t)(j - i) * BlockSize);
+            else
+                c.reqs.push_back(soSubmitRawRead(dzStart + c.bns[i], j - i, p));
+        }
+
+        stats.issued += n;
+    }
+
+    /* ***************************************** */
+
+    /* copy the prefetched file blocks at the start of [fbn, fbn + n); return how many */
+    static uint32_t soServe(int ih, SOReadStream & s, uint32_t fbn, uint32_t n, char *buf)
+    {
+        uint32_t got = 0;
+        while (got < n and not s.chunks.empty())
+        {
+            SOReadChunk & c = s.chunks.front();
+            uint32_t f = fbn + got;
+
+            /* chunks behind the reader are of no use */
+            if (c.fbn + c.n <= f)
+            {
+                soPopChunk(s);
+                continue;
+            }
+            if (f < c.fbn)
+                break;
+
+            if (not c.reqs.empty())
+            {
+                stats.waits++;
+                if (not soWaitChunk(c))
+                {
+                    /* let the reader get the error by itself */
+                    soDropChunks(s);
+                    break;
+                }
+            }
+
+            uint32_t cnt = std::min(n - got, c.fbn + c.n - f);
+            for (uint32_t k = 0; k < cnt; k++)
+            {
+                uint32_t i = f - c.fbn + k;
+                char *dst = buf + (size_t)(got + k) * BlockSize;
+
+                /* file blocks kept in memory have no data block yet */
+                if (c.bns[i] != NullReference or not soDelallocRead(ih, f + k, dst))
+                    memcpy(dst, c.data.data() + (size_t)i * BlockSize, BlockSize);
+            }
+            c.served += cnt;
+            got += cnt;
+        }
+
+        stats.hits += got;
+        return got;
+    }
+
+    /* ***************************************** */
+
+    /* the stream of a file, evicting the least recently used one if there are too many */
+    static SOReadStream & soGetStream(uint32_t in)
+    {
+        auto it = streams.find(in);
+        if (it != streams.end())
+            return it->second;
+
+        if (streams.size() >= READAHEAD_STREAMS)
+        {
+            auto lru = streams.begin();
+            for (auto st = streams.begin(); st != streams.end(); ++st)
+            {
+                if (st->second.tick < lru->second.tick)
+                    lru = st;
+            }
+            soDropChunks(lru->second);
+            streams.erase(lru);
+        }
+
+        SOReadStream & s = streams[in];
+        s.prev = s.next = 0;
+        s.window = 0;
+        s.tick = 0;
+        return s;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soReadaheadRead(int ih, uint32_t fbn, uint32_t n, void *buf)
+    {
+        if (not maxSet)
+        {
+            const char *env = getenv("SOFS18_READAHEAD_BLOCKS");
+            maxWindow = (env != NULL) ? (uint32_t)atol(env) : 0;
+            maxSet = true;
+        }
+        if (maxWindow == 0 or n == 0)
+            return 0;
+
+        SOInode *ip = soITGetInodePointer(ih);
+        if ((ip->mode & S_IFMT) != S_IFREG)
+            return 0;
+
+        SOReadStream & s = soGetStream(soITGetInodeID(ih));
+        s.tick = ++ticks;
+
+        /* a read of part of the last one, as done block by block by some callers,
+         * changes nothing */
+        if (fbn >= s.prev and fbn + n <= s.next)
+            return soServe(ih, s, fbn, n, (char *)buf);
+
+        if (fbn != s.next)
+        {
+            /* random access: the window collapses */
+            if (s.window != 0 or not s.chunks.empty())
+                stats.collapses++;
+            soDropChunks(s);
+            s.window = 0;
+        }
+        else if (s.window == 0)
+            s.window = std::min(maxWindow, std::max((uint32_t)READAHEAD_MIN_WINDOW, n));
+        s.prev = fbn;
+        s.next = fbn + n;
+
+        uint32_t got = soServe(ih, s, fbn, n, (char *)buf);
+        if (s.window == 0)
+            return got;
+
+        /* top up the blocks ahead, when half of them were consumed, doubling the window */
+        uint32_t end = s.chunks.empty() ? s.next : s.chunks.back().fbn + s.chunks.back().n;
+        uint32_t nfb = (ip->size + BlockSize - 1) / BlockSize;
+        if (end - s.next <= s.window / 2 and end < nfb)
+        {
+            soPrefetch(ih, s, end, std::min(s.window, nfb - end));
+            s.window = std::min(maxWindow, s.window * 2);
+        }
+
+        return got;
+    }
+
+    /* ***************************************** */
+
+    void soReadaheadDrop(int ih)
+    {
+        if (streams.empty())
+            return;
+
+        auto it = streams.find(soITGetInodeID(ih));
+        if (it == streams.end())
+            return;
+
+        soProbe(319, "%s(%d)\n", __FUNCTION__, ih);
+
+        soDropChunks(it->second);
+        streams.erase(it);
+    }
+
+    /* ***************************************** */
+
+    void soReadaheadDropAll()
+    {
+        if (streams.empty())
+            return;
+
+        soProbe(320, "%s()\n", __FUNCTION__);
+
+        for (auto & st : streams)
+            soDropChunks(st.second);
+        streams.clear();
+    }
+
+    /* ***************************************** */
+
+    void soReadaheadGetStats(SOReadaheadStats * st)
+    {
+        if (st == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        *st = stats;
+    }
+
+    /* ***************************************** */
+
+    void soReadaheadResetStats(void)
+    {
+        stats = {0, 0, 0, 0, 0};
+    }
+
+    /* ***************************************** */
+};
+
@@ -12,11 +12,32 @@ namespace sofs18
 
     void soWriteFileBlock(int ih, uint32_t fbn, void *buf)
     {
-        if (soBinSelected(332))
+        soReadaheadDrop(ih);
+        if (soDelallocWrite(ih, fbn, buf))
+            return;
+
+        /* the binary version does not know the extent format */
+        if (soBinSelected(332) and not soIsExtentInode(ih))
             bin::soWriteFileBlock(ih, fbn, buf);
         else
             work::soWriteFileBlock(ih, fbn, buf);
     }
 
+    /* ***************************************** */
+
+    void soWriteFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf)
+    {
+        soReadaheadDrop(ih);
+
+        if (soBinSelected(334))
+        {
+            /* there is no binary version: write one file block at a time */
+            for (uint32_t i = 0; i < n; i++)
+                sofs18::soWriteFileBlock(ih, fbn + i, (char *)buf + (size_t)i * BlockSize);
+        }
+        else
+            work::soWriteFileBlocks(ih, fbn, n, buf);
+    }
+
 };
 
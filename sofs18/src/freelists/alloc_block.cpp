@@ -7,16 +7,46 @@
 #include "work_freelists.h"
 
 #include "core.h"
+#include "dal.h"
 
 namespace sofs18
 {
 
     uint32_t soAllocDataBlock()
     {
+        return soAllocDataBlockNear(NullReference);
+    }
+
+    /* ********************************************************* */
+
+    uint32_t soAllocDataBlockNear(uint32_t hint)
+    {
+        SOStatTimer timer(SOSTAT_ALLOC_BLOCK);
+
+        uint32_t bn;
+        if (soMagazineAllocDataBlock(&bn))
+            return bn;
+
+        if (soGetAllocPolicy() == SOALLOC_NEAR)
+        {
+            soAllocNear(hint, 1, &bn);
+            return bn;
+        }
+
+        if (soRecycleDataBlock(&bn))
+        {
+            soFBMSet(bn, false);
+            return bn;
+        }
+
         if (soBinSelected(441))
-            return bin::soAllocDataBlock();
+            bn = bin::soAllocDataBlock();
         else
-            return work::soAllocDataBlock();
+            bn = work::soAllocDataBlock();
+
+        soFBMSet(bn, false);
+        soRefillerKick();
+        return bn;
     }
 
 };
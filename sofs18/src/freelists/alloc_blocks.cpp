@@ -0,0 +1,84 @@
+/*
+ *  \authur Artur Pereira - 2009-2018
+ */
+
+#include "freelists.h"
+#include "bin_freelists.h"
+#include "work_freelists.h"
+
+#include "core.h"
+#include "dal.h"
+
+#include <errno.h>
+
+#include <algorithm>
+
+namespace sofs18
+{
+
+    uint32_t soAllocDataBlocks(uint32_t n, uint32_t *refs)
+    {
+        return soAllocDataBlocksNear(NullReference, n, refs);
+    }
+
+    /* ********************************************************* */
+
+    uint32_t soAllocDataBlocksNear(uint32_t hint, uint32_t n, uint32_t *refs)
+    {
+        SOStatTimer timer(SOSTAT_ALLOC_BLOCK, n);
+
+        if (soGetAllocPolicy() == SOALLOC_NEAR)
+            return soAllocNear(hint, n, refs);
+
+        /* recently freed blocks first, if the recycling policy allows it */
+        uint32_t recycled = 0;
+        while (recycled < n and soRecycleDataBlock(&refs[recycled]))
+            recycled++;
+
+        uint32_t got = recycled;
+        if (got == n)
+        {
+            /* nothing else to do */
+        }
+        else if (soBinSelected(445))
+        {
+            /* there is no binary version: allocate one block at a time */
+            for ( ; got < n; got++)
+            {
+                try
+                {
+                    refs[got] = bin::soAllocDataBlock();
+                }
+                catch (SOException & err)
+                {
+                    if (err.en != ENOSPC or got == 0)
+                        throw;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            try
+            {
+                got += work::soAllocDataBlocks(n - got, &refs[got]);
+            }
+            catch (SOException & err)
+            {
+                if (err.en != ENOSPC or got == 0)
+                    throw;
+            }
+        }
+
+        /* keep the promise of ascending order */
+        if (recycled > 0)
+            std::sort(refs, refs + got);
+
+        for (uint32_t i = 0; i < got; i++)
+            soFBMSet(refs[i], false);
+        soRefillerKick();
+        return got;
+    }
+
+};
+
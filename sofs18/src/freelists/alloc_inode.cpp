@@ -13,10 +13,19 @@ namespace sofs18
 
     uint32_t soAllocInode(uint32_t type)
     {
+        SOStatTimer timer(SOSTAT_ALLOC_INODE);
+
+        uint32_t in;
+        if (soMagazineAllocInode(type, &in))
+            return in;
+
         if (soBinSelected(401))
-            return bin::soAllocInode(type);
+            in = bin::soAllocInode(type);
         else
-            return work::soAllocInode(type);
+            in = work::soAllocInode(type);
+
+        soRefillerKick();
+        return in;
     }
 
 };
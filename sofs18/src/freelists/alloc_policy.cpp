@@ -0,0 +1,148 @@
+/*
+ *  \brief Data block allocation and recycling policies
+ *
+ *  With the near policy, the free block map owns the free data blocks,
+ *  so a block can be taken wherever it is, instead of at the head of the free list.
+ *  With the lifo recycling policy, a freed block can be taken back from the insertion cache,
+ *  instead of going through the free list.
+ */
+
+#include "freelists.h"
+
+#include "core.h"
+#include "dal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    static SOAllocPolicy policy = SOALLOC_FIFO;
+    static bool policySet = false;
+
+    /* block after the last one allocated, where allocations without a hint start */
+    static uint32_t cursor = 0;
+
+    static SORecyclePolicy recycle = SORECYCLE_FIFO;
+    static uint32_t distance = 0;
+    static bool recycleSet = false;
+
+    /* ***************************************** */
+
+    void soSetAllocPolicy(SOAllocPolicy p)
+    {
+        soProbe(457, "%s(%d)\n", __FUNCTION__, p);
+
+        if (p != SOALLOC_FIFO and p != SOALLOC_NEAR)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        if (p == SOALLOC_FIFO)
+            soFBMRelease();
+
+        policy = p;
+        policySet = true;
+    }
+
+    /* ***************************************** */
+
+    SOAllocPolicy soGetAllocPolicy()
+    {
+        if (not policySet)
+        {
+            const char *env = getenv("SOFS18_ALLOC_POLICY");
+            policy = (env != NULL and strcmp(env, "near") == 0) ? SOALLOC_NEAR : SOALLOC_FIFO;
+            policySet = true;
+        }
+
+        return policy;
+    }
+
+    /* ***************************************** */
+
+    uint32_t soAllocNear(uint32_t hint, uint32_t n, uint32_t *refs)
+    {
+        soProbe(458, "%s(%u, %u, %p)\n", __FUNCTION__, hint, n, refs);
+
+        if (refs == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+        if (n == 0)
+            return 0;
+
+        soFBMAcquire();
+
+        uint32_t got = soFBMTake((hint == NullReference) ? cursor : hint, n, refs);
+        if (got == 0)
+            throw SOException(ENOSPC, __FUNCTION__);
+
+        cursor = refs[got - 1] + 1;
+        return got;
+    }
+
+    /* ***************************************** */
+
+    void soFreeNear(const uint32_t *refs, uint32_t n)
+    {
+        soProbe(459, "%s(%p, %u)\n", __FUNCTION__, refs, n);
+
+        soFBMAcquire();
+        soFBMGive(refs, n);
+    }
+
+    /* ***************************************** */
+    void soSetRecyclePolicy(SORecyclePolicy p, uint32_t d)
+    {
+        soProbe(463, "%s(%d, %u)\n", __FUNCTION__, p, d);
+
+        if ((p != SORECYCLE_FIFO and p != SORECYCLE_LIFO) or d >= BLOCK_REFERENCE_CACHE_SIZE)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        recycle = p;
+        distance = d;
+        recycleSet = true;
+    }
+
+    /* ***************************************** */
+
+    bool soRecycleDataBlock(uint32_t *bn)
+    {
+        if (not recycleSet)
+        {
+            const char *env = getenv("SOFS18_RECYCLE");
+            if (env != NULL and strncmp(env, "lifo", 4) == 0)
+            {
+                recycle = SORECYCLE_LIFO;
+                if (env[4] == ',')
+                    distance = (uint32_t)atol(env + 5);
+                if (distance >= BLOCK_REFERENCE_CACHE_SIZE)
+                    distance = BLOCK_REFERENCE_CACHE_SIZE - 1;
+            }
+            recycleSet = true;
+        }
+
+        if (recycle == SORECYCLE_FIFO or soGetAllocPolicy() == SOALLOC_NEAR)
+            return false;
+
+        SOSuperBlock *sb = soSBGetPointer();
+        if (sb->bicache.idx <= distance)
+            return false;
+
+        soProbe(464, "%s(%p)\n", __FUNCTION__, bn);
+
+        /* the newest block with at least distance blocks freed after it */
+        uint32_t *ref = sb->bicache.ref;
+        uint32_t k = sb->bicache.idx - 1 - distance;
+        *bn = ref[k];
+        memmove(&ref[k], &ref[k + 1], distance * sizeof(uint32_t));
+        sb->bicache.idx--;
+        ref[sb->bicache.idx] = NullReference;
+        sb->dz_free--;
+        soSBSave();
+
+        return true;
+    }
+
+    /* ***************************************** */
+};
@@ -7,16 +7,31 @@
 #include "work_freelists.h"
 
 #include "core.h"
+#include "dal.h"
 
 namespace sofs18
 {
 
     void soFreeDataBlock(uint32_t bn)
     {
+        SOStatTimer timer(SOSTAT_FREE_BLOCK);
+
+        if (soMagazineFreeDataBlock(bn))
+            return;
+
+        if (soGetAllocPolicy() == SOALLOC_NEAR)
+        {
+            soFreeNear(&bn, 1);
+            return;
+        }
+
         if (soBinSelected(442))
             bin::soFreeDataBlock(bn);
         else
             work::soFreeDataBlock(bn);
+
+        soFBMSet(bn, true);
+        soRefillerKick();
     }
 
 };
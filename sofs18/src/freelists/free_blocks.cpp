@@ -0,0 +1,40 @@
+/*
+ *  \authur Artur Pereira - 2009-2018
+ */
+
+#include "freelists.h"
+#include "bin_freelists.h"
+#include "work_freelists.h"
+
+#include "core.h"
+#include "dal.h"
+
+namespace sofs18
+{
+
+    void soFreeDataBlocks(const uint32_t *refs, uint32_t n)
+    {
+        SOStatTimer timer(SOSTAT_FREE_BLOCK, n);
+
+        if (soGetAllocPolicy() == SOALLOC_NEAR)
+        {
+            soFreeNear(refs, n);
+            return;
+        }
+
+        if (soBinSelected(446))
+        {
+            /* there is no binary version: free one block at a time */
+            for (uint32_t i = 0; i < n; i++)
+                bin::soFreeDataBlock(refs[i]);
+        }
+        else
+            work::soFreeDataBlocks(refs, n);
+
+        for (uint32_t i = 0; i < n; i++)
+            soFBMSet(refs[i], true);
+        soRefillerKick();
+    }
+
+};
+
@@ -13,10 +13,17 @@ namespace sofs18
 
     void soFreeInode(uint32_t in)
     {
+        SOStatTimer timer(SOSTAT_FREE_INODE);
+
+        if (soMagazineFreeInode(in))
+            return;
+
         if (soBinSelected(402))
             bin::soFreeInode(in);
         else
             work::soFreeInode(in);
+
+        soRefillerKick();
     }
 
 };
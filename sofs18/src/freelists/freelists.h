@@ -12,6 +12,7 @@
 #define __SOFS18_FREELISTS__
 
 #include <inttypes.h>
+#include <pthread.h>
 
 namespace sofs18
 {
@@ -103,6 +104,184 @@ namespace sofs18
 
     /* *************************************************** */
 
+    /**
+     *  \brief Allocate a number of free data blocks at once.
+     *
+     *  \details
+     *  Up to \c n data block references are retrieved from the data block retrieval cache,
+     *  replenishing it as many times as necessary.
+     *
+     *  \param [in] n the number of data blocks wanted
+     *  \param [out] refs array, with room for \c n references, where the allocated ones are stored
+     *
+     *  \remarks
+     *
+     *  \li fewer than \c n blocks are allocated only if the disk runs out of free data blocks;
+     *  \li the references are stored in ascending order, so that consecutive file blocks
+     *      get physically contiguous data blocks whenever the free list holds contiguous runs;
+     *  \li the superblock is saved once, not once per block;
+     *  \li if there are no free data blocks, error \c ENOSPC must be thrown;
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     *
+     *  \return the number of data blocks allocated
+     */
+    uint32_t soAllocDataBlocks(uint32_t n, uint32_t *refs);
+
+    /* *************************************************** */
+
+    /** \brief Data block allocation policies */
+    enum SOAllocPolicy
+    {
+        SOALLOC_FIFO = 0,       ///< blocks are taken in free list order
+        SOALLOC_NEAR = 1        ///< blocks are taken from the free block map, close to a hint
+    };
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Set the data block allocation policy.
+     *
+     *  \details
+     *  With \c SOALLOC_NEAR, the free block map takes over the free lists
+     *  (see \c soFBMAcquire) on the first allocation or release,
+     *  and blocks are allocated as close as possible to the given hint,
+     *  or right after the last block allocated if there is none.
+     *  Setting \c SOALLOC_FIFO gives the free lists back.
+     *
+     *  \param [in] policy the policy
+     *
+     *  \remarks
+     *
+     *  \li if never called, the policy is taken from environment variable
+     *      \c SOFS18_ALLOC_POLICY ("fifo" or "near"), defaulting to \c SOALLOC_FIFO.
+     */
+    void soSetAllocPolicy(SOAllocPolicy policy);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Get the data block allocation policy.
+     */
+    SOAllocPolicy soGetAllocPolicy();
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Allocate a free data block, close to a given one.
+     *
+     *  \param [in] hint the number of the data block wanted, or \c NullReference
+     *
+     *  \remarks
+     *
+     *  \li with the \c SOALLOC_FIFO policy, \c hint is ignored and this is \c soAllocDataBlock;
+     *  \li a block in the calling thread's magazine, if any, is taken first.
+     *
+     *  \return the number (reference) of the data block allocated
+     */
+    uint32_t soAllocDataBlockNear(uint32_t hint);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Allocate a number of free data blocks at once, close to a given one.
+     *
+     *  \param [in] hint the number of the data block wanted first, or \c NullReference
+     *  \param [in] n the number of data blocks wanted
+     *  \param [out] refs array, with room for \c n references, where the allocated ones are stored
+     *
+     *  \remarks
+     *
+     *  \li with the \c SOALLOC_FIFO policy, \c hint is ignored and this is \c soAllocDataBlocks;
+     *  \li with the \c SOALLOC_NEAR policy, references are stored in allocation order,
+     *      which is ascending except when the search wraps around the end of the data zone.
+     *
+     *  \return the number of data blocks allocated
+     */
+    uint32_t soAllocDataBlocksNear(uint32_t hint, uint32_t n, uint32_t *refs);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Allocate data blocks with the \c SOALLOC_NEAR policy.
+     *  \details Used by the allocation functions; throws \c ENOSPC if no block is free.
+     *  \return the number of data blocks allocated
+     */
+    uint32_t soAllocNear(uint32_t hint, uint32_t n, uint32_t *refs);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Free data blocks with the \c SOALLOC_NEAR policy.
+     *  \details Used by the release functions.
+     */
+    void soFreeNear(const uint32_t *refs, uint32_t n);
+
+    /* *************************************************** */
+
+    /** \brief Policies for the reuse of freed data blocks */
+    enum SORecyclePolicy
+    {
+        SORECYCLE_FIFO = 0,     ///< freed blocks go through the free list before being reused
+        SORECYCLE_LIFO = 1      ///< freed blocks are reused straight from the insertion cache
+    };
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Set the policy for the reuse of freed data blocks.
+     *
+     *  \details
+     *  With \c SORECYCLE_LIFO, a data block allocation takes the most recently freed block
+     *  of the insertion cache that has at least \c distance blocks freed after it,
+     *  before looking at the retrieval cache, saving the round trip through the free list
+     *  and reusing blocks likely to still be in the block cache.
+     *  With \c SORECYCLE_FIFO, freed blocks are reused in free list order, as late as possible.
+     *
+     *  \param [in] policy the policy
+     *  \param [in] distance minimum number of blocks freed after a block before it is reused;
+     *      ignored with \c SORECYCLE_FIFO
+     *
+     *  \remarks
+     *
+     *  \li \c distance must be less than \c BLOCK_REFERENCE_CACHE_SIZE;
+     *  \li if never called, the policy is taken from environment variable
+     *      \c SOFS18_RECYCLE ("fifo", "lifo" or "lifo,distance"), defaulting to \c SORECYCLE_FIFO;
+     *  \li ignored with the \c SOALLOC_NEAR allocation policy.
+     */
+    void soSetRecyclePolicy(SORecyclePolicy policy, uint32_t distance);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Allocate a data block straight from the insertion cache.
+     *  \details Used by \c soAllocDataBlock, with the \c SORECYCLE_LIFO policy.
+     *
+     *  \param [out] bn where to put the number of the data block
+     *  \return false, if the policy is \c SORECYCLE_FIFO or no block is old enough
+     */
+    bool soRecycleDataBlock(uint32_t *bn);
+
+    /* *************************************************** */
+
+    /**
+     *  \brief Free a number of data blocks at once.
+     *
+     *  \details
+     *  The data block references are inserted into the data block insertion cache,
+     *  depleting it as many times as necessary.
+     *
+     *  \param [in] refs the numbers (references) of the data blocks to be freed
+     *  \param [in] n the number of references in \c refs
+     *
+     *  \remarks
+     *
+     *  \li the superblock is saved once, not once per block;
+     *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
+     */
+    void soFreeDataBlocks(const uint32_t *refs, uint32_t n);
+
+    /* *************************************************** */
+
     /**
      * \brief Replenish the inode retrieval cache
      * \details References to free inode should be transferred from the free inode list table
@@ -112,10 +291,10 @@ namespace sofs18
      *
      *  \li nothing should be done if the retrieval cache is not empty;
      *  \li the insertion cache should only be used if the free inode list table (\c FILT) is empty;
-     *  \li only a single block should be processed, 
-     *      even if it is not enough to fulfill the retrieval cache;
-     *  \li the block to be processes is the one pointed to by the \c filt_head field 
-     *      of the superblock;
+     *  \li as many references as fit in the retrieval cache should be transferred,
+     *      starting at the position pointed to by the \c filt_head field of the superblock
+     *      and crossing block boundaries if necessary;
+     *  \li contiguous blocks should be accessed through a single window (\c soFILTOpenBlocks);
      *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
      */
     void soReplenishIRCache();
@@ -131,10 +310,10 @@ namespace sofs18
      *
      *  \li nothing should be done if the retrieval cache is not empty;
      *  \li the insertion cache should only be used if the free data block list table (\c FBLT) is empty;
-     *  \li only a single block should be processed, 
-     *          even if it is not enough to fulfill the retrieval cache;
-     *  \li the block to be processed is the one pointed to by the \c fblt_head field 
-     *      of the superblock;
+     *  \li as many references as fit in the retrieval cache should be transferred,
+     *      starting at the position pointed to by the \c fblt_head field of the superblock
+     *      and crossing block boundaries if necessary;
+     *  \li contiguous blocks should be accessed through a single window (\c soFBLTOpenBlocks);
      *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
      */
     void soReplenishBRCache();
@@ -148,10 +327,10 @@ namespace sofs18
      *
      *  \remarks
      *
-     *  \li only a single block of the \c FILT should be processed, 
-     *          even if it is not enough to empty the insertion cache;
-     *  \li the block to be processed is the one pointed to by the \c filt_tail field 
-     *      of the superblock;
+     *  \li the whole insertion cache should be transferred,
+     *      starting at the position pointed to by the \c filt_tail field of the superblock
+     *      and crossing block boundaries if necessary;
+     *  \li contiguous blocks should be accessed through a single window (\c soFILTOpenBlocks);
      *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
      */
     void soDepleteIICache();
@@ -165,14 +344,159 @@ namespace sofs18
      *
      *  \remarks
      *
-     *  \li only a single block of the \c FBLT should be processed, 
-     *          even if it is not enough to empty the insertion cache;
-     *  \li the block to be processed is the one pointed to by the \c fblt_tail field 
-     *      of the superblock;
+     *  \li the whole insertion cache should be transferred,
+     *      starting at the position pointed to by the \c fblt_tail field of the superblock
+     *      and crossing block boundaries if necessary;
+     *  \li contiguous blocks should be accessed through a single window (\c soFBLTOpenBlocks);
      *  \li when calling a function of any layer, use the main version (sofs18::«func»(...)).
      */
     void soDepleteBICache();
 
+    /* *************************************************** */
+
+    /**
+     * \brief Set the size of the per-thread allocation magazines
+     * \details Every thread allocating inodes or data blocks gets its own magazines,
+     *      stocks of references reserved in batches of half their size from the free lists,
+     *      so most allocations and releases do not touch the superblock caches.
+     *      A full magazine gives half of its references back to the free lists.
+     *
+     *  \param [in] inodes size of the inode magazines
+     *  \param [in] blocks size of the data block magazines
+     *
+     *  \remarks
+     *
+     *  \li a size of 0 disables the corresponding magazines, which is the default;
+     *  \li if never called, sizes are taken from environment variables
+     *      \c SOFS18_MAG_INODES and \c SOFS18_MAG_BLOCKS;
+     *  \li reserved references are not counted as free in the superblock;
+     *      those of a thread that exits are queued, as it does not hold the filesystem lock,
+     *      and given back by the next refill or release of a magazine and on \c soMagazineDrain;
+     *  \li a magazine refill about to fail with \c ENOSPC first empties every magazine.
+     */
+    void soMagazineSetSize(uint32_t inodes, uint32_t blocks);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Give the references held in every thread's magazines back to the free lists
+     *
+     *  \remarks
+     *
+     *  \li must be called before the disk is closed, with no allocation or release under way.
+     */
+    void soMagazineDrain();
+
+    /* *************************************************** */
+
+    /**
+     * \brief Allocate an inode from the calling thread's magazine
+     * \details Used by \c soAllocInode; the inode is initialized as there.
+     *
+     *  \param [in] type the inode type
+     *  \param [out] in where to put the number of the inode
+     *  \return false, if inode magazines are disabled
+     */
+    bool soMagazineAllocInode(uint32_t type, uint32_t *in);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Free an inode into the calling thread's magazine
+     * \details Used by \c soFreeInode; the inode is cleared as there.
+     *
+     *  \param [in] in number of the inode
+     *  \return false, if inode magazines are disabled
+     */
+    bool soMagazineFreeInode(uint32_t in);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Allocate a data block from the calling thread's magazine
+     * \details Used by \c soAllocDataBlock.
+     *
+     *  \param [out] bn where to put the number of the data block
+     *  \return false, if data block magazines are disabled
+     */
+    bool soMagazineAllocDataBlock(uint32_t *bn);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Free a data block into the calling thread's magazine
+     * \details Used by \c soFreeDataBlock.
+     *
+     *  \param [in] bn number of the data block
+     *  \return false, if data block magazines are disabled
+     */
+    bool soMagazineFreeDataBlock(uint32_t bn);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Set the watermarks of the superblock reference caches
+     * \details A retrieval cache holding less than \c low percent of its size
+     *  is topped up to \c high percent; an insertion cache holding more than
+     *  \c high percent of its size is drained down to \c low percent.
+     *  If not called, they are taken from the \c SOFS18_REFILL_WATERMARKS environment
+     *  variable (\c low,high), or default to 25 and 75.
+     *
+     *  \param [in] low low watermark, in percentage of the cache size
+     *  \param [in] high high watermark, in percentage of the cache size
+     */
+    void soRefillSetWatermarks(uint32_t low, uint32_t high);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Check if a superblock reference cache crossed a watermark
+     * \return true, if \c soRefillCaches has something to do
+     */
+    bool soRefillNeeded();
+
+    /* *************************************************** */
+
+    /**
+     * \brief Top up the retrieval caches and drain the insertion caches
+     * \details References are taken from and given to the reference pools;
+     *  the block caches are left alone while the free block map owns the free blocks.
+     */
+    void soRefillCaches();
+
+    /* *************************************************** */
+
+    /**
+     * \brief Start the thread that refills the superblock reference caches in background
+     *
+     *  \param [in] lock the lock serializing the accesses to the file system,
+     *      taken by the thread around every refill
+     *
+     *  \remarks
+     *
+     *  \li the disk must be open.
+     */
+    void soRefillerStart(pthread_mutex_t * lock);
+
+    /* *************************************************** */
+
+    /**
+     * \brief Stop the refill thread, waiting for it to finish
+     *
+     *  \remarks
+     *
+     *  \li must not be called with the lock given to \c soRefillerStart held.
+     */
+    void soRefillerStop();
+
+    /* *************************************************** */
+
+    /**
+     * \brief Wake the refill thread, if running and a cache crossed a watermark
+     * \details Called by the allocation and release functions.
+     */
+    void soRefillerKick();
+
     /* *************************************************** */
     /** @} close group freelists */
     /* *************************************************** */
@@ -0,0 +1,394 @@
+/*
+ *  \brief Per-thread allocation magazines
+ *
+ *  Every thread has a magazine of inode references and one of data block references,
+ *  reserved from the free lists in batches.
+ *  Allocations and releases only touch the calling thread's magazines;
+ *  the free lists (superblock caches and tables) are only touched to refill
+ *  an empty magazine or to give back half of a full one, under a single lock.
+ *  Reserved references are accounted as in use in the superblock
+ *  (ifree and dz_free), and in the free block map.
+ *  A thread going away does not hold the filesystem lock, so its magazines
+ *  are only queued; they are given back by the next refill, release or drain,
+ *  which run on behalf of a filesystem operation.
+ *  Before an allocation fails with ENOSPC, the magazines of every thread are emptied,
+ *  so each of them has a lock of its own, taken by its thread on every access,
+ *  and only contended by such a reclaim; the free lists lock is always taken first.
+ */
+
+#include "freelists.h"
+
+#include "core.h"
+#include "dal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    struct SOMagazines
+    {
+        std::mutex mtx;                 ///< guards the references, against a reclaim by another thread
+        std::vector<uint32_t> inodes;
+        std::vector<uint32_t> blocks;
+
+        SOMagazines();
+        ~SOMagazines();
+    };
+
+    static std::mutex lock;                     ///< serializes accesses to the free lists
+    static std::set<SOMagazines *> registry;    ///< magazines of all living threads
+    static std::vector<uint32_t> orphanInodes;  ///< inode references of the threads gone
+    static std::vector<uint32_t> orphanBlocks;  ///< data block references of the threads gone
+
+    static uint32_t inodeSize = 0;
+    static uint32_t blockSize = 0;
+    static bool sizeSet = false;
+
+    static thread_local SOMagazines mags;
+
+    /* ***************************************** */
+
+    /* take sizes from the environment, if not set explicitly */
+    static void soMagazineConfigure()
+    {
+        if (sizeSet)
+            return;
+
+        const char *env = getenv("SOFS18_MAG_INODES");
+        inodeSize = (env != NULL) ? (uint32_t)atol(env) : 0;
+        env = getenv("SOFS18_MAG_BLOCKS");
+        blockSize = (env != NULL) ? (uint32_t)atol(env) : 0;
+        sizeSet = true;
+    }
+
+    /* ***************************************** */
+
+    /* take up to n free inode references out of the free lists; called with lock held */
+    static uint32_t soReserveInodes(uint32_t n, uint32_t *refs)
+    {
+        SOSuperBlock *sb = soSBGetPointer();
+
+        uint32_t got = 0;
+        while (got < n and sb->ifree > 0)
+        {
+            if (sb->ircache.idx == INODE_REFERENCE_CACHE_SIZE)
+            {
+                sofs18::soReplenishIRCache();
+                if (sb->ircache.idx == INODE_REFERENCE_CACHE_SIZE)
+                    break;
+            }
+            refs[got++] = sb->ircache.ref[sb->ircache.idx];
+            sb->ircache.ref[sb->ircache.idx] = NullReference;
+            sb->ircache.idx++;
+            sb->ifree--;
+        }
+
+        if (got > 0)
+            soSBSave();
+        return got;
+    }
+
+    /* ***************************************** */
+
+    /* give n free inode references back to the free lists; called with lock held */
+    static void soReturnInodes(const uint32_t *refs, uint32_t n)
+    {
+        SOSuperBlock *sb = soSBGetPointer();
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (sb->iicache.idx == INODE_REFERENCE_CACHE_SIZE)
+                sofs18::soDepleteIICache();
+            sb->iicache.ref[sb->iicache.idx++] = refs[i];
+            sb->ifree++;
+        }
+
+        if (n > 0)
+            soSBSave();
+    }
+
+    /* ***************************************** */
+
+    /* give the whole contents of a set of magazines back; called with lock held */
+    static void soMagazineEmpty(SOMagazines * m)
+    {
+        std::vector<uint32_t> inodes;
+        std::vector<uint32_t> blocks;
+        {
+            std::lock_guard<std::mutex> own(m->mtx);
+            inodes.swap(m->inodes);
+            blocks.swap(m->blocks);
+        }
+
+        if (not inodes.empty())
+            soReturnInodes(inodes.data(), inodes.size());
+        if (not blocks.empty())
+            sofs18::soFreeDataBlocks(blocks.data(), blocks.size());
+    }
+
+    /* ***************************************** */
+
+    /* take the last reference of a magazine of the calling thread; false if it is empty */
+    static bool soMagazineTake(std::vector<uint32_t> & v, uint32_t *ref)
+    {
+        std::lock_guard<std::mutex> own(mags.mtx);
+        if (v.empty())
+            return false;
+
+        *ref = v.back();
+        v.pop_back();
+        return true;
+    }
+
+    /* ***************************************** */
+
+    /* give back the magazines of the threads gone; called with lock held */
+    static void soMagazineAdopt()
+    {
+        if (not orphanInodes.empty())
+        {
+            soReturnInodes(orphanInodes.data(), orphanInodes.size());
+            orphanInodes.clear();
+        }
+        if (not orphanBlocks.empty())
+        {
+            sofs18::soFreeDataBlocks(orphanBlocks.data(), orphanBlocks.size());
+            orphanBlocks.clear();
+        }
+    }
+
+    /* ***************************************** */
+
+    /* empty the magazines of every thread, before giving up with ENOSPC; called with lock held */
+    static void soMagazineReclaim()
+    {
+        soMagazineAdopt();
+        for (SOMagazines *m : registry)
+            soMagazineEmpty(m);
+    }
+
+    /* ***************************************** */
+
+    SOMagazines::SOMagazines()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        registry.insert(this);
+    }
+
+    /* ***************************************** */
+
+    SOMagazines::~SOMagazines()
+    {
+        /* the free lists must not be touched here: the references are queued */
+        std::lock_guard<std::mutex> guard(lock);
+        registry.erase(this);
+        orphanInodes.insert(orphanInodes.end(), inodes.begin(), inodes.end());
+        orphanBlocks.insert(orphanBlocks.end(), blocks.begin(), blocks.end());
+    }
+
+    /* ***************************************** */
+
+    void soMagazineSetSize(uint32_t inodes, uint32_t blocks)
+    {
+        soProbe(451, "%s(%u, %u)\n", __FUNCTION__, inodes, blocks);
+
+        inodeSize = inodes;
+        blockSize = blocks;
+        sizeSet = true;
+    }
+
+    /* ***************************************** */
+
+    void soMagazineDrain()
+    {
+        soProbe(452, "%s()\n", __FUNCTION__);
+
+        std::lock_guard<std::mutex> guard(lock);
+        soMagazineReclaim();
+    }
+
+    /* ***************************************** */
+
+    bool soMagazineAllocInode(uint32_t type, uint32_t *in)
+    {
+        soMagazineConfigure();
+        if (inodeSize == 0)
+            return false;
+
+        soProbe(453, "%s(%x, %p)\n", __FUNCTION__, type, in);
+
+        if (type != S_IFREG and type != S_IFDIR and type != S_IFLNK)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        /* refill with half a magazine */
+        if (not soMagazineTake(mags.inodes, in))
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            soMagazineAdopt();
+            std::vector<uint32_t> refs((inodeSize + 1) / 2);
+            uint32_t got = soReserveInodes(refs.size(), refs.data());
+            if (got == 0)
+            {
+                /* free inodes may be sitting in the magazines of other threads */
+                soMagazineReclaim();
+                got = soReserveInodes(refs.size(), refs.data());
+            }
+            if (got == 0)
+                throw SOException(ENOSPC, __FUNCTION__);
+            *in = refs[--got];
+            refs.resize(got);
+
+            std::lock_guard<std::mutex> own(mags.mtx);
+            mags.inodes.insert(mags.inodes.end(), refs.begin(), refs.end());
+        }
+
+        int ih = soITOpenInode(*in);
+        SOInode *ip = soITGetInodePointer(ih);
+        time_t now = time(NULL);
+        ip->mode = type;
+        ip->atime = now;
+        ip->mtime = now;
+        ip->ctime = now;
+        ip->owner = getuid();
+        ip->group = getgid();
+        soITSaveInode(ih);
+        soITCloseInode(ih);
+
+        return true;
+    }
+
+    /* ***************************************** */
+
+    bool soMagazineFreeInode(uint32_t in)
+    {
+        soMagazineConfigure();
+        if (inodeSize == 0)
+            return false;
+
+        soProbe(454, "%s(%u)\n", __FUNCTION__, in);
+
+        int ih = soITOpenInode(in);
+        SOInode *ip = soITGetInodePointer(ih);
+        ip->mode = INODE_FREE;
+        ip->lnkcnt = 0;
+        ip->owner = 0;
+        ip->group = 0;
+        ip->size = 0;
+        ip->blkcnt = 0;
+        ip->atime = 0;
+        ip->mtime = 0;
+        ip->ctime = 0;
+        soITSaveInode(ih);
+        soITCloseInode(ih);
+
+        /* give back the older half of a full magazine */
+        std::unique_lock<std::mutex> own(mags.mtx);
+        if (mags.inodes.size() >= inodeSize)
+        {
+            own.unlock();
+            std::lock_guard<std::mutex> guard(lock);
+            soMagazineAdopt();
+            /* a reclaim may have emptied it meanwhile */
+            own.lock();
+            uint32_t half = mags.inodes.size() / 2;
+            if (half > 0)
+            {
+                soReturnInodes(mags.inodes.data(), half);
+                mags.inodes.erase(mags.inodes.begin(), mags.inodes.begin() + half);
+            }
+        }
+        mags.inodes.push_back(in);
+
+        return true;
+    }
+
+    /* ***************************************** */
+
+    bool soMagazineAllocDataBlock(uint32_t *bn)
+    {
+        soMagazineConfigure();
+        if (blockSize == 0)
+            return false;
+
+        soProbe(455, "%s(%p)\n", __FUNCTION__, bn);
+
+        /* refill with half a magazine, in ascending order, handed out from the front */
+        if (not soMagazineTake(mags.blocks, bn))
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            soMagazineAdopt();
+            std::vector<uint32_t> refs((blockSize + 1) / 2);
+            uint32_t got;
+            try
+            {
+                got = sofs18::soAllocDataBlocks(refs.size(), refs.data());
+            }
+            catch (SOException & err)
+            {
+                if (err.en != ENOSPC)
+                    throw;
+
+                /* free data blocks may be sitting in the magazines of other threads */
+                soMagazineReclaim();
+                got = sofs18::soAllocDataBlocks(refs.size(), refs.data());
+            }
+            if (got == 0)
+                throw SOException(ENOSPC, __FUNCTION__);
+            *bn = refs[0];
+            std::reverse(refs.begin() + 1, refs.begin() + got);
+
+            std::lock_guard<std::mutex> own(mags.mtx);
+            mags.blocks.insert(mags.blocks.end(), refs.begin() + 1, refs.begin() + got);
+        }
+
+        return true;
+    }
+
+    /* ***************************************** */
+
+    bool soMagazineFreeDataBlock(uint32_t bn)
+    {
+        soMagazineConfigure();
+        if (blockSize == 0)
+            return false;
+
+        soProbe(456, "%s(%u)\n", __FUNCTION__, bn);
+
+        if (bn >= soSBGetPointer()->dz_total)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        /* give back the older half of a full magazine */
+        std::unique_lock<std::mutex> own(mags.mtx);
+        if (mags.blocks.size() >= blockSize)
+        {
+            own.unlock();
+            std::lock_guard<std::mutex> guard(lock);
+            soMagazineAdopt();
+            /* a reclaim may have emptied it meanwhile */
+            own.lock();
+            uint32_t half = mags.blocks.size() / 2;
+            if (half > 0)
+            {
+                sofs18::soFreeDataBlocks(mags.blocks.data(), half);
+                mags.blocks.erase(mags.blocks.begin(), mags.blocks.begin() + half);
+            }
+        }
+        mags.blocks.push_back(bn);
+
+        return true;
+    }
+
+    /* ***************************************** */
+};
+
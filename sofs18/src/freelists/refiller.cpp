@@ -0,0 +1,276 @@
+/*
+ *  \brief Background refill of the superblock reference caches
+ *
+ *  A retrieval cache holding fewer references than the low watermark is topped up
+ *  to the high watermark, and an insertion cache holding more than the high watermark
+ *  is drained down to the low watermark, both through the reference pools.
+ *  Done by a worker thread, woken by the allocation and release functions
+ *  when a cache crosses a watermark, so the foreground rarely finds a retrieval cache
+ *  empty or an insertion cache full.
+ *  The worker takes the lock that serializes the accesses to the file system
+ *  before touching anything, so it only runs between foreground requests.
+ */
+
+#include "freelists.h"
+
+#include "core.h"
+#include "dal.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* default watermarks, in percentage of the cache size */
+#define REFILL_DEFAULT_LOW 25
+#define REFILL_DEFAULT_HIGH 75
+
+    static uint32_t low = REFILL_DEFAULT_LOW;
+    static uint32_t high = REFILL_DEFAULT_HIGH;
+    static bool watermarksSet = false;
+
+    static pthread_mutex_t refillCR = PTHREAD_MUTEX_INITIALIZER;    ///< protects everything below
+    static pthread_cond_t kicked = PTHREAD_COND_INITIALIZER;        ///< a cache crossed a watermark
+    static pthread_t worker;
+    static pthread_mutex_t *fsLock = NULL;  ///< lock serializing the accesses to the file system
+    static std::atomic<bool> running(false);   ///< read by the foreground without the lock
+    static bool pending = false;
+    static bool stopping = false;
+
+    /* ***************************************** */
+
+    /* take the watermarks from the environment, if not set explicitly */
+    static void soRefillConfigure()
+    {
+        if (watermarksSet)
+            return;
+
+        const char *env = getenv("SOFS18_REFILL_WATERMARKS");
+        uint32_t l, h;
+        if (env != NULL and sscanf(env, "%u,%u", &l, &h) == 2 and l <= h and h <= 100)
+        {
+            low = l;
+            high = h;
+        }
+        watermarksSet = true;
+    }
+
+    /* ***************************************** */
+
+    /*
+     * top up a retrieval cache, whose references are in ref[idx..size), to the high watermark,
+     * keeping the references already there in front
+     */
+    static bool soTopUp(SORPKind k, uint32_t * ref, uint32_t & idx, uint32_t size)
+    {
+        uint32_t count = size - idx;
+        if (count * 100 >= low * size)
+            return false;
+
+        uint32_t want = (high * size + 99) / 100 - count;
+        uint32_t fresh[BLOCK_REFERENCE_CACHE_SIZE];     /* the larger of the two caches */
+        uint32_t got = soRPTake(k, fresh, want);
+        if (got == 0)
+            return false;
+
+        memmove(&ref[idx - got], &ref[idx], count * sizeof(uint32_t));
+        memcpy(&ref[size - got], fresh, got * sizeof(uint32_t));
+        idx -= got;
+        return true;
+    }
+
+    /* ***************************************** */
+
+    /*
+     * drain an insertion cache, whose references are in ref[0..idx), to the low watermark,
+     * the older references going first
+     */
+    static bool soDrain(SORPKind k, uint32_t * ref, uint32_t & idx, uint32_t size)
+    {
+        if (idx * 100 <= high * size)
+            return false;
+
+        uint32_t n = idx - low * size / 100;
+        soRPPut(k, ref, n);
+        memmove(ref, &ref[n], (idx - n) * sizeof(uint32_t));
+        for (uint32_t i = idx - n; i < idx; i++)
+            ref[i] = NullReference;
+        idx -= n;
+        return true;
+    }
+
+    /* ***************************************** */
+
+    void soRefillSetWatermarks(uint32_t l, uint32_t h)
+    {
+        soProbe(460, "%s(%u, %u)\n", __FUNCTION__, l, h);
+
+        if (l > h or h > 100)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        low = l;
+        high = h;
+        watermarksSet = true;
+    }
+
+    /* ***************************************** */
+
+    bool soRefillNeeded()
+    {
+        soRefillConfigure();
+
+        SOSuperBlock *sb = soSBGetPointer();
+
+        /* a retrieval cache is only worth topping up if there are free references outside the caches */
+        uint32_t isz = INODE_REFERENCE_CACHE_SIZE;
+        if ((isz - sb->ircache.idx) * 100 < low * isz and sb->ifree > isz - sb->ircache.idx + sb->iicache.idx)
+            return true;
+        if (sb->iicache.idx * 100 > high * isz)
+            return true;
+
+        /* under the near policy the free block map owns the free blocks */
+        if (soFBMOwned())
+            return false;
+
+        uint32_t bsz = BLOCK_REFERENCE_CACHE_SIZE;
+        if ((bsz - sb->brcache.idx) * 100 < low * bsz and sb->dz_free > bsz - sb->brcache.idx + sb->bicache.idx)
+            return true;
+        if (sb->bicache.idx * 100 > high * bsz)
+            return true;
+
+        return false;
+    }
+
+    /* ***************************************** */
+
+    void soRefillCaches()
+    {
+        soProbe(461, "%s()\n", __FUNCTION__);
+
+        soRefillConfigure();
+
+        SOSuperBlock *sb = soSBGetPointer();
+
+        bool changed = false;
+        changed |= soTopUp(SORP_INODE, sb->ircache.ref, sb->ircache.idx, INODE_REFERENCE_CACHE_SIZE);
+        changed |= soDrain(SORP_INODE, sb->iicache.ref, sb->iicache.idx, INODE_REFERENCE_CACHE_SIZE);
+        if (not soFBMOwned())
+        {
+            changed |= soTopUp(SORP_BLOCK, sb->brcache.ref, sb->brcache.idx, BLOCK_REFERENCE_CACHE_SIZE);
+            changed |= soDrain(SORP_BLOCK, sb->bicache.ref, sb->bicache.idx, BLOCK_REFERENCE_CACHE_SIZE);
+        }
+
+        if (changed)
+            soSBSave();
+    }
+
+    /* ***************************************** */
+
+    static void *soRefillWorker(void *)
+    {
+        pthread_mutex_lock(&refillCR);
+        while (true)
+        {
+            while (not pending and not stopping)
+                pthread_cond_wait(&kicked, &refillCR);
+            if (stopping)
+                break;
+            pending = false;
+            pthread_mutex_unlock(&refillCR);
+
+            pthread_mutex_lock(fsLock);
+            try
+            {
+                soRefillCaches();
+            }
+            catch (SOException & err)
+            {
+                /* the foreground will find the cache empty or full and report it */
+            }
+            pthread_mutex_unlock(fsLock);
+
+            pthread_mutex_lock(&refillCR);
+        }
+        pthread_mutex_unlock(&refillCR);
+
+        return NULL;
+    }
+
+    /* ***************************************** */
+
+    void soRefillerStart(pthread_mutex_t * lock)
+    {
+        soProbe(462, "%s(%p)\n", __FUNCTION__, lock);
+
+        if (lock == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        pthread_mutex_lock(&refillCR);
+        if (running)
+        {
+            pthread_mutex_unlock(&refillCR);
+            throw SOException(EBUSY, __FUNCTION__);
+        }
+        fsLock = lock;
+        pending = false;
+        stopping = false;
+        int stat = pthread_create(&worker, NULL, soRefillWorker, NULL);
+        if (stat != 0)
+        {
+            pthread_mutex_unlock(&refillCR);
+            throw SOException(stat, __FUNCTION__);
+        }
+        running = true;
+        pthread_mutex_unlock(&refillCR);
+    }
+
+    /* ***************************************** */
+
+    void soRefillerStop()
+    {
+        soProbe(465, "%s()\n", __FUNCTION__);
+
+        pthread_mutex_lock(&refillCR);
+        if (not running)
+        {
+            pthread_mutex_unlock(&refillCR);
+            return;
+        }
+        stopping = true;
+        pthread_cond_signal(&kicked);
+        pthread_mutex_unlock(&refillCR);
+
+        pthread_join(worker, NULL);
+
+        pthread_mutex_lock(&refillCR);
+        running = false;
+        fsLock = NULL;
+        pthread_mutex_unlock(&refillCR);
+    }
+
+    /* ***************************************** */
+
+    void soRefillerKick()
+    {
+        if (not running or not soRefillNeeded())
+            return;
+
+        pthread_mutex_lock(&refillCR);
+        if (not pending)
+        {
+            pending = true;
+            pthread_cond_signal(&kicked);
+        }
+        pthread_mutex_unlock(&refillCR);
+    }
+
+    /* ***************************************** */
+};
+
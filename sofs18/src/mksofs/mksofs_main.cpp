@@ -15,6 +15,7 @@
 #include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /* print help message */
 static void printUsage(char *cmd_name)
@@ -53,6 +54,27 @@ static void errnoMsg(int en, const char *msg)
         strerror(en));
 }
 
+/* time spent in every formatting phase */
+static struct
+{
+    const char *name;
+    double ms;
+} phases[8];
+static int nphases = 0;
+static struct timespec phaseStart;
+
+/* close the current phase, whose name is given, and open the next one */
+static void endPhase(const char *name)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    phases[nphases].name = name;
+    phases[nphases].ms = (now.tv_sec - phaseStart.tv_sec) * 1e3 
+        + (now.tv_nsec - phaseStart.tv_nsec) / 1e6;
+    nphases++;
+    phaseStart = now;
+}
+
 using namespace sofs18;
 
 /* The main function */
@@ -177,6 +199,7 @@ int main(int argc, char *argv[])
     {
         /* open the storage device */
         uint32_t ntotal;
+        clock_gettime(CLOCK_MONOTONIC, &phaseStart);
         soOpenRawDisk(devname, &ntotal);
 
         if (!quiet) 
@@ -187,42 +210,57 @@ int main(int argc, char *argv[])
         uint32_t rdsize; // number of blocks used by cluster reference table
         if (!quiet) infoMsg("  Computing disk structure... \n");
         computeStructure(ntotal, itotal, btotal, rdsize);
+        endPhase("structure");
         if (!quiet) infoMsg("    (itotal: %u, rdsize: %u).\n", itotal, rdsize);
 
         /* filling in the superblock fields: */
         if (!quiet) infoMsg("  Filling in the superblock fields... \n");
         fillInSuperBlock(volname, ntotal, itotal, rdsize);
+        endPhase("superblock");
 
         /* filling in the free inode list table: */
         uint32_t n = 1;
         if (!quiet) infoMsg("  Filling in the free inode list table... \n");
         n += fillInFreeInodeListTable(n, itotal);
+        endPhase("free inode list table");
 
         /* filling in the inode table: */
         if (!quiet) infoMsg("  Filling in the inode table... \n");
         n += fillInInodeTable(n, itotal, rdsize);
+        endPhase("inode table");
 
         /* filling in the free block list table: */
         if (!quiet) infoMsg("  Filling in the free block list table... \n");
         n += fillInFreeBlockListTable(n, btotal, rdsize);
+        endPhase("free block list table");
 
         /* filling in the root directory: */
         if (!quiet) infoMsg("  Filling in the root directory... \n");
         n += fillInRootDir(n, rdsize);
+        endPhase("root directory");
 
         /* reset free cluster, if required */
         if (zero)
         {
             if (!quiet) infoMsg("  Filling in free data blocks with zeros... \n    ");
             resetBlocks(n, ntotal - n);
+            endPhase("zeroing");
         }
 
         /* set magic number and save superblock */
         if (!quiet) infoMsg("  Setting magic number... \n");
-        SOSuperBlock sb;
-        soReadRawBlock(0, &sb);
+        union { SOSuperBlock sb; char data[BlockSize]; } block0;
+        SOSuperBlock & sb = block0.sb;
+        soReadRawBlock(0, &block0);
         sb.magic = MAGIC_NUMBER;
-        soWriteRawBlock(0, &sb);
+
+        /* stamp the block size, if there is room for it */
+        if (BlockSize > BlockSizeStampOffset)
+        {
+            uint32_t bs = BlockSize;
+            memcpy(block0.data + BlockSizeStampOffset, &bs, sizeof(bs));
+        }
+        soWriteRawBlock(0, &block0);
 
         /* reset dates if required */
 #ifdef RESET_DATE
@@ -234,9 +272,21 @@ int main(int argc, char *argv[])
 
         /* close device and quit */
         soCloseRawDisk();
+        endPhase("closing");
         if (!quiet) 
+        {
             infoMsg("A %ld-inodes SOFS18 file system was successfully installed in %s.\n", 
                         sb.itotal, argv[optind]);
+
+            double total = 0;
+            infoMsg("Time spent:\n");
+            for (int i = 0; i < nphases; i++)
+            {
+                infoMsg("  %-24s %10.3f ms\n", phases[i].name, phases[i].ms);
+                total += phases[i].ms;
+            }
+            infoMsg("  %-24s %10.3f ms\n", "total", total);
+        }
     }
     catch (SOException & err)
     {
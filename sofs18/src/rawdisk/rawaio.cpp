@@ -0,0 +1,406 @@
+/*
+ *  \brief Asynchronous block transfers
+ *
+ *  Requests are carried out by io_uring, if the library was found at build time
+ *  and the kernel supports it, or by a small pool of worker threads otherwise.
+ *  Submission and completion are meant to be driven by a single thread,
+ *  the one that owns the device.
+ */
+
+#include "rawdisk.h"
+#include "rawcache.h"
+
+#include "core.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef SOFS18_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* default number of worker threads of the pool */
+#define RAWAIO_DEFAULT_THREADS 4
+
+    /* number of entries of the io_uring submission queue */
+#define RAWAIO_RING_DEPTH 64
+
+    /* an asynchronous request */
+    struct SORawAioRequest
+    {
+        uint32_t id;        ///< request identifier
+        bool writing;       ///< true for a write, false for a read
+        uint32_t first;     ///< first block of the range
+        uint32_t count;     ///< number of blocks of the range
+        char *buf;          ///< user buffer
+        int err;            ///< error number, 0 on success
+        bool done;          ///< true once the transfer is over
+    };
+
+    static pthread_mutex_t aioCR = PTHREAD_MUTEX_INITIALIZER;   ///< protects everything below
+    static pthread_cond_t queued = PTHREAD_COND_INITIALIZER;    ///< a request was queued
+    static pthread_cond_t completed = PTHREAD_COND_INITIALIZER; ///< a request was completed
+
+    static std::deque<SORawAioRequest *> queue;     ///< requests waiting for a worker
+    static std::unordered_map<uint32_t, SORawAioRequest *> pending; ///< requests not yet waited for
+    static uint32_t inflight = 0;       ///< requests not yet completed
+    static uint32_t nextid = 1;         ///< identifier of the next request
+    static std::vector<pthread_t> workers;
+    static bool stopping = false;
+
+#ifdef SOFS18_HAVE_LIBURING
+    static struct io_uring ring;
+    static bool uring = false;          ///< true if requests go through io_uring
+#endif
+
+    static bool started = false;        ///< true once the engine is set up
+
+    /* ***************************************** */
+
+    /* carry out a request, recording its outcome */
+    static void soRawAioTransfer(SORawAioRequest * r)
+    {
+        try
+        {
+            if (r->writing)
+                soDevWrite(r->first, r->count, r->buf, "soSubmitRawWrite");
+            else
+                soDevRead(r->first, r->count, r->buf, "soSubmitRawRead");
+            r->err = 0;
+        }
+        catch (SOException & err)
+        {
+            r->err = err.en;
+        }
+    }
+
+    /* ***************************************** */
+
+    static void *soRawAioWorker(void *)
+    {
+        pthread_mutex_lock(&aioCR);
+        while (true)
+        {
+            while (queue.empty() and not stopping)
+                pthread_cond_wait(&queued, &aioCR);
+            if (queue.empty())
+                break;
+
+            SORawAioRequest *r = queue.front();
+            queue.pop_front();
+
+            pthread_mutex_unlock(&aioCR);
+            soRawAioTransfer(r);
+            pthread_mutex_lock(&aioCR);
+
+            r->done = true;
+            inflight--;
+            pthread_cond_broadcast(&completed);
+        }
+        pthread_mutex_unlock(&aioCR);
+
+        return NULL;
+    }
+
+    /* ***************************************** */
+
+#ifdef SOFS18_HAVE_LIBURING
+    /* collect io_uring completions; if wait is true, block until at least one arrives */
+    static void soRawAioReap(bool wait)
+    {
+        struct io_uring_cqe *cqe;
+        while ((wait ? io_uring_wait_cqe(&ring, &cqe) : io_uring_peek_cqe(&ring, &cqe)) == 0)
+        {
+            SORawAioRequest *r = (SORawAioRequest *) io_uring_cqe_get_data(cqe);
+            if (cqe->res < 0)
+                r->err = -cqe->res;
+            else if ((size_t)cqe->res != (size_t)r->count * BlockSize)
+                r->err = EIO;
+            else
+                r->err = 0;
+            r->done = true;
+            inflight--;
+            io_uring_cqe_seen(&ring, cqe);
+            wait = false;
+        }
+    }
+#endif
+
+    /* ***************************************** */
+
+    /* set up the engine, on first use */
+    static void soRawAioStart()
+    {
+        if (started)
+            return;
+
+        const char *env = getenv("SOFS18_RAWAIO");
+        bool pool = (env != NULL and strcmp(env, "pool") == 0);
+
+#ifdef SOFS18_HAVE_LIBURING
+        /* fall back to the pool if the kernel does not support io_uring */
+        if (not pool and io_uring_queue_init(RAWAIO_RING_DEPTH, &ring, 0) == 0)
+        {
+            uring = true;
+            started = true;
+            return;
+        }
+#else
+        (void)pool;
+#endif
+
+        env = getenv("SOFS18_RAWAIO_THREADS");
+        uint32_t n = (env != NULL) ? (uint32_t)atol(env) : RAWAIO_DEFAULT_THREADS;
+        if (n == 0)
+            n = 1;
+
+        stopping = false;
+        for (uint32_t i = 0; i < n; i++)
+        {
+            pthread_t t;
+            int en = pthread_create(&t, NULL, soRawAioWorker, NULL);
+            if (en != 0)
+            {
+                if (workers.empty())
+                    throw SOException(en, __FUNCTION__);
+                break;
+            }
+            workers.push_back(t);
+        }
+        started = true;
+    }
+
+    /* ***************************************** */
+
+    /* check arguments of a request and launch it */
+    static uint32_t soRawAioSubmit(uint32_t first, uint32_t count, void *buf,
+            bool writing, const char *funcname)
+    {
+        /* checking arguments */
+        if (buf == NULL)
+            throw SOException(EINVAL, funcname);
+
+        soDevCheckRange(first, count, funcname);
+
+        /* keep the block cache coherent with the device */
+        if (soRawCacheActive())
+        {
+            if (writing)
+            {
+                for (uint32_t i = 0; i < count; i++)
+                    soRawCacheUpdate(first + i, (char *)buf + (size_t)i * BlockSize);
+            }
+            else
+                soRawCacheWriteBack(first, count);
+        }
+
+        if (not soDevMapped())
+            soRawAioStart();
+
+        SORawAioRequest *r = new SORawAioRequest;
+        r->writing = writing;
+        r->first = first;
+        r->count = count;
+        r->buf = (char *)buf;
+        r->err = 0;
+        r->done = false;
+
+        /* in mmap mode, a transfer is a memory copy; there is no point in deferring it */
+        if (soDevMapped())
+        {
+            soRawAioTransfer(r);
+            r->done = true;
+        }
+
+        pthread_mutex_lock(&aioCR);
+        r->id = nextid++;
+        if (nextid == NullReference)
+            nextid = 1;
+        pending[r->id] = r;
+        if (not r->done)
+        {
+            inflight++;
+#ifdef SOFS18_HAVE_LIBURING
+            if (uring)
+            {
+                struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+                if (sqe == NULL)
+                {
+                    /* submission queue full: hand it over to the kernel and retry */
+                    io_uring_submit(&ring);
+                    sqe = io_uring_get_sqe(&ring);
+                }
+                size_t len = (size_t)count * BlockSize;
+                off_t off = (off_t)first * BlockSize;
+                if (writing)
+                    io_uring_prep_write(sqe, soDevDescriptor(), buf, len, off);
+                else
+                    io_uring_prep_read(sqe, soDevDescriptor(), buf, len, off);
+                io_uring_sqe_set_data(sqe, r);
+                io_uring_submit(&ring);
+
+                /* collect whatever is already complete, so the completion queue never overflows */
+                soRawAioReap(false);
+            }
+            else
+#endif
+            {
+                queue.push_back(r);
+                pthread_cond_signal(&queued);
+            }
+        }
+        uint32_t id = r->id;
+        pthread_mutex_unlock(&aioCR);
+
+        return id;
+    }
+
+    /* ***************************************** */
+
+    /* wait for request r to complete; to be called with aioCR locked */
+    static void soRawAioAwait(SORawAioRequest * r)
+    {
+        while (not r->done)
+        {
+#ifdef SOFS18_HAVE_LIBURING
+            if (uring)
+            {
+                soRawAioReap(true);
+                continue;
+            }
+#endif
+            pthread_cond_wait(&completed, &aioCR);
+        }
+    }
+
+    /* ***************************************** */
+
+    uint32_t soSubmitRawRead(uint32_t first, uint32_t count, void *buf)
+    {
+        soProbe(SOPROBE_GREEN, 757, "%s(%" PRIu32 ", %" PRIu32 ", %p)\n",
+                __FUNCTION__, first, count, buf);
+
+        return soRawAioSubmit(first, count, buf, false, __FUNCTION__);
+    }
+
+    /* ***************************************** */
+
+    uint32_t soSubmitRawWrite(uint32_t first, uint32_t count, void *buf)
+    {
+        soProbe(SOPROBE_GREEN, 758, "%s(%" PRIu32 ", %" PRIu32 ", %p)\n",
+                __FUNCTION__, first, count, buf);
+
+        return soRawAioSubmit(first, count, buf, true, __FUNCTION__);
+    }
+
+    /* ***************************************** */
+
+    void soWaitRaw(uint32_t req)
+    {
+        soProbe(SOPROBE_GREEN, 759, "%s(%" PRIu32 ")\n", __FUNCTION__, req);
+
+        pthread_mutex_lock(&aioCR);
+        auto it = pending.find(req);
+        if (it == pending.end())
+        {
+            pthread_mutex_unlock(&aioCR);
+            throw SOException(EINVAL, __FUNCTION__);
+        }
+        SORawAioRequest *r = it->second;
+        soRawAioAwait(r);
+        pending.erase(it);
+        pthread_mutex_unlock(&aioCR);
+
+        int en = r->err;
+        delete r;
+        if (en != 0)
+            throw SOException(en, __FUNCTION__);
+    }
+
+    /* ***************************************** */
+
+    void soWaitRawAll(void)
+    {
+        soProbe(SOPROBE_GREEN, 760, "%s()\n", __FUNCTION__);
+
+        int en = 0;
+        pthread_mutex_lock(&aioCR);
+        for (auto & p : pending)
+        {
+            SORawAioRequest *r = p.second;
+            soRawAioAwait(r);
+            if (en == 0)
+                en = r->err;
+            delete r;
+        }
+        pending.clear();
+        pthread_mutex_unlock(&aioCR);
+
+        if (en != 0)
+            throw SOException(en, __FUNCTION__);
+    }
+
+    /* ***************************************** */
+
+    void soRawAioDrain()
+    {
+        pthread_mutex_lock(&aioCR);
+        while (inflight > 0)
+        {
+#ifdef SOFS18_HAVE_LIBURING
+            if (uring)
+            {
+                soRawAioReap(true);
+                continue;
+            }
+#endif
+            pthread_cond_wait(&completed, &aioCR);
+        }
+        pthread_mutex_unlock(&aioCR);
+    }
+
+    /* ***************************************** */
+
+    void soRawAioClose()
+    {
+        soRawAioDrain();
+
+        /* stop the workers */
+        pthread_mutex_lock(&aioCR);
+        stopping = true;
+        pthread_cond_broadcast(&queued);
+        pthread_mutex_unlock(&aioCR);
+
+        for (pthread_t t : workers)
+            pthread_join(t, NULL);
+        workers.clear();
+
+#ifdef SOFS18_HAVE_LIBURING
+        if (uring)
+        {
+            io_uring_queue_exit(&ring);
+            uring = false;
+        }
+#endif
+
+        /* results not waited for are lost */
+        for (auto & p : pending)
+            delete p.second;
+        pending.clear();
+
+        stopping = false;
+        started = false;
+    }
+
+    /* ***************************************** */
+};
@@ -0,0 +1,204 @@
+/**
+ *  \defgroup rawbench rawbench
+ *  \ingroup tools
+ *  \brief The \b sofs18 rawdisk benchmark program.
+ *
+ *  \details
+ *      It measures the throughput of block transfers on a storage device,
+ *      comparing the synchronous path (one request at a time)
+ *      with the asynchronous one (several requests in flight).<br/>
+ *      The block cache is disabled, so every transfer reaches the supporting file.<br/>
+ *      \b Warning: in write mode, the contents of the device are destroyed.
+ *
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <vector>
+
+#include "rawdisk.h"
+#include "core.h"
+
+/*
+ * print help message
+ */
+static void printUsage(char *cmd_name)
+{
+    printf("Sinopsis: %s [ OPTIONS ] supp-file\n"
+           "  OPTIONS:\n"
+           "  -s num     --- number of blocks per request (default: 8)\n"
+           "  -n num     --- number of requests (default: 4096)\n"
+           "  -q num     --- number of asynchronous requests in flight (default: 16)\n"
+           "  -r         --- random offsets (default: sequential)\n"
+           "  -w         --- write (default: read); destroys the device contents\n"
+           "  -h         --- print this help\n", cmd_name);
+}
+
+/* print error message */
+static void printError(int errcode, char *cmd_name)
+{
+    fprintf(stderr, "%s: error #%d - %s.\n", cmd_name, errcode,
+        strerror(errcode));
+}
+
+/* current time in seconds */
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* print the results of a pass */
+static void printResult(const char *name, uint32_t nreq, uint32_t size, double secs)
+{
+    double mib = (double)nreq * size * BlockSize / (1024 * 1024);
+    printf("%-6s %10.1f MiB/s %10.0f req/s %8.3f s\n", name, mib / secs, nreq / secs, secs);
+}
+
+/* The main function */
+
+using namespace sofs18;
+
+int main(int argc, char *argv[])
+{
+    /* process command line options */
+    int opt;
+    uint32_t size = 8;
+    uint32_t nreq = 4096;
+    uint32_t depth = 16;
+    bool random = false;
+    bool writing = false;
+
+    while ((opt = getopt(argc, argv, "s:n:q:rwh")) != -1)
+    {
+        switch (opt)
+        {
+            case 's':
+            {
+                size = atol(optarg);
+                break;
+            }
+            case 'n':
+            {
+                nreq = atol(optarg);
+                break;
+            }
+            case 'q':
+            {
+                depth = atol(optarg);
+                break;
+            }
+            case 'r':
+            {
+                random = true;
+                break;
+            }
+            case 'w':
+            {
+                writing = true;
+                break;
+            }
+            case 'h':
+            {
+                printUsage(basename(argv[0]));
+                return EXIT_SUCCESS;
+            }
+            default:
+            {
+                fprintf(stderr, "%s: Wrong option.\n", basename(argv[0]));
+                printUsage(basename(argv[0]));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    /* check existence of mandatory argument: storage device name */
+    if ((argc - optind) != 1)
+    {
+        fprintf(stderr, "%s: Wrong number of mandatory arguments.\n", basename(argv[0]));
+        printUsage(basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    if (size == 0 or nreq == 0 or depth == 0)
+    {
+        fprintf(stderr, "%s: Sizes must be positive.\n", basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        /* measure the device, not the block cache */
+        soRawCacheSetSize(0);
+
+        uint32_t nb;
+        soOpenRawDisk(argv[optind], &nb);
+        if (nb < size)
+        {
+            fprintf(stderr, "%s: Device too small.\n", basename(argv[0]));
+            soCloseRawDisk();
+            return EXIT_FAILURE;
+        }
+
+        /* offsets of the requests, the same for both passes */
+        uint32_t nslots = nb / size;
+        std::vector<uint32_t> first(nreq);
+        srand(1);
+        for (uint32_t i = 0; i < nreq; i++)
+            first[i] = (random ? (uint32_t)rand() % nslots : i % nslots) * size;
+
+        /* one buffer per request in flight */
+        std::vector<char> buf((size_t)depth * size * BlockSize, 'x');
+
+        printf("%s: %" PRIu32 " %s %s requests of %" PRIu32 " blocks, %" PRIu32 " in flight\n",
+                basename(argv[optind]), nreq, random ? "random" : "sequential",
+                writing ? "write" : "read", size, depth);
+
+        /* synchronous pass */
+        double t0 = now();
+        for (uint32_t i = 0; i < nreq; i++)
+        {
+            if (writing)
+                soWriteRawBlocks(first[i], size, buf.data());
+            else
+                soReadRawBlocks(first[i], size, buf.data());
+        }
+        if (writing)
+            soSyncRawDisk();
+        printResult("sync", nreq, size, now() - t0);
+
+        /* asynchronous pass, keeping up to depth requests in flight */
+        std::vector<uint32_t> req(depth);
+        t0 = now();
+        for (uint32_t i = 0; i < nreq; i++)
+        {
+            uint32_t k = i % depth;
+            if (i >= depth)
+                soWaitRaw(req[k]);
+            char *p = buf.data() + (size_t)k * size * BlockSize;
+            req[k] = writing ? soSubmitRawWrite(first[i], size, p)
+                             : soSubmitRawRead(first[i], size, p);
+        }
+        soWaitRawAll();
+        if (writing)
+            soSyncRawDisk();
+        printResult("async", nreq, size, now() - t0);
+
+        soCloseRawDisk();
+    }
+    catch (SOException & err)
+    {
+        printError(err.en, basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
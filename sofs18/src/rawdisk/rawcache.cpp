@@ -0,0 +1,394 @@
+/*
+ *  \brief A write-back LRU cache of disk blocks
+ *
+ *  Every block transferred through the rawdisk API goes through this cache,
+ *  so the upper layers (dal included) get it for free.
+ *  Dirty blocks are written back on eviction, on sync and on close.
+ */
+
+#include "rawdisk.h"
+#include "rawcache.h"
+
+#include "core.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* default number of cached blocks: 1 MiB worth of blocks */
+#define RAWCACHE_DEFAULT_SIZE ((1U << 20) / BlockSize)
+
+    /* a slot of the cache */
+    struct SORawCacheSlot
+    {
+        uint32_t bn;        ///< number of the cached block (NullReference if empty)
+        bool dirty;         ///< true if the block differs from the device
+        uint32_t prev;      ///< previous slot in LRU order (towards the MRU end)
+        uint32_t next;      ///< next slot in LRU order (towards the LRU end)
+    };
+
+    static uint32_t capacity = 0;           ///< number of slots; 0 means no cache
+    static bool capacity_set = false;       ///< true if set by soRawCacheSetSize
+    static char *pool = NULL;               ///< block buffers, one per slot
+    static std::vector<SORawCacheSlot> slot;
+    static std::unordered_map<uint32_t, uint32_t> index;    ///< block number to slot
+    static uint32_t mru = NullReference;    ///< most recently used slot
+    static uint32_t lru = NullReference;    ///< least recently used slot
+    static uint32_t ndirty = 0;             ///< number of dirty slots
+
+    static SORawCacheStats stats;
+
+    /* ***************************************** */
+
+    static inline char *soSlotData(uint32_t s)
+    {
+        return pool + (size_t)s * BlockSize;
+    }
+
+    /* remove slot s from the LRU list */
+    static void soUnlinkSlot(uint32_t s)
+    {
+        if (slot[s].prev != NullReference)
+            slot[slot[s].prev].next = slot[s].next;
+        else
+            mru = slot[s].next;
+
+        if (slot[s].next != NullReference)
+            slot[slot[s].next].prev = slot[s].prev;
+        else
+            lru = slot[s].prev;
+    }
+
+    /* put slot s at the MRU end of the LRU list */
+    static void soPushSlot(uint32_t s)
+    {
+        slot[s].prev = NullReference;
+        slot[s].next = mru;
+        if (mru != NullReference)
+            slot[mru].prev = s;
+        mru = s;
+        if (lru == NullReference)
+            lru = s;
+    }
+
+    /* get a slot for block n, evicting the LRU one if necessary */
+    static uint32_t soGrabSlot(uint32_t n)
+    {
+        uint32_t s = lru;
+
+        if (slot[s].bn != NullReference)
+        {
+            if (slot[s].dirty)
+            {
+                soDevWrite(slot[s].bn, 1, soSlotData(s), __FUNCTION__);
+                slot[s].dirty = false;
+                ndirty--;
+                stats.writebacks++;
+            }
+            index.erase(slot[s].bn);
+            stats.evictions++;
+        }
+
+        soUnlinkSlot(s);
+        slot[s].bn = n;
+        index[n] = s;
+        soPushSlot(s);
+        return s;
+    }
+
+    /* slot holding block n, or NullReference */
+    static inline uint32_t soFindSlot(uint32_t n)
+    {
+        auto it = index.find(n);
+        return (it == index.end()) ? NullReference : it->second;
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheOpen(uint32_t ntotal)
+    {
+        /* set capacity, if not done explicitly */
+        if (not capacity_set)
+        {
+            const char *env = getenv("SOFS18_RAWCACHE_BLOCKS");
+            capacity = (env != NULL) ? (uint32_t)atol(env) : RAWCACHE_DEFAULT_SIZE;
+        }
+
+        /* there is no point in having more slots than blocks */
+        uint32_t size = std::min(capacity, ntotal);
+        if (size == 0)
+            return;
+
+        pool = (char *)malloc((size_t)size * BlockSize);
+        if (pool == NULL)
+            throw SOException(ENOMEM, __FUNCTION__);
+
+        slot.resize(size);
+        index.reserve(size);
+        mru = lru = NullReference;
+        for (uint32_t s = 0; s < size; s++)
+        {
+            slot[s].bn = NullReference;
+            slot[s].dirty = false;
+            soPushSlot(s);
+        }
+        ndirty = 0;
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheClose()
+    {
+        if (pool == NULL)
+            return;
+
+        soRawCacheFlush();
+
+        free(pool);
+        pool = NULL;
+        slot.clear();
+        index.clear();
+        mru = lru = NullReference;
+    }
+
+    /* ***************************************** */
+
+    bool soRawCacheActive()
+    {
+        return pool != NULL;
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheRead(uint32_t n, void *buf)
+    {
+        uint32_t s = soFindSlot(n);
+        if (s != NullReference)
+        {
+            stats.hits++;
+            soUnlinkSlot(s);
+            soPushSlot(s);
+        }
+        else
+        {
+            stats.misses++;
+            s = soGrabSlot(n);
+            try
+            {
+                soDevRead(n, 1, soSlotData(s), __FUNCTION__);
+            }
+            catch (SOException & err)
+            {
+                index.erase(n);
+                slot[s].bn = NullReference;
+                throw;
+            }
+        }
+        memcpy(buf, soSlotData(s), BlockSize);
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheWrite(uint32_t n, const void *buf)
+    {
+        uint32_t s = soFindSlot(n);
+        if (s != NullReference)
+        {
+            stats.hits++;
+            soUnlinkSlot(s);
+            soPushSlot(s);
+        }
+        else
+        {
+            /* a whole block is written, so there is no need to read it first */
+            stats.misses++;
+            s = soGrabSlot(n);
+        }
+        memcpy(soSlotData(s), buf, BlockSize);
+        if (not slot[s].dirty)
+        {
+            slot[s].dirty = true;
+            ndirty++;
+        }
+    }
+
+    /* ***************************************** */
+
+    bool soRawCacheOverlay(uint32_t n, void *buf)
+    {
+        uint32_t s = soFindSlot(n);
+        if (s == NullReference)
+            return false;
+
+        memcpy(buf, soSlotData(s), BlockSize);
+        return true;
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheUpdate(uint32_t n, const void *buf)
+    {
+        uint32_t s = soFindSlot(n);
+        if (s == NullReference)
+            return;
+
+        memcpy(soSlotData(s), buf, BlockSize);
+        if (slot[s].dirty)
+        {
+            slot[s].dirty = false;
+            ndirty--;
+        }
+    }
+
+    /* ***************************************** */
+
+    static void soZeroSlot(uint32_t s)
+    {
+        memset(soSlotData(s), 0, BlockSize);
+        if (slot[s].dirty)
+        {
+            slot[s].dirty = false;
+            ndirty--;
+        }
+    }
+
+    void soRawCacheZero(uint32_t first, uint32_t count)
+    {
+        /* for large ranges, scanning the slots is cheaper than probing the index */
+        if (count > slot.size())
+        {
+            for (uint32_t s = 0; s < slot.size(); s++)
+            {
+                if (slot[s].bn != NullReference and slot[s].bn >= first 
+                        and slot[s].bn - first < count)
+                    soZeroSlot(s);
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t s = soFindSlot(first + i);
+                if (s != NullReference)
+                    soZeroSlot(s);
+            }
+        }
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheFlush()
+    {
+        if (ndirty == 0)
+            return;
+
+        /* collect dirty slots in block order, so adjacent blocks are coalesced */
+        std::vector<uint32_t> ds;
+        ds.reserve(ndirty);
+        for (uint32_t s = 0; s < slot.size(); s++)
+        {
+            if (slot[s].dirty)
+                ds.push_back(s);
+        }
+        std::sort(ds.begin(), ds.end(),
+                [](uint32_t a, uint32_t b) { return slot[a].bn < slot[b].bn; });
+
+        std::vector<uint32_t> bns(ds.size());
+        std::vector<struct iovec> iov(ds.size());
+        for (uint32_t i = 0; i < ds.size(); i++)
+        {
+            bns[i] = slot[ds[i]].bn;
+            iov[i].iov_base = soSlotData(ds[i]);
+            iov[i].iov_len = BlockSize;
+        }
+        soDevTransferV(bns.data(), bns.size(), iov.data(), true, __FUNCTION__);
+
+        for (uint32_t s : ds)
+            slot[s].dirty = false;
+        stats.writebacks += ds.size();
+        ndirty = 0;
+    }
+
+    /* ***************************************** */
+
+    /* write back slot s, if dirty */
+    static void soWriteBackSlot(uint32_t s)
+    {
+        if (slot[s].dirty)
+        {
+            soDevWrite(slot[s].bn, 1, soSlotData(s), __FUNCTION__);
+            slot[s].dirty = false;
+            ndirty--;
+            stats.writebacks++;
+        }
+    }
+
+    void soRawCacheWriteBack(uint32_t first, uint32_t count)
+    {
+        if (ndirty == 0)
+            return;
+
+        /* for large ranges, scanning the slots is cheaper than probing the index */
+        if (count > slot.size())
+        {
+            for (uint32_t s = 0; s < slot.size(); s++)
+            {
+                if (slot[s].bn != NullReference and slot[s].bn >= first 
+                        and slot[s].bn - first < count)
+                    soWriteBackSlot(s);
+            }
+        }
+        else
+        {
+            for (uint32_t i = 0; i < count; i++)
+            {
+                uint32_t s = soFindSlot(first + i);
+                if (s != NullReference)
+                    soWriteBackSlot(s);
+            }
+        }
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheSetSize(uint32_t nblocks)
+    {
+        soProbe(SOPROBE_GREEN, 795, "%s(%" PRIu32 ")\n", __FUNCTION__, nblocks);
+
+        capacity = nblocks;
+        capacity_set = true;
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheGetStats(SORawCacheStats * st)
+    {
+        if (st == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        *st = stats;
+        st->size = slot.size();
+        st->used = index.size();
+        st->dirty = ndirty;
+    }
+
+    /* ***************************************** */
+
+    void soRawCacheResetStats(void)
+    {
+        stats = SORawCacheStats();
+    }
+
+    /* ***************************************** */
+};
+
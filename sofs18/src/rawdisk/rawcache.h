@@ -0,0 +1,84 @@
+/**
+ * \file
+ * \brief Internal interfaces among the rawdisk device access, its block cache
+ *  and its asynchronous engine
+ *
+ *  \remarks Not to be used outside the rawdisk module.
+ */
+
+#ifndef __SOFS18_RAWCACHE__
+#define __SOFS18_RAWCACHE__
+
+#include <inttypes.h>
+#include <sys/uio.h>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    /* device level transfers, bypassing the block cache */
+
+    void soDevRead(uint32_t first, uint32_t count, void *buf, const char *funcname);
+
+    void soDevWrite(uint32_t first, uint32_t count, const void *buf, const char *funcname);
+
+    void soDevTransferV(const uint32_t *bns, uint32_t n, const struct iovec *iov, 
+            bool writing, const char *funcname);
+
+    /* file descriptor of the supporting file */
+    int soDevDescriptor();
+
+    /* true if the device is in mmap mode */
+    bool soDevMapped();
+
+    /* check that the range [first, first+count) lies within an open device */
+    void soDevCheckRange(uint32_t first, uint32_t count, const char *funcname);
+
+    /* ***************************************** */
+
+    /* block cache, sitting between the rawdisk API and the device */
+
+    /* allocate the cache buffers for a device with ntotal blocks */
+    void soRawCacheOpen(uint32_t ntotal);
+
+    /* write back all dirty blocks and release the cache buffers */
+    void soRawCacheClose();
+
+    /* true if block transfers must go through the cache */
+    bool soRawCacheActive();
+
+    /* read block n, going to the device on a miss */
+    void soRawCacheRead(uint32_t n, void *buf);
+
+    /* write block n into the cache, marking it dirty */
+    void soRawCacheWrite(uint32_t n, const void *buf);
+
+    /* copy the cached version of block n, if any, into buf */
+    bool soRawCacheOverlay(uint32_t n, void *buf);
+
+    /* refresh the cached version of block n, if any, after a write to the device */
+    void soRawCacheUpdate(uint32_t n, const void *buf);
+
+    /* clear the cached versions of the blocks within range [first, first+count), after they were zeroed on the device */
+    void soRawCacheZero(uint32_t first, uint32_t count);
+
+    /* write back all dirty blocks */
+    void soRawCacheFlush();
+
+    /* write back the dirty blocks within range [first, first+count) */
+    void soRawCacheWriteBack(uint32_t first, uint32_t count);
+
+    /* ***************************************** */
+
+    /* asynchronous engine */
+
+    /* wait for every request in flight, keeping their results for soWaitRaw */
+    void soRawAioDrain();
+
+    /* wait for every request in flight and release the engine resources */
+    void soRawAioClose();
+
+    /* ***************************************** */
+};
+
+#endif /* __SOFS18_RAWCACHE__ */
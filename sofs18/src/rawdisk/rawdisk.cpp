@@ -5,15 +5,22 @@
  */
 
 #include "rawdisk.h"
+#include "rawcache.h"
 
 #include "core.h"
 
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
 
 #include <iostream>
 
@@ -25,11 +32,191 @@ namespace sofs18
     static int fd = -1;     ///< File descriptor of the Linux file that simulates the disk
     static uint32_t ntotal; ///< Total number of blocks of the storage device
 
+    static char *map = NULL;    ///< Base address of the device mapping, if in mmap mode
+    static size_t maplen = 0;   ///< Length in bytes of the device mapping
+
+    /* range of blocks written through the mapping since the last sync */
+    static uint32_t dirty_first = NullReference;
+    static uint32_t dirty_last = 0;
+
+    /* ********************************************* */
+
+    /* byte offset of block n in the supporting file */
+    static inline off_t soRawOffset(uint32_t n)
+    {
+        return (off_t)n * BlockSize;
+    }
+
+    /* check that the range [first, first+count) lies within the device */
+    static void soCheckRawRange(uint32_t first, uint32_t count, const char *funcname)
+    {
+        if (count == 0 or first >= ntotal or count > ntotal - first)
+            throw SOException(EINVAL, funcname);
+    }
+
+    /* extend the range of blocks to be msync'ed */
+    static inline void soMarkMapDirty(uint32_t first, uint32_t count)
+    {
+        if (dirty_first == NullReference or first < dirty_first)
+            dirty_first = first;
+        if (first + count - 1 > dirty_last)
+            dirty_last = first + count - 1;
+    }
+
+    /* flush the dirty range of the mapping to the supporting file */
+    static void soSyncMap(const char *funcname)
+    {
+        if (dirty_first == NullReference)
+            return;
+
+        /* msync requires a page aligned start address */
+        size_t pgsz = sysconf(_SC_PAGESIZE);
+        size_t start = (soRawOffset(dirty_first) / pgsz) * pgsz;
+        size_t end = soRawOffset(dirty_last + 1);
+        if (msync(map + start, end - start, MS_SYNC) == -1)
+            throw SOException(errno, funcname);
+
+        dirty_first = NullReference;
+        dirty_last = 0;
+    }
+
+    /* ********************************************* */
+
+    void soDevRead(uint32_t first, uint32_t count, void *buf, const char *funcname)
+    {
+        if (map != NULL)
+        {
+            memcpy(buf, map + soRawOffset(first), (size_t)count * BlockSize);
+            return;
+        }
+
+        ssize_t len = (ssize_t)count * BlockSize;
+        ssize_t ret = pread(fd, buf, len, soRawOffset(first));
+        if (ret == -1)
+            throw SOException(errno, funcname);
+        if (ret != len)
+            throw SOException(EIO, funcname);
+    }
+
+    /* ********************************************* */
+
+    void soDevWrite(uint32_t first, uint32_t count, const void *buf, const char *funcname)
+    {
+        if (map != NULL)
+        {
+            memcpy(map + soRawOffset(first), buf, (size_t)count * BlockSize);
+            soMarkMapDirty(first, count);
+            return;
+        }
+
+        ssize_t len = (ssize_t)count * BlockSize;
+        ssize_t ret = pwrite(fd, buf, len, soRawOffset(first));
+        if (ret == -1)
+            throw SOException(errno, funcname);
+        if (ret != len)
+            throw SOException(EIO, funcname);
+    }
+
+    /* ********************************************* */
+
+    void soDevTransferV(const uint32_t *bns, uint32_t n, const struct iovec *iov, 
+            bool writing, const char *funcname)
+    {
+        /* in mmap mode, each block is a plain memcpy */
+        if (map != NULL)
+        {
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (writing)
+                    soDevWrite(bns[i], 1, iov[i].iov_base, funcname);
+                else
+                    soDevRead(bns[i], 1, iov[i].iov_base, funcname);
+            }
+            return;
+        }
+
+        /* transfer each run of adjacent block numbers with a single vectored call */
+        uint32_t i = 0;
+        while (i < n)
+        {
+            uint32_t cnt = 1;
+            while (i + cnt < n and cnt < IOV_MAX and bns[i + cnt] == bns[i + cnt - 1] + 1)
+                cnt++;
+
+            ssize_t len = (ssize_t)cnt * BlockSize;
+            ssize_t ret = writing ? pwritev(fd, iov + i, cnt, soRawOffset(bns[i]))
+                                  : preadv(fd, iov + i, cnt, soRawOffset(bns[i]));
+            if (ret == -1)
+                throw SOException(errno, funcname);
+            if (ret != len)
+                throw SOException(EIO, funcname);
+
+            i += cnt;
+        }
+    }
+
     /* ********************************************* */
 
-    void soOpenRawDisk(const char *devname, uint32_t * np)
+    int soDevDescriptor()
     {
-        soProbe(SOPROBE_GREEN, 791, "%s(\"%s\", %p)\n", __FUNCTION__, devname, np);
+        return fd;
+    }
+
+    /* ********************************************* */
+
+    bool soDevMapped()
+    {
+        return map != NULL;
+    }
+
+    /* ********************************************* */
+
+    void soDevCheckRange(uint32_t first, uint32_t count, const char *funcname)
+    {
+        if (fd == -1)
+            throw SOException(EBADF, funcname);
+
+        soCheckRawRange(first, count, funcname);
+    }
+
+    /* ********************************************* */
+
+    /* check arguments of a vectored transfer and carry it out */
+    static void soTransferRawBlockV(const uint32_t *bns, uint32_t n, const struct iovec *iov, 
+            bool writing, const char *funcname)
+    {
+        /* checking arguments */
+        if (bns == NULL or iov == NULL)
+            throw SOException(EINVAL, funcname);
+
+        if (fd == -1)
+            throw SOException(EBADF, funcname);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (bns[i] >= ntotal or iov[i].iov_base == NULL or iov[i].iov_len != BlockSize)
+                throw SOException(EINVAL, funcname);
+        }
+
+        /* transfer blocks data, keeping the block cache coherent */
+        soDevTransferV(bns, n, iov, writing, funcname);
+        if (soRawCacheActive())
+        {
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (writing)
+                    soRawCacheUpdate(bns[i], iov[i].iov_base);
+                else
+                    soRawCacheOverlay(bns[i], iov[i].iov_base);
+            }
+        }
+    }
+
+    /* ********************************************* */
+
+    void soOpenRawDisk(const char *devname, uint32_t * np, uint32_t flags)
+    {
+        soProbe(SOPROBE_GREEN, 791, "%s(\"%s\", %p, %#x)\n", __FUNCTION__, devname, np, flags);
 
         /* check devname */
         if (devname == NULL)
@@ -53,6 +240,33 @@ namespace sofs18
         /* get number of blocks of the device */
         ntotal = st.st_size / BlockSize;
 
+        /* the environment can also ask for mmap mode */
+        const char *env = getenv("SOFS18_RAWDISK_MMAP");
+        if (env != NULL and atoi(env) != 0)
+            flags |= RAWDISK_MMAP;
+
+        /* map the whole device, if requested */
+        if ((flags & RAWDISK_MMAP) and ntotal > 0)
+        {
+            maplen = soRawOffset(ntotal);
+            void *addr = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                int en = errno;
+                close(fd);
+                fd = -1;
+                ntotal = 0;
+                throw SOException(en, __FUNCTION__);
+            }
+            map = (char *)addr;
+            dirty_first = NullReference;
+            dirty_last = 0;
+        }
+
+        /* a mapped device does not need a block cache */
+        if (map == NULL)
+            soRawCacheOpen(ntotal);
+
         /* return number of blocks, if requested */
         if (np != NULL)
             *np = ntotal;
@@ -64,6 +278,21 @@ namespace sofs18
     {
         soProbe(SOPROBE_GREEN, 792, "%s()\n", __FUNCTION__);
 
+        /* let asynchronous requests complete */
+        soRawAioClose();
+
+        /* write back and release the block cache */
+        soRawCacheClose();
+
+        /* flush and release the mapping, if in mmap mode */
+        if (map != NULL)
+        {
+            soSyncMap(__FUNCTION__);
+            munmap(map, maplen);
+            map = NULL;
+            maplen = 0;
+        }
+
         /* close the device */
         close(fd);
         ntotal = 0;
@@ -72,9 +301,54 @@ namespace sofs18
 
     /* ********************************************* */
 
+    void soSyncRawDisk(void)
+    {
+        soProbe(SOPROBE_GREEN, 793, "%s()\n", __FUNCTION__);
+
+        if (fd == -1)
+            throw SOException(EBADF, __FUNCTION__);
+
+        /* asynchronous writes must reach the device before the sync */
+        soRawAioDrain();
+
+        if (map != NULL)
+            soSyncMap(__FUNCTION__);
+        else
+        {
+            soRawCacheFlush();
+            if (fdatasync(fd) == -1)
+                throw SOException(errno, __FUNCTION__);
+        }
+    }
+
+    /* ********************************************* */
+
+    void *soGetRawBlockPointer(uint32_t n)
+    {
+        soProbe(SOPROBE_GREEN, 794, "%s(%" PRIu32 ")\n", __FUNCTION__, n);
+
+        if (fd == -1)
+            throw SOException(EBADF, __FUNCTION__);
+
+        if (map == NULL)
+            throw SOException(ENOTSUP, __FUNCTION__);
+
+        if (n >= ntotal)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        /* the caller may write through the pointer */
+        soMarkMapDirty(n, 1);
+
+        return map + soRawOffset(n);
+    }
+
+    /* ********************************************* */
+
     void soReadRawBlock(uint32_t n, void *buf)
     {
-        soProbe(SOPROBE_GREEN, 751, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, n, buf);
+        soProbeHot(SOPROBE_GREEN, 751, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, n, buf);
+
+        SOStatTimer timer(SOSTAT_RAW_READ);
 
         /* checking arguments */
         if (buf == NULL)
@@ -87,18 +361,19 @@ namespace sofs18
             throw SOException(EBADF, __FUNCTION__);
 
         /* transfer block data */
-        if (lseek(fd, BlockSize * n, SEEK_SET) == -1)
-            throw SOException(errno, __FUNCTION__);
-
-        if (read(fd, buf, BlockSize) != BlockSize)
-            throw SOException(EIO, __FUNCTION__);
+        if (soRawCacheActive())
+            soRawCacheRead(n, buf);
+        else
+            soDevRead(n, 1, buf, __FUNCTION__);
     }
 
     /* ********************************************* */
 
     void soWriteRawBlock(uint32_t n, void *buf)
     {
-        soProbe(SOPROBE_GREEN, 752, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, n, buf);
+        soProbeHot(SOPROBE_GREEN, 752, "%s(%" PRIu32 ", %p)\n", __FUNCTION__, n, buf);
+
+        SOStatTimer timer(SOSTAT_RAW_WRITE);
 
         /* checking arguments */
         if (buf == NULL)
@@ -111,10 +386,137 @@ namespace sofs18
             throw SOException(EBADF, __FUNCTION__);
 
         /* transfer block data */
-        if (lseek(fd, BlockSize * n, SEEK_SET) == -1)
-            throw SOException(errno, __FUNCTION__);
-        if (write(fd, buf, BlockSize) != BlockSize)
-            throw SOException(EIO, __FUNCTION__);
+        if (soRawCacheActive())
+            soRawCacheWrite(n, buf);
+        else
+            soDevWrite(n, 1, buf, __FUNCTION__);
+    }
+
+    /* ********************************************* */
+
+    void soReadRawBlocks(uint32_t first, uint32_t count, void *buf)
+    {
+        soProbeHot(SOPROBE_GREEN, 753, "%s(%" PRIu32 ", %" PRIu32 ", %p)\n", 
+                __FUNCTION__, first, count, buf);
+
+        SOStatTimer timer(SOSTAT_RAW_READ, count);
+
+        /* checking arguments */
+        if (buf == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soCheckRawRange(first, count, __FUNCTION__);
+
+        if (fd == -1)
+            throw SOException(EBADF, __FUNCTION__);
+
+        /* transfer blocks data, cached blocks being the most recent version */
+        soDevRead(first, count, buf, __FUNCTION__);
+        if (soRawCacheActive())
+        {
+            for (uint32_t i = 0; i < count; i++)
+                soRawCacheOverlay(first + i, (char *)buf + (size_t)i * BlockSize);
+        }
+    }
+
+    /* ********************************************* */
+
+    void soWriteRawBlocks(uint32_t first, uint32_t count, void *buf)
+    {
+        soProbeHot(SOPROBE_GREEN, 754, "%s(%" PRIu32 ", %" PRIu32 ", %p)\n", 
+                __FUNCTION__, first, count, buf);
+
+        SOStatTimer timer(SOSTAT_RAW_WRITE, count);
+
+        /* checking arguments */
+        if (buf == NULL)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        soCheckRawRange(first, count, __FUNCTION__);
+
+        if (fd == -1)
+            throw SOException(EBADF, __FUNCTION__);
+
+        /* transfer blocks data, keeping cached copies up to date */
+        soDevWrite(first, count, buf, __FUNCTION__);
+        if (soRawCacheActive())
+        {
+            for (uint32_t i = 0; i < count; i++)
+                soRawCacheUpdate(first + i, (char *)buf + (size_t)i * BlockSize);
+        }
+    }
+
+    /* ********************************************* */
+
+    void soZeroRawBlocks(uint32_t first, uint32_t count)
+    {
+        soProbe(SOPROBE_GREEN, 761, "%s(%" PRIu32 ", %" PRIu32 ")\n", __FUNCTION__, first, count);
+
+        soCheckRawRange(first, count, __FUNCTION__);
+
+        if (fd == -1)
+            throw SOException(EBADF, __FUNCTION__);
+
+        if (count == 0)
+            return;
+
+        SOStatTimer timer(SOSTAT_RAW_WRITE, count);
+
+        if (map != NULL)
+        {
+            memset(map + soRawOffset(first), 0, (size_t)count * BlockSize);
+            soMarkMapDirty(first, count);
+        }
+
+        /* let the file system drop the range, or zero it, without transferring anything */
+        else if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    soRawOffset(first), (off_t)count * BlockSize) == -1 and
+                fallocate(fd, FALLOC_FL_ZERO_RANGE,
+                    soRawOffset(first), (off_t)count * BlockSize) == -1)
+        {
+            /* not supported: write zeros, in large chunks */
+            const uint32_t chunk = 256;
+            char *buf = (char *)calloc(chunk, BlockSize);
+            if (buf == NULL)
+                throw SOException(ENOMEM, __FUNCTION__);
+            try
+            {
+                for (uint32_t i = 0; i < count; i += chunk)
+                    soDevWrite(first + i, (count - i < chunk) ? count - i : chunk, buf, __FUNCTION__);
+            }
+            catch (SOException & err)
+            {
+                free(buf);
+                throw;
+            }
+            free(buf);
+        }
+
+        /* keep cached copies up to date */
+        if (soRawCacheActive())
+            soRawCacheZero(first, count);
+    }
+
+    /* ********************************************* */
+
+    void soReadRawBlockV(const uint32_t *bns, uint32_t n, const struct iovec *iov)
+    {
+        soProbeHot(SOPROBE_GREEN, 755, "%s(%p, %" PRIu32 ", %p)\n", __FUNCTION__, bns, n, iov);
+
+        SOStatTimer timer(SOSTAT_RAW_READ, n);
+
+        soTransferRawBlockV(bns, n, iov, false, __FUNCTION__);
+    }
+
+    /* ********************************************* */
+
+    void soWriteRawBlockV(const uint32_t *bns, uint32_t n, const struct iovec *iov)
+    {
+        soProbeHot(SOPROBE_GREEN, 756, "%s(%p, %" PRIu32 ", %p)\n", __FUNCTION__, bns, n, iov);
+
+        SOStatTimer timer(SOSTAT_RAW_WRITE, n);
+
+        soTransferRawBlockV(bns, n, iov, true, __FUNCTION__);
     }
 
 };
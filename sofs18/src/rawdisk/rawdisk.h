@@ -14,6 +14,7 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <sys/uio.h>
 
 namespace sofs18
 {
@@ -27,6 +28,11 @@ namespace sofs18
 
     /* ***************************************** */
 
+    /** \brief open flag: map the whole storage device into memory */
+#define RAWDISK_MMAP 0x01
+
+    /* ***************************************** */
+
     /**
      *  \brief Open the storage device.
      *
@@ -34,12 +40,17 @@ namespace sofs18
      *  It is supposed that no communication channel was previously established.
      *  The storage file must exist and have a size multiple of the block size.
      *
+     *  If \c RAWDISK_MMAP is given in \c flags, or the environment variable
+     *  \c SOFS18_RAWDISK_MMAP is set to a non-zero value,
+     *  the whole device is mapped into memory and block transfers become plain memory copies.
+     *
      *  \param [in] devname absolute path to the Linux file that simulates the storage device
      *  \param [out] np if not null,
      *      pointer to a location where the number of blocks of the device is to be stored
+     *  \param [in] flags bitwise OR of open flags (\c RAWDISK_MMAP)
      *
      */
-    void soOpenRawDisk(const char *devname, uint32_t * np = NULL);
+    void soOpenRawDisk(const char *devname, uint32_t * np = NULL, uint32_t flags = 0);
 
     /* ***************************************** */
 
@@ -47,11 +58,40 @@ namespace sofs18
      *  \brief Close the storage device.
      *
      *  The communication channel previously established with the storage device is closed.
+     *  Asynchronous requests in flight are completed, but their results are lost.
+     *  Dirty cached blocks, or, in mmap mode, blocks written since the last sync,
+     *  are flushed first.
      */
     void soCloseRawDisk(void);
 
     /* ***************************************** */
 
+    /**
+     *  \brief Flush written blocks to the storage device.
+     *
+     *  Asynchronous requests in flight are completed first.
+     *  In mmap mode, only the range of blocks written since the last sync is \c msync'ed;
+     *  otherwise, dirty cached blocks are written back and 
+     *  the supporting file is \c fdatasync'ed.
+     */
+    void soSyncRawDisk(void);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Get a pointer to a block of the storage device.
+     *
+     *  Only available in mmap mode (\c ENOTSUP is thrown otherwise).
+     *  The block is accessed in place, with no copy;
+     *  it is assumed to be modified and will be flushed on the next sync.
+     *
+     *  \param [in] n physical number of the block
+     *  \return pointer to the mapped block
+     */
+    void *soGetRawBlockPointer(uint32_t n);
+
+    /* ***************************************** */
+
     /**
      *  \brief Read a block of data from the storage device.
      *
@@ -70,6 +110,224 @@ namespace sofs18
      */
     void soWriteRawBlock(uint32_t n, void *buf);
 
+    /* ***************************************** */
+
+    /**
+     *  \brief Read a range of contiguous blocks from the storage device.
+     *
+     *  The whole range is transferred with a single positional read.
+     *
+     *  \param [in] first physical number of the first block to be read from
+     *  \param [in] count number of blocks to be read
+     *  \param [out] buf pointer to the buffer where the data must be read into;
+     *      it must be at least <tt>count * BlockSize</tt> bytes long
+     */
+    void soReadRawBlocks(uint32_t first, uint32_t count, void *buf);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Write a range of contiguous blocks into the storage device.
+     *
+     *  The whole range is transferred with a single positional write.
+     *
+     *  \param [in] first physical number of the first block to be written into
+     *  \param [in] count number of blocks to be written
+     *  \param [in] buf pointer to the buffer containing the data to be written from;
+     *      it must be at least <tt>count * BlockSize</tt> bytes long
+     */
+    void soWriteRawBlocks(uint32_t first, uint32_t count, void *buf);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Fill a range of contiguous blocks of the storage device with zeros.
+     *
+     *  The range is punched out of the supporting file, or zeroed in place,
+     *  with \c fallocate, so no data is transferred;
+     *  if neither is supported, zeros are written in large chunks.
+     *
+     *  \param [in] first physical number of the first block of the range
+     *  \param [in] count number of blocks of the range
+     */
+    void soZeroRawBlocks(uint32_t first, uint32_t count);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Read a set of blocks from the storage device into scattered buffers.
+     *
+     *  Block \c bns[i] is read into \c iov[i].iov_base.
+     *  Runs of adjacent block numbers are coalesced,
+     *  so each run costs a single vectored read.
+     *
+     *  \param [in] bns array with the physical numbers of the blocks to be read from
+     *  \param [in] n number of blocks to be read
+     *  \param [in] iov array of \c n buffer descriptors, 
+     *      each one with \c iov_len equal to \c BlockSize
+     */
+    void soReadRawBlockV(const uint32_t *bns, uint32_t n, const struct iovec *iov);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Write a set of blocks into the storage device from scattered buffers.
+     *
+     *  Block \c bns[i] is written from \c iov[i].iov_base.
+     *  Runs of adjacent block numbers are coalesced,
+     *  so each run costs a single vectored write.
+     *
+     *  \param [in] bns array with the physical numbers of the blocks to be written into
+     *  \param [in] n number of blocks to be written
+     *  \param [in] iov array of \c n buffer descriptors, 
+     *      each one with \c iov_len equal to \c BlockSize
+     */
+    void soWriteRawBlockV(const uint32_t *bns, uint32_t n, const struct iovec *iov);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Submit an asynchronous read of a range of contiguous blocks.
+     *
+     *  The transfer is carried out by io_uring, if available,
+     *  or by a small pool of worker threads otherwise
+     *  (the environment variable \c SOFS18_RAWAIO set to \c pool forces the latter,
+     *  whose size is taken from \c SOFS18_RAWAIO_THREADS, defaulting to 4).
+     *  Neither the buffer nor the blocks in the range may be accessed 
+     *  until the request is waited for.
+     *
+     *  \param [in] first physical number of the first block to be read from
+     *  \param [in] count number of blocks to be read
+     *  \param [out] buf pointer to the buffer where the data must be read into;
+     *      it must be at least <tt>count * BlockSize</tt> bytes long
+     *  \return the identifier of the request, to be given to \c soWaitRaw
+     */
+    uint32_t soSubmitRawRead(uint32_t first, uint32_t count, void *buf);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Submit an asynchronous write of a range of contiguous blocks.
+     *
+     *  Same rules as for \c soSubmitRawRead apply.
+     *
+     *  \param [in] first physical number of the first block to be written into
+     *  \param [in] count number of blocks to be written
+     *  \param [in] buf pointer to the buffer containing the data to be written from;
+     *      it must be at least <tt>count * BlockSize</tt> bytes long
+     *  \return the identifier of the request, to be given to \c soWaitRaw
+     */
+    uint32_t soSubmitRawWrite(uint32_t first, uint32_t count, void *buf);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Wait for the completion of an asynchronous request.
+     *
+     *  Every submitted request must be waited for exactly once.
+     *  If the transfer failed, its error is thrown.
+     *
+     *  \param [in] req identifier of the request, as returned on submission
+     */
+    void soWaitRaw(uint32_t req);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Wait for the completion of all pending asynchronous requests.
+     *
+     *  If some transfers failed, the error of one of them is thrown.
+     */
+    void soWaitRawAll(void);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Sequential writer of a range of contiguous blocks
+     *  \details Blocks are filled in one at a time, in the buffer returned by \c next,
+     *      and written a chunk at a time with asynchronous writes,
+     *      so the next chunk is built while the previous one is being written.
+     *      Two chunks are used, in turn.
+     *      If the writer goes out of scope before \c finish, pending writes are waited for
+     *      and their errors lost.
+     */
+    class SORawWriter
+    {
+    public:
+        /**
+         *  \param [in] first physical number of the first block of the range
+         *  \param [in] chunk number of blocks per write
+         */
+        SORawWriter(uint32_t first, uint32_t chunk = 256);
+        ~SORawWriter();
+
+        /** \brief Get the buffer of the next block, \c BlockSize bytes long */
+        void *next();
+
+        /** \brief Write what is left and wait for all writes; return the number of blocks written */
+        uint32_t finish();
+
+    private:
+        void submit();
+
+        uint32_t first;     ///< physical number of the first block of the current chunk
+        uint32_t chunk;     ///< blocks per chunk
+        uint32_t filled;    ///< blocks filled in the current chunk
+        uint32_t written;   ///< blocks of previous chunks
+        uint32_t cur;       ///< index of the current chunk buffer
+        char *buf[2];       ///< chunk buffers
+        uint32_t req[2];    ///< request writing each buffer, or 0
+    };
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Counters of the rawdisk block cache
+     */
+    struct SORawCacheStats
+    {
+        uint64_t hits;          ///< block transfers served by the cache
+        uint64_t misses;        ///< block transfers that needed a new cache slot
+        uint64_t evictions;     ///< blocks dropped from the cache to make room for others
+        uint64_t writebacks;    ///< dirty blocks written to the device
+        uint32_t size;          ///< number of cache slots
+        uint32_t used;          ///< number of slots holding a block
+        uint32_t dirty;         ///< number of slots holding a dirty block
+    };
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Set the number of blocks of the rawdisk block cache.
+     *
+     *  Single-block transfers go through a write-back LRU cache,
+     *  whose dirty blocks are written on eviction, on sync and on close.
+     *  The size takes effect on the next open of the device; 
+     *  \c 0 disables the cache.
+     *  If never called, the size is taken from the environment variable
+     *  \c SOFS18_RAWCACHE_BLOCKS, defaulting to 1 MiB worth of blocks.
+     *  The cache is never used in mmap mode.
+     *
+     *  \param [in] nblocks number of blocks the cache can hold
+     */
+    void soRawCacheSetSize(uint32_t nblocks);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Get the counters of the rawdisk block cache.
+     *
+     *  \param [out] st pointer to the location where counters are to be stored
+     */
+    void soRawCacheGetStats(SORawCacheStats * st);
+
+    /* ***************************************** */
+
+    /**
+     *  \brief Reset the counters of the rawdisk block cache.
+     */
+    void soRawCacheResetStats(void);
+
 /* ***************************************** */
 
 /** @} closing group rawdisk */
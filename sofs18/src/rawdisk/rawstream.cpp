@@ -0,0 +1,104 @@
+/*
+ *  \brief Sequential writer of a range of contiguous blocks
+ */
+
+#include "rawdisk.h"
+
+#include "core.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+namespace sofs18
+{
+    /* ***************************************** */
+
+    SORawWriter::SORawWriter(uint32_t first, uint32_t chunk)
+        : first(first), chunk(chunk), filled(0), written(0), cur(0)
+    {
+        if (chunk == 0)
+            throw SOException(EINVAL, __FUNCTION__);
+
+        req[0] = req[1] = 0;
+        buf[0] = (char *)malloc((size_t)chunk * BlockSize);
+        buf[1] = (char *)malloc((size_t)chunk * BlockSize);
+        if (buf[0] == NULL or buf[1] == NULL)
+        {
+            free(buf[0]);
+            free(buf[1]);
+            throw SOException(ENOMEM, __FUNCTION__);
+        }
+    }
+
+    /* ***************************************** */
+
+    SORawWriter::~SORawWriter()
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            if (req[i] != 0)
+            {
+                try
+                {
+                    soWaitRaw(req[i]);
+                }
+                catch (SOException & err)
+                {
+                    /* finish was not called; nobody to report it to */
+                }
+            }
+            free(buf[i]);
+        }
+    }
+
+    /* ***************************************** */
+
+    /* write the current chunk and switch to the other buffer, once its write is over */
+    void SORawWriter::submit()
+    {
+        req[cur] = soSubmitRawWrite(first, filled, buf[cur]);
+        first += filled;
+        written += filled;
+        filled = 0;
+
+        cur = 1 - cur;
+        if (req[cur] != 0)
+        {
+            uint32_t r = req[cur];
+            req[cur] = 0;
+            soWaitRaw(r);
+        }
+    }
+
+    /* ***************************************** */
+
+    void *SORawWriter::next()
+    {
+        if (filled == chunk)
+            submit();
+
+        return buf[cur] + (size_t)(filled++) * BlockSize;
+    }
+
+    /* ***************************************** */
+
+    uint32_t SORawWriter::finish()
+    {
+        if (filled > 0)
+            submit();
+
+        /* the chunk submitted before the last one was waited for by submit */
+        cur = 1 - cur;
+        if (req[cur] != 0)
+        {
+            uint32_t r = req[cur];
+            req[cur] = 0;
+            soWaitRaw(r);
+        }
+
+        return written;
+    }
+
+    /* ***************************************** */
+};
+
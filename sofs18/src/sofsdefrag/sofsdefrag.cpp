@@ -0,0 +1,475 @@
+/*
+ *  \brief Defragmenter of a SOFS18 disk
+ *
+ *  Every fragmented file is moved to a run of contiguous free data blocks,
+ *  the first one long enough, counting from the start of the data zone;
+ *  with compaction, unfragmented files are also moved, if such a run starts before them.
+ *  Data is copied first, then the references (d, i1 and i2), or the extents
+ *  of an extent-mapped file, are rewritten, and only then are the old data blocks freed.
+ *  Blocks of references and of trees of extents stay where they are.
+ *  The free block map takes over the free lists while the disk is open,
+ *  so the free block list table ends up rewritten in ascending order.
+ *  The disk must not be mounted: unless forced, one not flagged as properly unmounted,
+ *  as it is while mounted or after a crash, is only reported on.
+ */
+
+#include "core.h"
+#include "dal.h"
+#include "fileblocks.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <map>
+#include <vector>
+
+using namespace sofs18;
+
+/* ******************************************** */
+
+/* print help message */
+static void printUsage(char *cmd_name)
+{
+    printf("Sinopsis: %s [OPTIONS] supp-file\n"
+           "  OPTIONS:\n"
+           "  -c          --- compact: also move unfragmented files towards the start of the data zone\n"
+           "  -f          --- force: defragment a disk not flagged as properly unmounted\n"
+           "  -n          --- dry run: only report fragmentation and read throughput\n"
+           "  -q          --- set quiet mode (default: false)\n"
+           "  -d          --- set debug mode (default: false)\n"
+           "  -h          --- print this help\n", cmd_name);
+}
+
+/* print an INFO message */
+static void infoMsg(const char *fmt, ...)
+{
+    fprintf(stdout, "\e[00;34m");
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stdout, fmt, ap);
+    va_end(ap);
+    fprintf(stdout, "\e[0m");
+    fflush(stdout);
+}
+
+/* print a system error message */
+static void errnoMsg(int en, const char *msg)
+{
+    fprintf(stderr, "\e[00;31m%s: error #%d - %s\e[0m\n", msg, en,
+        strerror(en));
+}
+
+/* ******************************************** */
+
+/* the data blocks of every file in use, by inode number, in file block order */
+typedef std::map<uint32_t, std::vector<uint32_t> > SOFileMap;
+
+/* fragmentation figures */
+struct SOFragReport
+{
+    uint32_t files;         ///< inodes in use
+    uint32_t blocks;        ///< data blocks in use by them, blocks of references excluded
+    uint32_t extents;       ///< runs of contiguous data blocks
+    uint32_t fragmented;    ///< files with more than one extent
+    uint32_t free;          ///< free data blocks
+    uint32_t runs;          ///< runs of contiguous free data blocks
+    uint32_t longest;       ///< longest of those runs
+};
+
+/* ******************************************** */
+
+/* get the data blocks of every file in use; holes are left out */
+static void getFileMap(SOFileMap & files)
+{
+    SOSuperBlock *sb = soSBGetPointer();
+
+    files.clear();
+    for (uint32_t in = 0; in < sb->itotal; in++)
+    {
+        int ih = soITOpenInode(in);
+        SOInode *ip = soITGetInodePointer(ih);
+        if ((ip->mode & INODE_FREE) == 0)
+        {
+            std::vector<uint32_t> & bns = files[in];
+            uint32_t nfb = (ip->size + BlockSize - 1) / BlockSize;
+            std::vector<uint32_t> map(nfb);
+            if (nfb > 0)
+                soGetFileBlocks(ih, 0, nfb, map.data());
+            for (uint32_t bn : map)
+            {
+                if (bn != NullReference)
+                    bns.push_back(bn);
+            }
+        }
+        soITCloseInode(ih);
+    }
+}
+
+/* ******************************************** */
+
+/* number of runs of contiguous blocks */
+static uint32_t countExtents(const std::vector<uint32_t> & bns)
+{
+    uint32_t ext = 0;
+    for (uint32_t i = 0; i < bns.size(); i++)
+        if (i == 0 or bns[i] != bns[i - 1] + 1)
+            ext++;
+    return ext;
+}
+
+/* ******************************************** */
+
+static void getFragReport(const SOFileMap & files, SOFragReport & rep)
+{
+    memset(&rep, 0, sizeof(rep));
+
+    for (auto & f : files)
+    {
+        uint32_t ext = countExtents(f.second);
+        rep.files++;
+        rep.blocks += f.second.size();
+        rep.extents += ext;
+        if (ext > 1)
+            rep.fragmented++;
+    }
+
+    uint32_t len = 0;
+    for (uint32_t bn = 0; bn < soSBGetPointer()->dz_total; bn++)
+    {
+        if (soFBMIsFree(bn))
+        {
+            rep.free++;
+            if (len++ == 0)
+                rep.runs++;
+            if (len > rep.longest)
+                rep.longest = len;
+        }
+        else
+            len = 0;
+    }
+}
+
+/* ******************************************** */
+
+static void printFragReport(const char *when, const SOFragReport & rep)
+{
+    infoMsg("%s: %u files, %u data blocks in %u extents (%.2f per file), %u files fragmented;\n"
+            "    %u free blocks in %u runs, longest run of %u\n",
+            when, rep.files, rep.blocks, rep.extents,
+            (rep.files > 0) ? (double)rep.extents / rep.files : 0.0, rep.fragmented,
+            rep.free, rep.runs, rep.longest);
+}
+
+/* ******************************************** */
+
+/*
+ * read every file in file block order, straight from the device with the page cache dropped,
+ * a run of contiguous blocks per read, as a file system with readahead would
+ */
+static void measureRead(const char *devname, const SOFileMap & files, const char *when)
+{
+    int fd = open(devname, O_RDONLY);
+    if (fd == -1)
+        throw SOException(errno, __FUNCTION__);
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    uint64_t base = soSBGetPointer()->dz_start;
+    std::vector<char> buf;
+    uint64_t bytes = 0;
+    uint32_t reads = 0;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (auto & f : files)
+    {
+        const std::vector<uint32_t> & bns = f.second;
+        for (uint32_t i = 0; i < bns.size(); )
+        {
+            uint32_t n = 1;
+            while (i + n < bns.size() and bns[i + n] == bns[i] + n)
+                n++;
+            buf.resize((size_t)n * BlockSize);
+            if (pread(fd, buf.data(), buf.size(), (base + bns[i]) * BlockSize) != (ssize_t)buf.size())
+            {
+                close(fd);
+                throw SOException(EIO, __FUNCTION__);
+            }
+            bytes += buf.size();
+            reads++;
+            i += n;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    close(fd);
+
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    infoMsg("%s: sequential read of %.1f KiB in %u reads, %.3f ms (%.1f MiB/s)\n",
+            when, bytes / 1024.0, reads, secs * 1e3,
+            (secs > 0) ? bytes / secs / (1024 * 1024) : 0.0);
+}
+
+/* ******************************************** */
+
+/* blocks of references read while rewriting the references of a file */
+typedef std::map<uint32_t, std::vector<uint32_t> > SORefBlocks;
+
+static uint32_t *getRefBlock(SORefBlocks & cache, uint32_t bn)
+{
+    auto it = cache.find(bn);
+    if (it == cache.end())
+    {
+        it = cache.emplace(bn, std::vector<uint32_t>(ReferencesPerBlock)).first;
+        soReadDataBlock(bn, it->second.data());
+    }
+    return it->second.data();
+}
+
+/* ******************************************** */
+
+/* make file block fbn of the inode reference data block bn */
+static void setFileBlock(SOInode * ip, SORefBlocks & cache, uint32_t fbn, uint32_t bn)
+{
+    uint32_t RPB = ReferencesPerBlock;
+
+    if (fbn < N_DIRECT)
+    {
+        ip->d[fbn] = bn;
+        return;
+    }
+
+    uint32_t afbn = fbn - N_DIRECT;
+    uint32_t *ref;
+    if (afbn < N_INDIRECT * RPB)
+        ref = getRefBlock(cache, ip->i1[afbn / RPB]);
+    else
+    {
+        afbn -= N_INDIRECT * RPB;
+        uint32_t *ref2 = getRefBlock(cache, ip->i2[afbn / (RPB * RPB)]);
+        ref = getRefBlock(cache, ref2[(afbn / RPB) % RPB]);
+    }
+    ref[afbn % RPB] = bn;
+}
+
+/* ******************************************** */
+
+/* move the data blocks of a file to a run starting at block first */
+static void moveFile(uint32_t in, std::vector<uint32_t> & bns, uint32_t first)
+{
+    uint32_t n = bns.size();
+    std::vector<uint32_t> fresh(n);
+    if (soFBMTake(first, n, fresh.data()) != n or fresh[n - 1] != first + n - 1)
+        throw SOException(ENOSPC, __FUNCTION__);
+
+    /* copy the data */
+    char buf[BlockSize];
+    for (uint32_t i = 0; i < n; i++)
+    {
+        soReadDataBlock(bns[i], buf);
+        soWriteDataBlock(fresh[i], buf);
+    }
+
+    /* rewrite the references; holes keep no data block */
+    int ih = soITOpenInode(in);
+    if (soIsExtentInode(ih))
+        soExtentRelocate(ih, first);
+    else
+    {
+        SOInode *ip = soITGetInodePointer(ih);
+        SORefBlocks cache;
+        uint32_t nfb = (ip->size + BlockSize - 1) / BlockSize;
+        std::vector<uint32_t> map(nfb);
+        if (nfb > 0)
+            soGetFileBlocks(ih, 0, nfb, map.data());
+        for (uint32_t fbn = 0, i = 0; fbn < nfb and i < n; fbn++)
+        {
+            if (map[fbn] == NullReference)
+                continue;
+            setFileBlock(ip, cache, fbn, fresh[i++]);
+        }
+        for (auto & rb : cache)
+            soWriteDataBlock(rb.first, rb.second.data());
+        soITSaveInode(ih);
+    }
+    soITCloseInode(ih);
+
+    /* only now free the old blocks */
+    soFBMGive(bns.data(), n);
+    bns.swap(fresh);
+}
+
+/* ******************************************** */
+
+/* move every file that gains from it; returns the number of files moved */
+static uint32_t defragment(SOFileMap & files, bool compact, uint32_t & skipped)
+{
+    uint32_t moved = 0;
+    skipped = 0;
+    for (auto & f : files)
+    {
+        std::vector<uint32_t> & bns = f.second;
+        if (bns.empty())
+            continue;
+
+        uint32_t ext = countExtents(bns);
+        if (ext == 1 and not compact)
+            continue;
+
+        uint32_t runlen;
+        uint32_t first = soFBMFindRun(0, bns.size(), &runlen);
+        if (first == NullReference or runlen < bns.size())
+        {
+            if (ext > 1)
+                skipped++;
+            continue;
+        }
+        if (ext == 1 and first > bns[0])
+            continue;
+
+        moveFile(f.first, bns, first);
+        moved++;
+    }
+    return moved;
+}
+
+/* ******************************************** */
+
+/* The main function */
+int main(int argc, char *argv[])
+{
+    bool compact = false;   /* compact mode */
+    bool dryrun = false;    /* dry run mode */
+    bool force = false;     /* force mode */
+    bool quiet = false;     /* quiet mode */
+    bool debug = false;     /* debug mode */
+
+    /* process command line options */
+    int opt;
+    while ((opt = getopt(argc, argv, "cfnqdh")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c':    /* compact mode */
+            {
+                compact = true;
+                break;
+            }
+            case 'f':    /* force mode */
+            {
+                force = true;
+                break;
+            }
+            case 'n':    /* dry run mode */
+            {
+                dryrun = true;
+                break;
+            }
+            case 'q':    /* quiet mode */
+            {
+                quiet = true;
+                break;
+            }
+            case 'd':    /* debug mode */
+            {
+                debug = true;
+                break;
+            }
+            case 'h':    /* help mode */
+            {
+                printUsage(basename(argv[0]));
+                return EXIT_SUCCESS;
+            }
+            default:
+            {
+                fprintf(stderr, "%s: Wrong option.\n", basename(argv[0]));
+                printUsage(basename(argv[0]));
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    /* in debug mode can not be quiet */
+    if (debug) quiet = false;
+
+    /* check existence of mandatory argument: storage device name */
+    if ((argc - optind) != 1)
+    {
+        fprintf(stderr, "%s: Wrong number of mandatory arguments.\n", basename(argv[0]));
+        printUsage(basename(argv[0]));
+        return EXIT_FAILURE;
+    }
+    const char *devname = argv[optind];
+
+    /* set probing system on */
+    if (debug)
+        soProbeOpen(stdout, 0, 1000);
+    else
+    {
+        soProbeOpen(stdout, 0, 0);
+        soProbeRemoveIDs(0, 0);
+    }
+
+    try
+    {
+        soOpenDisk(devname);
+
+        /* references must not be moved under a mount; the disk is not closed,
+         * as closing flags it as properly unmounted */
+        if (not dryrun and not force and soSBGetPointer()->mntstat == 0)
+        {
+            fprintf(stderr, "%s: %s is mounted or was not properly unmounted (use -f to force)\n",
+                    basename(argv[0]), devname);
+            return EXIT_FAILURE;
+        }
+
+        SOFileMap files;
+        getFileMap(files);
+
+        SOFragReport before;
+        getFragReport(files, before);
+        if (!quiet)
+        {
+            printFragReport("before", before);
+            measureRead(devname, files, "before");
+        }
+
+        if (not dryrun)
+        {
+            /* the free block map owns the free lists from here on;
+             * the report only reads the map, so a dry run leaves the lists alone */
+            soFBMAcquire();
+
+            uint32_t skipped;
+            uint32_t moved = defragment(files, compact, skipped);
+            soSyncDisk();
+
+            if (!quiet)
+            {
+                infoMsg("%u files moved, %u fragmented files left for lack of a long enough free run\n",
+                        moved, skipped);
+                SOFragReport after;
+                getFragReport(files, after);
+                printFragReport("after", after);
+                measureRead(devname, files, "after");
+            }
+        }
+
+        soCloseDisk();
+    }
+    catch (SOException & err)
+    {
+        errnoMsg(err.en, err.what());
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -27,11 +27,17 @@
 #include <pthread.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <fuse.h>
 #include <fuse/fuse.h>
 
 #include "core.h"
 #include "syscalls.h"
+#include "dal.h"
+#include "freelists.h"
+#include "fileblocks.h"
 
 using namespace sofs18;
 
@@ -47,6 +53,46 @@ static pthread_mutex_t accessCR = PTHREAD_MUTEX_INITIALIZER;    /* locking flag
 /* SOFS18 support filename (should be the absolute path) */
 static char *sofs_supp_file = NULL;
 
+/* ***************************************************** */
+
+/*
+ *  A read-only virtual file, not listed in the root directory,
+ *  exposing the operation statistics (see stats.h).
+ *  The report is taken when the file is opened and kept until it is released.
+ */
+static const char *sofs_stats_path = "/.sofs_stats";
+
+/* a snapshot of the statistics report */
+struct SOStatsSnapshot
+{
+    size_t len;
+    char *data;
+};
+
+static bool isStatsFile(const char *path)
+{
+    return strcmp(path, sofs_stats_path) == 0;
+}
+
+/* take a snapshot of the statistics report; to be called with accessCR locked */
+static SOStatsSnapshot *takeStatsSnapshot(void)
+{
+    SOStatsSnapshot *snap = (SOStatsSnapshot *) malloc(sizeof(SOStatsSnapshot));
+    if (snap == NULL)
+        return NULL;
+    size_t n = soStatFormat(NULL, 0);
+    snap->data = (char *) malloc(n + 1);
+    if (snap->data == NULL)
+    {
+        free(snap);
+        return NULL;
+    }
+    snap->len = soStatFormat(snap->data, n + 1);
+    if (snap->len > n)
+        snap->len = n;
+    return snap;
+}
+
 
 /* ***************************************************** */
 
@@ -68,6 +114,16 @@ fprintf(stderr, "=============================================\n");
     int stat;
     if ((stat = soOpenFileSystem(sofs_supp_file)) != 0)
         return NULL;
+
+    /* keep the reference caches away from empty and full in background */
+    try
+    {
+        soRefillerStart(&accessCR);
+    }
+    catch (SOException & err)
+    {
+        fprintf(stderr, "%s: no background refill - %s\n", __FUNCTION__, strerror(err.en));
+    }
     return sofs_supp_file;
 }
 
@@ -87,6 +143,9 @@ static void sofs_unmount(void *path)
 fprintf(stderr, "=============================================\n");
     soProbe(SOPROBE_GREEN, 11, "%s(\"%s\")\n", __FUNCTION__, (char *)path);
 
+    /* the refill thread takes accessCR, so it must be stopped first */
+    soRefillerStop();
+
     pthread_mutex_lock(&accessCR);
     soCloseFileSystem();
     pthread_mutex_unlock(&accessCR);
@@ -114,7 +173,20 @@ fprintf(stderr, "=============================================\n");
     soProbe(SOPROBE_GREEN, 11, "%s(\"%s\", %p)\n", __FUNCTION__, path, st);
 
     pthread_mutex_lock(&accessCR);
-    int ret = soStat(path, st);
+    int ret;
+    if (isStatsFile(path))
+    {
+        memset(st, 0, sizeof(struct stat));
+        st->st_mode = S_IFREG | 0444;
+        st->st_nlink = 1;
+        st->st_uid = getuid();
+        st->st_gid = getgid();
+        st->st_size = soStatFormat(NULL, 0);
+        st->st_atime = st->st_mtime = st->st_ctime = time(NULL);
+        ret = 0;
+    }
+    else
+        ret = soStat(path, st);
     pthread_mutex_unlock(&accessCR);
     return ret;
 }
@@ -138,6 +210,9 @@ static int sofs_access(const char *path, int opRequested)
 fprintf(stderr, "=============================================\n");
     soProbe(SOPROBE_GREEN, 11, "%s(\"%s\", %x)\n", __FUNCTION__, path, opRequested);
 
+    if (isStatsFile(path))
+        return (opRequested & (W_OK | X_OK)) ? -EACCES : 0;
+
     pthread_mutex_lock(&accessCR);
     int ret = soAccess(path, opRequested);
     pthread_mutex_unlock(&accessCR);
@@ -355,6 +430,38 @@ fprintf(stderr, "=============================================\n");
 
 /* ***************************************************** */
 
+/* \brief Manipulate the space allocated to a file.
+ *
+ *  Similar to system call fallocate (man 2 fallocate).
+ *
+ *  Only hole punching is supported: the file blocks within the range are freed
+ *  and the size of the file is kept.
+ *
+ *  \param path path to the file
+ *  \param mode it must be <tt>FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE</tt>
+ *  \param pos starting [byte] position of the range
+ *  \param len number of bytes of the range
+ *  \param fi pointer to fuse file information
+ *
+ *  \return 0, on success, and a negative value, on error
+ */
+static int sofs_fallocate(const char *path, int mode, off_t pos, off_t len, struct fuse_file_info *fi)
+{
+fprintf(stderr, "=============================================\n");
+    soProbe(SOPROBE_GREEN, 11, "%s(\"%s\", %d, %" PRId64 ", %" PRId64 ", %p)\n", __FUNCTION__, path, 
+                mode, (int64_t) pos, (int64_t) len, fi);
+
+    if (mode != (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE))
+        return -EOPNOTSUPP;
+
+    pthread_mutex_lock(&accessCR);
+    int ret = soPunchHole(path, pos, len);
+    pthread_mutex_unlock(&accessCR);
+    return ret;
+}
+
+/* ***************************************************** */
+
 /* \brief Change the access and/or modification times of a file.
  *
  *  Similar to system call utime (man 2 utime).
@@ -428,6 +535,20 @@ static int sofs_open(const char *path, struct fuse_file_info *fi)
 fprintf(stderr, "=============================================\n");
     soProbe(SOPROBE_GREEN, 11, "%s(\"%s\", %p)\n", __FUNCTION__, path, fi);
 
+    if (isStatsFile(path))
+    {
+        if ((fi->flags & O_ACCMODE) != O_RDONLY)
+            return -EACCES;
+        pthread_mutex_lock(&accessCR);
+        SOStatsSnapshot *snap = takeStatsSnapshot();
+        pthread_mutex_unlock(&accessCR);
+        if (snap == NULL)
+            return -ENOMEM;
+        fi->fh = (uint64_t) (uintptr_t) snap;
+        fi->direct_io = 1;
+        return 0;
+    }
+
     pthread_mutex_lock(&accessCR);
     int ret = soOpen(path, fi->flags);
     fi->fh = (uint64_t) 0;
@@ -464,6 +585,20 @@ fprintf(stderr, "=============================================\n");
     soProbe(SOPROBE_GREEN, 11, "%s(\"%s\", %p, %" PRIu32 ", %" PRId32 ", %p)\n", __FUNCTION__, path,
                  buff, (uint32_t) count, (int32_t) pos, fi);
 
+    if (isStatsFile(path))
+    {
+        SOStatsSnapshot *snap = (SOStatsSnapshot *) (uintptr_t) fi->fh;
+        if (snap == NULL or pos < 0)
+            return -EINVAL;
+        if ((size_t) pos >= snap->len)
+            return 0;
+        size_t n = snap->len - pos;
+        if (n > count)
+            n = count;
+        memcpy(buff, snap->data + pos, n);
+        return n;
+    }
+
     pthread_mutex_lock(&accessCR);
     int n = soRead(path, buff, (uint32_t) count, (int32_t) pos);
     pthread_mutex_unlock(&accessCR);
@@ -573,6 +708,18 @@ static int sofs_release(const char *path, struct fuse_file_info *fi)
 fprintf(stderr, "=============================================\n");
     soProbe(SOPROBE_GREEN, 11, "%s(\"%s\", %p)\n", __FUNCTION__, path, fi);
 
+    if (isStatsFile(path))
+    {
+        SOStatsSnapshot *snap = (SOStatsSnapshot *) (uintptr_t) fi->fh;
+        if (snap != NULL)
+        {
+            free(snap->data);
+            free(snap);
+        }
+        fi->fh = (uint64_t) 0;
+        return 0;
+    }
+
     pthread_mutex_lock(&accessCR);
     int ret = soClose(path);
     pthread_mutex_unlock(&accessCR);
@@ -933,7 +1080,11 @@ const struct fuse_operations sofs18_fuse_operations = {
     flag_utime_omit_ok:0,
     flag_reserved:0,
     ioctl:NULL,
-    poll:NULL
+    poll:NULL,
+    write_buf:NULL,
+    read_buf:NULL,
+    flock:NULL,
+    fallocate:sofs_fallocate
 };
 
 /* The main function */
@@ -956,6 +1107,14 @@ static void printUsage(char *cmd_name)
            "  -w          --- set bin configuration to 0-0 (default)\n"
            "  -a num-num  --- add range of IDs to bin configuration\n"
            "  -r num-num  --- remove range of IDs from bin configuration\n"
+           "  -c num,num  --- capacity of the inode and block reference pools (default: 1024,1024)\n"
+           "  -m num,num  --- size of the per-thread inode and block magazines (default: 0,0)\n"
+           "  -l policy   --- data block allocation policy, fifo or near (default: fifo)\n"
+           "  -u policy   --- reuse of freed data blocks, fifo, lifo or lifo,distance (default: fifo)\n"
+           "  -D num      --- delayed allocation, with up to num file blocks in memory (default: 0, off)\n"
+           "  -e num      --- sequential readahead, up to num file blocks ahead (default: 0, off)\n"
+           "  -W num,num  --- low and high watermarks of the reference caches, in % (default: 25,75)\n"
+           "  -x          --- map new regular files with extents (default: off)\n"
            "  -h          --- print this help\n", cmd_name);
 }
 
@@ -968,7 +1127,7 @@ int main(int argc, char *argv[])
 
     /* process command line options */
     int opt;
-    while ((opt = getopt(argc, argv, "P:p:A:R:bwa:r:dh")) != -1)
+    while ((opt = getopt(argc, argv, "P:p:A:R:bwa:r:c:m:l:u:W:D:e:xdh")) != -1)
     {
         switch (opt)
         {
@@ -1078,6 +1237,111 @@ int main(int argc, char *argv[])
                 soBinRemoveIDs(lower, upper);
                 break;
             }
+            case 'c':   /* capacity of the reference pools */
+            {
+                uint32_t inodes, blocks;
+                uint32_t cnt = 0;
+                if ( (sscanf(optarg, "%u,%u %n", &inodes, &blocks, &cnt) != 2) 
+                        or (cnt != strlen(optarg)) )
+                {
+                    fprintf(stderr, "%s: Bad argument to 'c' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                soRPSetCapacity(inodes, blocks);
+                break;
+            }
+            case 'm':   /* size of the allocation magazines */
+            {
+                uint32_t inodes, blocks;
+                uint32_t cnt = 0;
+                if ( (sscanf(optarg, "%u,%u %n", &inodes, &blocks, &cnt) != 2) 
+                        or (cnt != strlen(optarg)) )
+                {
+                    fprintf(stderr, "%s: Bad argument to 'm' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                soMagazineSetSize(inodes, blocks);
+                break;
+            }
+            case 'l':   /* data block allocation policy */
+            {
+                if (strcmp(optarg, "fifo") == 0)
+                    soSetAllocPolicy(SOALLOC_FIFO);
+                else if (strcmp(optarg, "near") == 0)
+                    soSetAllocPolicy(SOALLOC_NEAR);
+                else
+                {
+                    fprintf(stderr, "%s: Bad argument to 'l' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'u':   /* reuse of freed data blocks */
+            {
+                uint32_t distance = 0;
+                uint32_t cnt = 0;
+                if (strcmp(optarg, "fifo") == 0)
+                    soSetRecyclePolicy(SORECYCLE_FIFO, 0);
+                else if ( (strcmp(optarg, "lifo") == 0) or
+                        ( (sscanf(optarg, "lifo,%u %n", &distance, &cnt) == 1) and (cnt == strlen(optarg))
+                          and (distance < BLOCK_REFERENCE_CACHE_SIZE) ) )
+                    soSetRecyclePolicy(SORECYCLE_LIFO, distance);
+                else
+                {
+                    fprintf(stderr, "%s: Bad argument to 'u' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                break;
+            }
+            case 'D':   /* delayed allocation */
+            {
+                uint32_t blocks;
+                uint32_t cnt = 0;
+                if ( (sscanf(optarg, "%u %n", &blocks, &cnt) != 1) or (cnt != strlen(optarg)) )
+                {
+                    fprintf(stderr, "%s: Bad argument to 'D' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                soDelallocSetLimit(blocks);
+                break;
+            }
+            case 'e':   /* readahead */
+            {
+                uint32_t blocks;
+                uint32_t cnt = 0;
+                if ( (sscanf(optarg, "%u %n", &blocks, &cnt) != 1) or (cnt != strlen(optarg)) )
+                {
+                    fprintf(stderr, "%s: Bad argument to 'e' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                soReadaheadSetMax(blocks);
+                break;
+            }
+            case 'W':   /* watermarks of the reference caches */
+            {
+                uint32_t low, high;
+                uint32_t cnt = 0;
+                if ( (sscanf(optarg, "%u,%u %n", &low, &high, &cnt) != 2) 
+                        or (cnt != strlen(optarg)) or (low > high) or (high > 100) )
+                {
+                    fprintf(stderr, "%s: Bad argument to 'W' option.\n", basename(argv[0]));
+                    printUsage(basename(argv[0]));
+                    return EXIT_FAILURE;
+                }
+                soRefillSetWatermarks(low, high);
+                break;
+            }
+            case 'x':   /* extent-mapped inodes */
+            {
+                soExtentsSetEnabled(true);
+                break;
+            }
             case 'd':          /* debugging mode */
             {
                 debug_mode = true;
@@ -10,6 +10,8 @@ namespace sofs18
 
     int soLink(const char *path, const char *newPath)
     {
+        SOStatTimer timer(SOSTAT_SYS_LINK);
+
         if (soBinSelected(104))
             return bin::soLink(path, newPath);
         else
@@ -9,6 +9,8 @@ namespace sofs18
 {
     int soMkdir(const char *path, mode_t mode)
     {
+        SOStatTimer timer(SOSTAT_SYS_MKDIR);
+
         if (soBinSelected(102))
             return bin::soMkdir(path, mode);
         else
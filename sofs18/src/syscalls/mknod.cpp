@@ -9,6 +9,8 @@ namespace sofs18
 {
     int soMknod(const char *path, mode_t mode)
     {
+        SOStatTimer timer(SOSTAT_SYS_MKNOD);
+
         if (soBinSelected(101))
             return bin::soMknod(path, mode);
         else
@@ -0,0 +1,19 @@
+/*
+ *  \author Artur Pereira - 2016-2018
+ */
+
+#include "work_syscalls.h"
+#include "core.h"
+
+namespace sofs18
+{
+    int soPunchHole(const char *path, off_t pos, off_t len)
+    {
+        SOStatTimer timer(SOSTAT_SYS_PUNCH, (uint32_t)len);
+
+        /* there is no binary version */
+        return work::soPunchHole(path, pos, len);
+    }
+
+};
+
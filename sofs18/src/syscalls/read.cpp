@@ -3,17 +3,19 @@
  */
 
 #include "bin_syscalls.h"
+#include "work_syscalls.h"
 #include "core.h"
 
 namespace sofs18
 {
     int soRead(const char *path, void *buf, uint32_t count, int32_t pos)
     {
+        SOStatTimer timer(SOSTAT_SYS_READ, count);
+
         if (soBinSelected(108))
             return bin::soRead(path, buf, count, pos);
         else
-            /* replace bin:: with work:: if you implement this syscall */
-            return bin::soRead(path, buf, count, pos);
+            return work::soRead(path, buf, count, pos);
     }
 
 };
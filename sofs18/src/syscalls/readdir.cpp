@@ -10,6 +10,8 @@ namespace sofs18
 
     int soReaddir(const char *path, void *buf, int32_t pos)
     {
+        SOStatTimer timer(SOSTAT_SYS_READDIR);
+
         if (soBinSelected(111))
             return bin::soReaddir(path, buf, pos);
         else
@@ -9,6 +9,8 @@ namespace sofs18
 {
     int soReadlink(const char *path, char *buf, size_t bufsz)
     {
+        SOStatTimer timer(SOSTAT_SYS_READLINK);
+
         if (soBinSelected(112))
             return bin::soReadlink(path, buf, bufsz);
         else
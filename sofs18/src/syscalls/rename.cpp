@@ -9,6 +9,8 @@ namespace sofs18
 {
     int soRename(const char *path, const char *newPath)
     {
+        SOStatTimer timer(SOSTAT_SYS_RENAME);
+
         if (soBinSelected(107))
             return bin::soRename(path, newPath);
         else
@@ -9,6 +9,8 @@ namespace sofs18
 {
     int soRmdir(const char *path)
     {
+        SOStatTimer timer(SOSTAT_SYS_RMDIR);
+
         if (soBinSelected(106))
             return bin::soRmdir(path);
         else
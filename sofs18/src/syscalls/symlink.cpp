@@ -10,6 +10,8 @@ namespace sofs18
 
     int soSymlink(const char *effPath, const char *path)
     {
+        SOStatTimer timer(SOSTAT_SYS_SYMLINK);
+
         if (soBinSelected(103))
             return bin::soSymlink(effPath, path);
         else
@@ -295,6 +295,29 @@ namespace sofs18
 
     /* ******************************************************************* */
 
+    /**
+     *  \brief Deallocate a byte range of a regular file, leaving a hole.
+     *
+     *  It tries to emulate <em>fallocate</em> system call with
+     *  <tt>FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE</tt>:
+     *  the file blocks fully within the range are freed, 
+     *  the bytes of the range in partial blocks are zeroed,
+     *  and the size of the file is kept.
+     *
+     *  To get more information, execute in a terminal the command <b><tt>man 2 fallocate</tt></b>
+     *
+     *  \param path path to the file
+     *  \param pos starting [byte] position of the range
+     *  \param len number of bytes of the range
+     *
+     *  \return 0 on success; 
+     *      -errno in case of error,
+     *      being errno the system error that better represents the cause of failure
+     */
+    int soPunchHole(const char *path, off_t pos, off_t len);
+
+    /* ******************************************************************* */
+
     /**
      *  \brief Read a directory entry from a directory.
      *
@@ -374,10 +397,13 @@ namespace sofs18
      * The rawdisk is open and, if it does not fail,
      * the three dealers are open.
      * This function is called by the mount operation.
+     * Most system calls only have a binary version, which assumes 512-byte blocks,
+     * so the file system can not be open if the block size is another one.
      *
      *  \param devname absolute path to the Linux file that simulates the storage device
      *
      *  \return 0 on success; 
+     *      -EOPNOTSUPP if the block size is not 512 bytes;
      *      -errno in case of error,
      *      being errno the system error that better represents the cause of failure
      */
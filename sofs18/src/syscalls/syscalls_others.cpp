@@ -4,17 +4,66 @@
 
 #include "bin_syscalls.h"
 
+#include "core.h"
+#include "dal.h"
+#include "freelists.h"
+#include "fileblocks.h"
+#include "direntries.h"
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+
 namespace sofs18
 {
     int soOpenFileSystem(const char *devname)
     {
+        /* most system calls only have a binary version, built for 512-byte blocks */
+        if (BlockSize != 512)
+            return -EOPNOTSUPP;
+
         return bin::soOpenFileSystem(devname);
     }
 
     /* ********************************************************* */
 
+    /* give data blocks to the file blocks of a file kept in memory */
+    static void soFlushPath(const char *path)
+    {
+        char p[PATH_MAX];
+        strncpy(p, path, PATH_MAX - 1);
+        p[PATH_MAX - 1] = '\0';
+
+        int ih = soITOpenInode(sofs18::soTraversePath(p));
+        try
+        {
+            soFlushFileBlocks(ih);
+        }
+        catch (SOException & err)
+        {
+            soITCloseInode(ih);
+            throw;
+        }
+        soITCloseInode(ih);
+    }
+
+    /* ********************************************************* */
+
     int soCloseFileSystem(void)
     {
+        /* delayed file blocks get their data blocks, and reserved references
+         * go back to the free lists, while the disk is open */
+        try
+        {
+            soFlushAllFileBlocks();
+            soReadaheadDropAll();
+            soMagazineDrain();
+        }
+        catch (SOException & err)
+        {
+            return -err.en;
+        }
+
         return bin::soCloseFileSystem();
     }
 
@@ -22,6 +71,8 @@ namespace sofs18
 
     int soStatFS(const char *path, struct statvfs *st)
     {
+        SOStatTimer timer(SOSTAT_SYS_STATFS);
+
         return bin::soStatFS(path, st);
     }
 
@@ -29,13 +80,23 @@ namespace sofs18
 
     int soStat(const char *path, struct stat *st)
     {
-        return bin::soStat(path, st);
+        SOStatTimer timer(SOSTAT_SYS_STAT);
+
+        int ret = bin::soStat(path, st);
+
+        /* the extent format is none of the user's business */
+        if (ret == 0)
+            st->st_mode &= ~INODE_EXTENTS;
+
+        return ret;
     }
 
     /* ********************************************************* */
 
     int soAccess(const char *path, int opRequested)
     {
+        SOStatTimer timer(SOSTAT_SYS_ACCESS);
+
         return bin::soAccess(path, opRequested);
     }
 
@@ -43,6 +104,8 @@ namespace sofs18
 
     int soChmod(const char *path, mode_t mode)
     {
+        SOStatTimer timer(SOSTAT_SYS_CHMOD);
+
         return bin::soChmod(path, mode);
     }
 
@@ -50,6 +113,8 @@ namespace sofs18
 
     int soChown(const char *path, uid_t owner, gid_t group)
     {
+        SOStatTimer timer(SOSTAT_SYS_CHOWN);
+
         return bin::soChown(path, owner, group);
     }
 
@@ -57,6 +122,8 @@ namespace sofs18
 
     int soUtime(const char *path, const struct utimbuf *times)
     {
+        SOStatTimer timer(SOSTAT_SYS_UTIME);
+
         return bin::soUtime(path, times);
     }
 
@@ -64,6 +131,8 @@ namespace sofs18
 
     int soUtimens(const char *path, const struct timespec tv[2])
     {
+        SOStatTimer timer(SOSTAT_SYS_UTIME);
+
         return bin::soUtimens(path, tv);
     }
 
@@ -71,6 +140,8 @@ namespace sofs18
 
     int soOpen(const char *path, int flags)
     {
+        SOStatTimer timer(SOSTAT_SYS_OPEN);
+
         return bin::soOpen(path, flags);
     }
 
@@ -78,6 +149,17 @@ namespace sofs18
 
     int soClose(const char *path)
     {
+        SOStatTimer timer(SOSTAT_SYS_CLOSE);
+
+        try
+        {
+            soFlushPath(path);
+        }
+        catch (SOException & err)
+        {
+            return -err.en;
+        }
+
         return bin::soClose(path);
     }
 
@@ -85,18 +167,38 @@ namespace sofs18
 
     int soFsync(const char *path)
     {
-        return bin::soFsync(path);
+        SOStatTimer timer(SOSTAT_SYS_FSYNC);
+
+        int ret = bin::soFsync(path);
+        if (ret != 0)
+            return ret;
+
+        /* make sure delayed and cached blocks reach the device */
+        try
+        {
+            soFlushPath(path);
+            soSyncDisk();
+        }
+        catch (SOException & err)
+        {
+            return -err.en;
+        }
+        return 0;
     }
 
     /* ********************************************************* */
 
     int soOpendir(const char *path)
     {
+        SOStatTimer timer(SOSTAT_SYS_OPEN);
+
         return bin::soOpendir(path);
     }
 
     int soClosedir(const char *path)
     {
+        SOStatTimer timer(SOSTAT_SYS_CLOSE);
+
         return bin::soClosedir(path);
     }
 
@@ -3,6 +3,7 @@
  */
 
 #include "bin_syscalls.h"
+#include "work_syscalls.h"
 #include "core.h"
 
 namespace sofs18
@@ -10,11 +11,12 @@ namespace sofs18
 
     int soTruncate(const char *path, off_t length)
     {
+        SOStatTimer timer(SOSTAT_SYS_TRUNCATE);
+
         if (soBinSelected(110))
             return bin::soTruncate(path, length);
         else
-            /* replace bin:: with work:: if you implement this syscall */
-            return bin::soTruncate(path, length);
+            return work::soTruncate(path, length);
     }
 
 };
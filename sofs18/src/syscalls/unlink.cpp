@@ -10,6 +10,8 @@ namespace sofs18
 
     int soUnlink(const char *path)
     {
+        SOStatTimer timer(SOSTAT_SYS_UNLINK);
+
         if (soBinSelected(105))
             return bin::soUnlink(path);
         else
@@ -3,6 +3,7 @@
  */
 
 #include "bin_syscalls.h"
+#include "work_syscalls.h"
 #include "core.h"
 
 namespace sofs18
@@ -10,11 +11,12 @@ namespace sofs18
 
     int soWrite(const char *path, void *buf, uint32_t count, int32_t pos)
     {
+        SOStatTimer timer(SOSTAT_SYS_WRITE, count);
+
         if (soBinSelected(109))
             return bin::soWrite(path, buf, count, pos);
         else
-            /* replace bin:: with work:: if you implement this syscall */
-            return bin::soWrite(path, buf, count, pos);
+            return work::soWrite(path, buf, count, pos);
     }
 
 };
@@ -24,6 +24,8 @@
 
 #include "core.h"
 #include "dal.h"
+#include "freelists.h"
+#include "fileblocks.h"
 
 using namespace sofs18;
 
@@ -80,6 +82,8 @@ public:
         hdl["api"] = addProbeIDs;
         hdl["rpi"] = removeProbeIDs;
         hdl["ppi"] = printProbeIDs;
+        hdl["pst"] = printStats;
+        hdl["rst"] = resetStats;
         hdl["sbi"] = setBinIDs;
         hdl["abi"] = addBinIDs;
         hdl["rbi"] = removeBinIDs;
@@ -92,10 +96,13 @@ public:
         hdl["adb"] = allocDataBlock;
         hdl["fb"] = freeDataBlock;
         hdl["fdb"] = freeDataBlock;
+        hdl["adbs"] = allocDataBlocks;
+        hdl["fdbs"] = freeDataBlocks;
         hdl["ric"] = replenishIRCache;
         hdl["dic"] = depleteIICache;
         hdl["rbc"] = replenishBRCache;
         hdl["dbc"] = depleteBICache;
+        hdl["cfm"] = checkFreeBlockMap;
         /* inodeattr functions */
         hdl["cia"] = checkInodeAccess;
         hdl["sia"] = setInodeAccess;
@@ -107,10 +114,12 @@ public:
         hdl["cog"] = changeOwnership;
         /* fileblocks functions */
         hdl["afb"] = allocFileBlock;
+        hdl["afbs"] = allocFileBlocks;
         hdl["ffb"] = freeFileBlocks;
         hdl["gfb"] = getFileBlock;
         hdl["rfb"] = readFileBlock;
         hdl["wfb"] = writeFileBlock;
+        hdl["frg"] = fragmentationReport;
         /* direntries functions */
         hdl["ade"] = addDirEntry;
         hdl["dde"] = deleteDirEntry;
@@ -158,15 +167,19 @@ public:
              "| api       - Add Probe Ids             | rpi       - Remove Probe Ids          |\n"
              "| sbi       - Set Bin Ids               | pbi       - Print Bin Ids             |\n"
              "| abi       - Add Bin Ids               | rbi       - Remove Bin Ids            |\n"
+             "| pst       - Print Statistics          | rst       - Reset Statistics          |\n"
              "+---------------------------------------+---------------------------------------+\n"
              "|  ai [401] - Alloc Inode               |  fi [402] - Free Inode                |\n"
              "| ric [403] - Replenish Inode rCache    | dic [404] - Deplete Inode iCache      |\n"
              "| adb [441] - Alloc Data Block          | fdb [442] - Free Data Block           |\n"
              "| rbc [443] - Replenish Block rCache    | dbc [444] - Deplete Block iCache      |\n"
+             "|adbs [445] - Alloc Data Blocks         |fdbs [446] - Free Data Blocks          |\n"
+             "| cfm [575] - Check Free Block Map      |                                       |\n"
              "+---------------------------------------+--------------------------------------+\n"
              "| gfb [301] - Get File Block            | afb [302] - Alloc File Block          |\n"
-             "| ffb [303] - Free File Blocks          |                                       |\n"
+             "| ffb [303] - Free File Blocks          |afbs [304] - Alloc File Blocks         |\n"
              "| rfb [331] - Read File Block           | wfb [332] - Write File Block          |\n"
+             "| frg       - Fragmentation Report      |                                       |\n"
              "+---------------------------------------+---------------------------------------+\n"
              "| gde [201] - Get Dir Entry             | ade [202] - Add Dir Entry             |\n"
              "| dde [203] - Delete Dir Entry          | rde [204] - Rename Dir Entry          |\n"
@@ -351,6 +364,9 @@ int main(int argc, char *argv[])
     /* close the unbuffered communication channel with the storage device */
     try
     {
+        soFlushAllFileBlocks();
+        soReadaheadDropAll();
+        soMagazineDrain();
         soCloseDisk();
     }
     catch(SOException & err)
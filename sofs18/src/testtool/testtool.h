@@ -41,6 +41,8 @@ void setProbeIDs();
 void addProbeIDs();
 void removeProbeIDs();
 void printProbeIDs();
+void printStats();
+void resetStats();
 void createDisk();
 void formatDisk();
 void showBlock();
@@ -56,15 +58,20 @@ void replenishIRCache();
 void depleteIICache();
 void allocDataBlock();
 void freeDataBlock();
+void allocDataBlocks();
+void freeDataBlocks();
 void depleteBICache();
 void replenishBRCache();
+void checkFreeBlockMap();
 
 /* fileblocks */
 void getFileBlock();
 void allocFileBlock();
+void allocFileBlocks();
 void freeFileBlocks();
 void readFileBlock();
 void writeFileBlock();
+void fragmentationReport();
 
 /* direntries */
 void checkDirectoryEmptiness();
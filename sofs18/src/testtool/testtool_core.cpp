@@ -2,7 +2,10 @@
 
 #include "core.h"
 #include "dal.h"
+#include "freelists.h"
+#include "fileblocks.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -234,6 +237,30 @@ void printProbeIDs()
     notImplemented();
 }
 
+/* ******************************************** */
+/* print operation statistics */
+void printStats()
+{
+    soStatPrint(stdout);
+
+    SOReadaheadStats ra;
+    soReadaheadGetStats(&ra);
+    if (ra.issued != 0)
+    {
+        printf("readahead: %" PRIu64 " blocks issued, %" PRIu64 " hits, %" PRIu64 " wasted, "
+                "%" PRIu64 " waits, %" PRIu64 " collapses\n",
+                ra.issued, ra.hits, ra.waste, ra.waits, ra.collapses);
+    }
+}
+
+/* ******************************************** */
+/* reset operation statistics */
+void resetStats()
+{
+    soStatReset();
+    soReadaheadResetStats();
+}
+
 /* ******************************************** */
 /* create disk */
 void createDisk(void)
@@ -273,6 +300,9 @@ void formatDisk(void)
     /* close disk */
     try
     {
+        soFlushAllFileBlocks();
+        soReadaheadDropAll();
+        soMagazineDrain();
         soCloseDisk();
     }
     catch(SOException & err)
@@ -6,6 +6,9 @@
 
 #include <string.h>
 
+#include <string>
+#include <vector>
+
 using namespace sofs18;
 
 /* ******************************************** */
@@ -74,6 +77,51 @@ void allocFileBlock(void)
     resultMsg("Block number %u allocated\n", bn);
 }
 
+/* ******************************************** */
+/* alloc a range of file blocks */
+void allocFileBlocks(void)
+{
+    /* ask for inode number */
+    promptMsg("Inode number: ");
+    uint32_t in;
+    fscanf(fin, "%u", &in);
+    fPurge(fin);
+
+    /* ask for first file block index */
+    promptMsg("First file block index: ");
+    uint32_t fbn;
+    fscanf(fin, "%u", &fbn);
+    fPurge(fin);
+
+    /* ask for number of file blocks */
+    promptMsg("Number of file blocks: ");
+    uint32_t n;
+    fscanf(fin, "%u", &n);
+    fPurge(fin);
+    if (n == 0)
+    {
+        errorMsg("Wrong number: %u", n);
+        return;
+    }
+
+    /* open inode */
+    uint32_t ih = soITOpenInode(in);
+
+    /* alloc file blocks */
+    std::vector<uint32_t> refs(n);
+    soAllocFileBlocks(ih, fbn, n, refs.data());
+
+    /* save and close inode */
+    soITSaveInode(ih);
+    soITCloseInode(ih);
+
+    /* print result */
+    std::string list;
+    for (uint32_t i = 0; i < n; i++)
+        list += " " + std::to_string(refs[i]);
+    resultMsg("Block numbers:%s\n", list.c_str());
+}
+
 /* ******************************************** */
 /* free file blocks */
 void freeFileBlocks(void)
@@ -177,3 +225,65 @@ void writeFileBlock(void)
     soITCloseInode(ih);
 }
 
+/* fragmentation report */
+void fragmentationReport(void)
+{
+    SOSuperBlock *sb = soSBGetPointer();
+
+    /* files: a new extent starts whenever a file block is not right after the previous one */
+    uint32_t files = 0, blocks = 0, extents = 0, fragmented = 0;
+    for (uint32_t in = 0; in < sb->itotal; in++)
+    {
+        int ih = soITOpenInode(in);
+        SOInode *ip = soITGetInodePointer(ih);
+        if ((ip->mode & INODE_FREE) != 0)
+        {
+            soITCloseInode(ih);
+            continue;
+        }
+
+        uint32_t nfb = (ip->size + BlockSize - 1) / BlockSize;
+        std::vector<uint32_t> map(nfb);
+        if (nfb > 0)
+            soGetFileBlocks(ih, 0, nfb, map.data());
+        uint32_t prev = NullReference, ext = 0;
+        for (uint32_t bn : map)
+        {
+            if (bn == NullReference)
+                continue;
+            if (prev == NullReference or bn != prev + 1)
+                ext++;
+            prev = bn;
+            blocks++;
+        }
+        soITCloseInode(ih);
+
+        files++;
+        extents += ext;
+        if (ext > 1)
+            fragmented++;
+    }
+
+    /* free space: runs of free blocks */
+    uint32_t free = 0, runs = 0, longest = 0, len = 0;
+    for (uint32_t bn = 0; bn < sb->dz_total; bn++)
+    {
+        if (soFBMIsFree(bn))
+        {
+            free++;
+            if (len++ == 0)
+                runs++;
+            if (len > longest)
+                longest = len;
+        }
+        else
+            len = 0;
+    }
+
+    resultMsg("%u files, %u data blocks in %u extents (%.2f per file), %u files fragmented\n"
+            "%u free blocks in %u runs, longest run of %u\n",
+            files, blocks, extents, (files > 0) ? (double)extents / files : 0.0, fragmented,
+            free, runs, longest);
+}
+
+/* ******************************************** */
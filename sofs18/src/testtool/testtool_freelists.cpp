@@ -1,11 +1,15 @@
 #include "testtool.h"
 
 #include "freelists.h"
+#include "dal.h"
 
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <string>
+#include <vector>
+
 using namespace sofs18;
 
 /* ******************************************** */
@@ -105,6 +109,61 @@ void freeDataBlock(void)
     resultMsg("Data block number %u freed\n", cn);
 }
 
+/* ******************************************** */
+/* alloc a number of data blocks */
+void allocDataBlocks(void)
+{
+    /* ask for number of blocks */
+    promptMsg("Number of data blocks: ");
+    uint32_t n;
+    fscanf(fin, "%u", &n);
+    fPurge(fin);
+    if (n == 0)
+    {
+        errorMsg("Wrong number: %u", n);
+        return;
+    }
+
+    /* call function */
+    std::vector<uint32_t> refs(n);
+    uint32_t cnt = soAllocDataBlocks(n, refs.data());
+
+    /* print result */
+    std::string list;
+    for (uint32_t i = 0; i < cnt; i++)
+        list += " " + std::to_string(refs[i]);
+    resultMsg("%u data blocks allocated:%s\n", cnt, list.c_str());
+}
+
+/* ******************************************** */
+/* free a number of data blocks */
+void freeDataBlocks(void)
+{
+    /* ask for number of blocks */
+    promptMsg("Number of data blocks: ");
+    uint32_t n;
+    fscanf(fin, "%u", &n);
+    fPurge(fin);
+    if (n == 0)
+    {
+        errorMsg("Wrong number: %u", n);
+        return;
+    }
+
+    /* ask for block numbers */
+    promptMsg("Data block numbers: ");
+    std::vector<uint32_t> refs(n);
+    for (uint32_t i = 0; i < n; i++)
+        fscanf(fin, "%u", &refs[i]);
+    fPurge(fin);
+
+    /* call function */
+    soFreeDataBlocks(refs.data(), n);
+
+    /* print result */
+    resultMsg("%u data blocks freed\n", n);
+}
+
 /* ******************************************** */
 /* deplete block insertion cache */
 void depleteBICache(void)
@@ -128,3 +187,20 @@ void replenishBRCache(void)
 }
 
 /* ******************************************** */
+/* ******************************************** */
+/* check the free block map */
+void checkFreeBlockMap(void)
+{
+    /* call function */
+    SOFBMReport rep;
+    soFBMCheck(&rep);
+
+    /* print result */
+    uint32_t runlen;
+    uint32_t run = soFBMFindRun(0, UINT32_MAX, &runlen);
+    resultMsg("free block map: %u free (superblock says %u), %u duplicates, %u out of range, "
+            "%u mismatches, longest run of %u at %u\n", rep.free, rep.dzFree,
+            rep.duplicates, rep.outOfRange, rep.mismatches, runlen, run);
+}
+
+/* ******************************************** */
@@ -1,5 +1,6 @@
 #include "work_fileblocks.h"
 
+#include "fileblocks.h"
 #include "freelists.h"
 #include "dal.h"
 #include "core.h"
@@ -7,17 +8,38 @@
 
 #include <errno.h>
 
-#include <iostream>
+#include <vector>
 
 namespace sofs18
 {
     namespace work
     {
 
-
-        static uint32_t soAllocIndirectFileBlocks(SOInode * ip, uint32_t afbn);
-        static uint32_t soAllocDoubleIndirectFileBlocks(SOInode * ip, uint32_t afbn);
-	
+        /*
+         * Allocation of a range of file blocks is done in two passes over the
+         * reference tree: the first one counts the data blocks and the blocks of
+         * references that are missing, the second one hands out blocks taken from
+         * the free list in bulk.
+         * The first pass already stores the data blocks the range has,
+         * so, if none is missing, refs is complete without the second one.
+         * Data blocks are handed out in file block order, in ascending order of
+         * block number, so a range gets a contiguous run whenever the free list has one.
+         */
+        struct SOAllocPass
+        {
+            bool assign;            ///< false on the counting pass
+            uint32_t ndata;         ///< data blocks counted, or handed out
+            uint32_t nmeta;         ///< blocks of references counted, or handed out
+            const uint32_t *data;   ///< data blocks to hand out
+            const uint32_t *meta;   ///< blocks of references to hand out
+            uint32_t *refs;         ///< data block of every file block of the range
+        };
+
+        static void soAllocRefBlock(uint32_t * slot, uint32_t off, uint32_t cnt,
+                SOAllocPass & p, uint32_t base);
+        static void soAllocDoubleRefBlock(uint32_t * slot, uint32_t off, uint32_t cnt,
+                SOAllocPass & p, uint32_t base);
+        static void soAllocRange(SOInode * ip, uint32_t fbn, uint32_t n, SOAllocPass & p);
 
         /* ********************************************************* */
 
@@ -25,130 +47,193 @@ namespace sofs18
         {
             soProbe(302, "%s(%d, %u)\n", __FUNCTION__, ih, fbn);
 
+            uint32_t ref;
+            sofs18::soAllocFileBlocks(ih, fbn, 1, &ref);
+            return ref;
+        }
 
-            SOInode* ip = soITGetInodePointer(ih);
-			uint32_t RPB = ReferencesPerBlock;
-			uint32_t RPBSQR = RPB * RPB;
-			uint32_t doubleIndirectStart = N_INDIRECT * RPB + N_DIRECT;
-			uint32_t doubleIndirectEnd = RPBSQR * N_DOUBLE_INDIRECT + doubleIndirectStart;
-			uint32_t allBlock;
-
-			// exit condition - invalid fbn
-			if (fbn < 0 || fbn >= doubleIndirectEnd) {
-				throw SOException(EINVAL, __FUNCTION__);
-			}
-
-
-			if (fbn < N_DIRECT) {
-
-				allBlock = sofs18::soAllocDataBlock();
-				ip->d[fbn] = allBlock ;
-				ip->blkcnt += 1;
-			}
-
-			if (fbn >= N_DIRECT && fbn < doubleIndirectStart) {
-
-				allBlock = soAllocIndirectFileBlocks(ip, fbn - N_DIRECT);
-			}
-
-			if (fbn >= doubleIndirectStart && fbn < doubleIndirectEnd) {
-
-				allBlock = soAllocDoubleIndirectFileBlocks(ip, fbn - doubleIndirectStart);
-			}
-
-			soITSaveInode(ih);
-			return allBlock;
-		}
-
-
-		/* ********************************************************* */
-
-
-		static uint32_t soAllocIndirectFileBlocks(SOInode * ip, uint32_t afbn)
-		{
-			soProbe(302, "%s(%d, ...)\n", __FUNCTION__, afbn);
-
-			/* change the following line by your code */
-			//throw SOException(ENOSYS, __FUNCTION__);
-
-			// calculate indirect list index
-			uint32_t i1index = (afbn / ReferencesPerBlock) % ReferencesPerBlock;
-
-			// calculate direct list index
-			uint32_t ref = afbn % ReferencesPerBlock; // ref inclusive
-
-			// data block frame
-			uint32_t db[ReferencesPerBlock];
-			uint32_t allBlock;
-
-			// indirect list index is empty
-			if (ip->i1[i1index] == NullReference) {
-
-				// create direct block and alloc it to indirect position
-				allBlock = sofs18::soAllocDataBlock();
-				for (uint32_t i = 0; i < ReferencesPerBlock; i++) {
-					db[i] = NullReference;
-				}
-				sofs18::soWriteDataBlock(allBlock,db);
-				// read direct block
-				ip->i1[i1index] = allBlock;
-				soReadDataBlock(ip->i1[i1index], &db);
-
-				allBlock = sofs18::soAllocDataBlock();
-				db[ref] = allBlock;
-				ip->blkcnt += 2;
-			}
-			else {
-
-				soReadDataBlock(ip->i1[i1index], &db);
-				allBlock = sofs18::soAllocDataBlock();
-				ip->i1[i1index] = allBlock;
-				ip->blkcnt += 1;
-			}
-
-			return allBlock;
-		}
-
-
-		/* ********************************************************* */
-
-
-		static uint32_t soAllocDoubleIndirectFileBlocks(SOInode * ip, uint32_t afbn)
-		{
-			soProbe(302, "%s(%d, ...)\n", __FUNCTION__, afbn);
+        /* ********************************************************* */
 
-			/* change the following line by your code */
-			//throw SOException(ENOSYS, __FUNCTION__);
+        void soAllocFileBlocks(int ih, uint32_t fbn, uint32_t n, uint32_t * refs)
+        {
+            soProbe(304, "%s(%d, %u, %u, %p)\n", __FUNCTION__, ih, fbn, n, refs);
+
+            uint32_t RPB = ReferencesPerBlock;
+            uint32_t maxBlocks = N_DIRECT + N_INDIRECT * RPB + N_DOUBLE_INDIRECT * RPB * RPB;
+            if (refs == NULL or n == 0 or fbn >= maxBlocks or n > maxBlocks - fbn)
+                throw SOException(EINVAL, __FUNCTION__);
+
+            SOInode *ip = soITGetInodePointer(ih);
+
+            /* counting pass */
+            SOAllocPass p = {false, 0, 0, NULL, NULL, refs};
+            soAllocRange(ip, fbn, n, p);
+
+            uint32_t total = p.ndata + p.nmeta;
+            if (total == 0)
+                return;
+
+            SOSuperBlock *sb = soSBGetPointer();
+            if (sb->dz_free < total)
+                throw SOException(ENOSPC, __FUNCTION__);
+
+            /*
+             * data blocks right after the block of the previous file block, if any,
+             * otherwise in the part of the data zone matching the inode's place in the inode table;
+             * blocks of references after them, so they do not break the run of data blocks
+             */
+            uint32_t hint = NullReference;
+            if (fbn > 0)
+            {
+                uint32_t prev = sofs18::soGetFileBlock(ih, fbn - 1);
+                if (prev != NullReference)
+                    hint = prev + 1;
+            }
+            if (hint == NullReference)
+                hint = (uint64_t)soITGetInodeID(ih) * sb->dz_total / sb->itotal;
+
+            std::vector<uint32_t> data(p.ndata);
+            std::vector<uint32_t> meta(p.nmeta);
+            for (uint32_t got = 0; got < p.ndata; )
+            {
+                got += sofs18::soAllocDataBlocksNear(hint, p.ndata - got, &data[got]);
+                hint = data[got - 1] + 1;
+            }
+            for (uint32_t got = 0; got < p.nmeta; )
+            {
+                got += sofs18::soAllocDataBlocksNear(hint, p.nmeta - got, &meta[got]);
+                hint = meta[got - 1] + 1;
+            }
+
+            /* assigning pass */
+            SOAllocPass q = {true, 0, 0, data.data(), meta.data(), refs};
+            soAllocRange(ip, fbn, n, q);
+
+            ip->blkcnt += total;
+            soITSaveInode(ih);
+        }
 
-			uint32_t i2index = afbn / ReferencesPerBlock / ReferencesPerBlock;
-			uint32_t db[ReferencesPerBlock];
-			uint32_t allBlock;
+        /* ********************************************************* */
 
-			// double indirect list index is empty
-			if (ip->i2[i2index] == NullReference) {
+        /* walk the range [fbn, fbn + n) of file blocks */
+        static void soAllocRange(SOInode * ip, uint32_t fbn, uint32_t n, SOAllocPass & p)
+        {
+            uint32_t RPB = ReferencesPerBlock;
+            uint32_t indirectStart = N_DIRECT;
+            uint32_t doubleIndirectStart = indirectStart + N_INDIRECT * RPB;
+
+            for (uint32_t i = 0; i < n; )
+            {
+                uint32_t f = fbn + i;
+                if (f < indirectStart)
+                {
+                    if (ip->d[f] == NullReference)
+                    {
+                        if (p.assign)
+                            ip->d[f] = p.data[p.ndata];
+                        p.ndata++;
+                    }
+                    p.refs[i] = ip->d[f];
+                    i++;
+                }
+                else if (f < doubleIndirectStart)
+                {
+                    uint32_t afbn = f - indirectStart;
+                    uint32_t off = afbn % RPB;
+                    uint32_t cnt = (n - i < RPB - off) ? n - i : RPB - off;
+                    soAllocRefBlock(&ip->i1[afbn / RPB], off, cnt, p, i);
+                    i += cnt;
+                }
+                else
+                {
+                    uint32_t afbn = f - doubleIndirectStart;
+                    uint32_t off = afbn % (RPB * RPB);
+                    uint32_t cnt = (n - i < RPB * RPB - off) ? n - i : RPB * RPB - off;
+                    soAllocDoubleRefBlock(&ip->i2[afbn / (RPB * RPB)], off, cnt, p, i);
+                    i += cnt;
+                }
+            }
+        }
 
-				// create indirect block and alloc it to double indirect position
-				allBlock = sofs18::soAllocDataBlock();
-				for (uint32_t i = 0; i < ReferencesPerBlock; i++) {
-					db[i] = NullReference;
-				}
-				sofs18::soWriteDataBlock(allBlock,db);
-				// read indirect block
-				ip->i2[i2index] = allBlock;
-				soReadDataBlock(ip->i2[i2index], &db);
+        /* ********************************************************* */
 
-				allBlock = soAllocIndirectFileBlocks(ip, afbn);
-				ip->blkcnt += 1;
-			}
-			else {
+        /*
+         * walk entries [off, off + cnt) of the block of references pointed to by slot,
+         * which cover file blocks [base, base + cnt) of the range
+         */
+        static void soAllocRefBlock(uint32_t * slot, uint32_t off, uint32_t cnt,
+                SOAllocPass & p, uint32_t base)
+        {
+            soProbe(302, "%s(%u, %u, %u)\n", __FUNCTION__, *slot, off, cnt);
+
+            uint32_t ref[ReferencesPerBlock];
+
+            /* a missing block of references: every entry is missing too */
+            if (*slot == NullReference)
+            {
+                p.nmeta++;
+                if (not p.assign)
+                {
+                    p.ndata += cnt;
+                    return;
+                }
+                *slot = p.meta[p.nmeta - 1];
+                for (uint32_t j = 0; j < ReferencesPerBlock; j++)
+                    ref[j] = NullReference;
+            }
+            else
+                sofs18::soReadDataBlock(*slot, ref);
+
+            for (uint32_t j = 0; j < cnt; j++)
+            {
+                if (ref[off + j] == NullReference)
+                {
+                    if (p.assign)
+                        ref[off + j] = p.data[p.ndata];
+                    p.ndata++;
+                }
+                p.refs[base + j] = ref[off + j];
+            }
+
+            if (p.assign)
+                sofs18::soWriteDataBlock(*slot, ref);
+        }
 
-				soReadDataBlock(ip->i2[i2index], &db);
-				allBlock = soAllocIndirectFileBlocks(ip, afbn);
-			}
+        /* ********************************************************* */
 
-			return allBlock;
+        /* same as soAllocRefBlock, for a block of references to blocks of references */
+        static void soAllocDoubleRefBlock(uint32_t * slot, uint32_t off, uint32_t cnt,
+                SOAllocPass & p, uint32_t base)
+        {
+            soProbe(302, "%s(%u, %u, %u)\n", __FUNCTION__, *slot, off, cnt);
+
+            uint32_t RPB = ReferencesPerBlock;
+            uint32_t ref[ReferencesPerBlock];
+
+            if (*slot == NullReference)
+            {
+                p.nmeta++;
+                if (p.assign)
+                    *slot = p.meta[p.nmeta - 1];
+                for (uint32_t j = 0; j < RPB; j++)
+                    ref[j] = NullReference;
+            }
+            else
+                sofs18::soReadDataBlock(*slot, ref);
+
+            for (uint32_t i = 0; i < cnt; )
+            {
+                uint32_t o = (off + i) % RPB;
+                uint32_t c = (cnt - i < RPB - o) ? cnt - i : RPB - o;
+                soAllocRefBlock(&ref[(off + i) / RPB], o, c, p, base + i);
+                i += c;
+            }
+
+            if (p.assign)
+                sofs18::soWriteDataBlock(*slot, ref);
+        }
 
-		}
+        /* ********************************************************* */
 
     };
 
@@ -21,14 +21,24 @@ namespace sofs18
 
         uint32_t soGetFileBlock(int ih, uint32_t fbn);
 
+        void soGetFileBlocks(int ih, uint32_t first, uint32_t count, uint32_t *out);
+
         uint32_t soAllocFileBlock(int ih, uint32_t fbn);
 
+        void soAllocFileBlocks(int ih, uint32_t fbn, uint32_t n, uint32_t *refs);
+
         void soFreeFileBlocks(int ih, uint32_t ffbn);
 
+        void soPunchFileBlocks(int ih, uint32_t first, uint32_t last);
+
         void soReadFileBlock(int ih, uint32_t fbn, void *buf);
 
+        void soReadFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf);
+
         void soWriteFileBlock(int ih, uint32_t fbn, void *buf);
 
+        void soWriteFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf);
+
     };
 
 };
@@ -9,24 +9,26 @@
 #include <errno.h>
 #include <assert.h>
 
+#include <algorithm>
+#include <vector>
+
 namespace sofs18
 {
     namespace work
     {
 
-        /* free all blocks between positions ffbn and ReferencesPerBlock - 1
-         * existing in the block of references given by i1.
-         * Return true if, after the operation, all references become NullReference.
-         * It assumes i1 is valid.
+        /* free the file blocks in [first, last] mapped by the block of references *ref,
+         * which covers the file blocks from base on; depth is 1 if it holds direct
+         * references and 2 if it holds indirect references.
+         * The data blocks released, including blocks of references left with no reference,
+         * are appended to freed; *ref becomes NullReference if it is one of them.
+         * A null *ref is skipped as a whole.
          */
-        static uint32_t soFreeIndirectFileBlocks(uint32_t * bl, uint32_t ffbn, uint32_t size);
+        static void soPunchRefBlock(uint32_t * ref, uint32_t depth, uint32_t base,
+                uint32_t first, uint32_t last, std::vector<uint32_t> & freed);
 
-        /* free all blocks between positions ffbn and ReferencesPerBloc**2 - 1
-         * existing in the block of indirect references given by i2.
-         * Return true if, after the operation, all references become NullReference.
-         * It assumes i2 is valid.
-         */
-        static uint32_t soFreeDoubleIndirectFileBlocks(uint32_t * bl, uint32_t ffbn);
+        /* free the file blocks in [first, last], last being a valid file block */
+        static void soPunch(int ih, uint32_t first, uint32_t last);
 
         /* ********************************************************* */
 
@@ -34,165 +36,116 @@ namespace sofs18
         {
             soProbe(303, "%s(%d, %u)\n", __FUNCTION__, ih, ffbn);
 
-            /* change the following line by your code */
-            //bin::soFreeFileBlocks(ih, ffbn);
-
-            // solution by Luis Moura, student 83808 DETI - UA and
-            //			   Maria João, student 84681 DETI - UA
-
-            SOInode* ip = soITGetInodePointer(ih);
             uint32_t RPB = ReferencesPerBlock;
-            uint32_t RPBSQR = RPB * RPB;
-            uint32_t doubleIndirectStart = N_INDIRECT * RPB + N_DIRECT;
-            uint32_t doubleIndirectEnd = RPBSQR * N_DOUBLE_INDIRECT + doubleIndirectStart;
-
-            uint32_t count = 0;
-
-            // exit condition - invalid ffbn
-            if (ffbn < 0 || ffbn >= doubleIndirectEnd) {
-				throw SOException(EINVAL, __FUNCTION__);
-
-			}
-
-            if (ffbn < N_DIRECT) {
-
-            	// alterar diretamente d
-            	for (; ffbn < N_DIRECT; ffbn++){
-            		if (ip->d[ffbn] != NullReference) {
-						count++;
-					}
-            		ip->d[ffbn] = NullReference;
-            	}
-            }
-
-            if (ffbn >= N_DIRECT && ffbn < doubleIndirectStart) {
-
-            	// free indirect list
-            	count += soFreeIndirectFileBlocks(ip->i1, ffbn - N_DIRECT, N_INDIRECT);
-            	ffbn = doubleIndirectStart;
-            }
+            uint32_t nfb = N_DIRECT + N_INDIRECT * RPB + N_DOUBLE_INDIRECT * RPB * RPB;
 
-            if (ffbn >= doubleIndirectStart && ffbn < doubleIndirectEnd) {
+            if (ffbn >= nfb)
+                throw SOException(EINVAL, __FUNCTION__);
 
-            	// free double indirect list
-            	count += soFreeDoubleIndirectFileBlocks(ip->i2, ffbn - N_DIRECT - N_INDIRECT * ReferencesPerBlock);
-            }
-
-            ip->blkcnt -= count;
-            soITSaveInode(ih);
+            soPunch(ih, ffbn, nfb - 1);
         }
 
-
         /* ********************************************************* */
 
-
-        static uint32_t soFreeIndirectFileBlocks(uint32_t * bl, uint32_t ffabn, uint32_t size)
+        void soPunchFileBlocks(int ih, uint32_t first, uint32_t last)
         {
-            soProbe(303, "%s(..., %u, %u)\n", __FUNCTION__, bl, ffabn);
-
-            /* change the following line by your code */
-            //throw SOException(ENOSYS, __FUNCTION__);
-
-            uint32_t count = 0;
-
-            // calculate indirect list index
-            uint32_t i1index = (ffabn / ReferencesPerBlock) % ReferencesPerBlock;
-
-            // calculate direct list index
-            uint32_t ref = ffabn % ReferencesPerBlock; // ref inclusive
-
-            // free file blocks from ref to end of indirect list
-            uint32_t db[ReferencesPerBlock];
-            for (uint32_t i = i1index; i < size; i++) {
-
-            	if (bl[i] == NullReference){
-            		continue;
-            	}
-
-            	soReadDataBlock(bl[i], &db);
+            soProbe(321, "%s(%d, %u, %u)\n", __FUNCTION__, ih, first, last);
 
-            	// free direct list
-            	for (uint32_t j = ref; j < ReferencesPerBlock; j++) {
-            		if (db[j] != NullReference) {
-            			count++;
-            		}
-					db[j] = NullReference;
-				}
+            uint32_t RPB = ReferencesPerBlock;
+            uint32_t nfb = N_DIRECT + N_INDIRECT * RPB + N_DOUBLE_INDIRECT * RPB * RPB;
 
-            	// verify direct list is completely empty
-            	bool del = true;
-            	for (uint32_t j = 0; j < ref; j++) {
+            if (first >= nfb or first > last)
+                throw SOException(EINVAL, __FUNCTION__);
 
-					if (db[j] != NullReference) {
-						del = false;
-					}
-				}
+            soPunch(ih, first, std::min(last, nfb - 1));
+        }
 
-            	soWriteDataBlock(bl[i], &db);
+        /* ********************************************************* */
 
-            	// if empty, free indirect list entry
-            	if (del) {
-            		bl[i] = NullReference;
-            		count++;
-            	}
+        static void soPunch(int ih, uint32_t first, uint32_t last)
+        {
+            SOInode *ip = soITGetInodePointer(ih);
+            uint32_t RPB = ReferencesPerBlock;
+            std::vector<uint32_t> freed;
+
+            /* direct references */
+            for (uint32_t i = first; i < N_DIRECT and i <= last; i++)
+            {
+                if (ip->d[i] != NullReference)
+                {
+                    freed.push_back(ip->d[i]);
+                    ip->d[i] = NullReference;
+                }
+            }
 
-            	// adjust ref (next iteration free complete direct lists)
-            	ref = 0;
+            /* indirect and double indirect references, visiting only the subtrees in the range */
+            uint32_t base = N_DIRECT;
+            for (uint32_t i = 0; i < N_INDIRECT; i++, base += RPB)
+            {
+                if (first < base + RPB and last >= base)
+                    soPunchRefBlock(&ip->i1[i], 1, base, first, last, freed);
+            }
+            for (uint32_t i = 0; i < N_DOUBLE_INDIRECT; i++, base += RPB * RPB)
+            {
+                if (first < base + RPB * RPB and last >= base)
+                    soPunchRefBlock(&ip->i2[i], 2, base, first, last, freed);
             }
 
-            return count;
+            if (not freed.empty())
+            {
+                sofs18::soFreeDataBlocks(freed.data(), freed.size());
+                ip->blkcnt -= freed.size();
+            }
+            soITSaveInode(ih);
         }
 
-
         /* ********************************************************* */
 
-
-        static uint32_t soFreeDoubleIndirectFileBlocks(uint32_t * bl, uint32_t ffabn)
+        static void soPunchRefBlock(uint32_t * ref, uint32_t depth, uint32_t base,
+                uint32_t first, uint32_t last, std::vector<uint32_t> & freed)
         {
-            soProbe(303, "%s(..., %u, %u)\n", __FUNCTION__, bl, ffabn);
-
-            /* change the following line by your code */
-            //throw SOException(ENOSYS, __FUNCTION__);
+            if (*ref == NullReference)
+                return;
 
-            uint32_t count = 0;
-
-            uint32_t i2index = ffabn / ReferencesPerBlock / ReferencesPerBlock;   // double indirect index, just to gabate myself
-            uint32_t i2block = (ffabn / ReferencesPerBlock) % ReferencesPerBlock; // indirect index
-
-            uint32_t db[ReferencesPerBlock];
-			for (uint32_t i = i2index; i < N_DOUBLE_INDIRECT; i++) {
-
-				if (bl[i] == NullReference){
-					continue;
-				}
-
-				soReadDataBlock(bl[i], &db);
-
-				// free indirect list
-				count += soFreeIndirectFileBlocks(db, ffabn, ReferencesPerBlock);
-
-				// verify indirect list is completely empty
-				bool del = true;
-				for (uint32_t j = 0; j < i2block; j++) {
-					if (db[j] != NullReference) {
-						del = false;
-					}
-				}
-
-				soWriteDataBlock(bl[i], &db);
-
-				// if empty, free indirect list entry
-				if (del) {
-					bl[i] = NullReference;
-					count++;
-				}
+            uint32_t RPB = ReferencesPerBlock;
+            uint32_t cspan = (depth == 1) ? 1 : RPB;
+
+            /* the entries touched by the range */
+            uint32_t lo = (first > base) ? (first - base) / cspan : 0;
+            uint32_t hi = std::min((last - base) / cspan, RPB - 1);
+
+            uint32_t refs[ReferencesPerBlock];
+            sofs18::soReadDataBlock(*ref, refs);
+
+            bool changed = false;
+            for (uint32_t i = lo; i <= hi; i++)
+            {
+                if (refs[i] == NullReference)
+                    continue;
+
+                if (depth == 1)
+                {
+                    freed.push_back(refs[i]);
+                    refs[i] = NullReference;
+                }
+                else
+                    soPunchRefBlock(&refs[i], 1, base + i * cspan, first, last, freed);
+
+                changed = changed or refs[i] == NullReference;
+            }
 
-				// adjust i2block and ffabn (next iteration free complete direct lists)
-				i2block = 0;
-				ffabn = 0;
-			}
+            /* a block of references left empty is released, and not written back */
+            bool empty = true;
+            for (uint32_t i = 0; i < RPB and empty; i++)
+                empty = (refs[i] == NullReference);
 
-			return count;
+            if (empty)
+            {
+                freed.push_back(*ref);
+                *ref = NullReference;
+            }
+            else if (changed)
+                sofs18::soWriteDataBlock(*ref, refs);
         }
 
         /* ********************************************************* */
@@ -200,4 +153,3 @@ namespace sofs18
     };
 
 };
-
@@ -5,6 +5,9 @@
 #include "bin_fileblocks.h"
 
 #include <errno.h>
+#include <string.h>
+
+#include <algorithm>
 
 namespace sofs18
 {
@@ -16,12 +19,14 @@ namespace sofs18
 
         static uint32_t soGetIndirectFileBlock(SOInode * ip, uint32_t fbn);
         static uint32_t soGetDoubleIndirectFileBlock(SOInode * ip, uint32_t fbn);
+        static void soGetRefBlockRange(uint32_t bn, uint32_t off, uint32_t cnt, uint32_t * out);
+        static void soGetDoubleRefBlockRange(uint32_t bn, uint32_t off, uint32_t cnt, uint32_t * out);
 
         /* ********************************************************* */
 
         uint32_t soGetFileBlock(int ih, uint32_t fbn)
         {
-            soProbe(301, "%s(%d, %u)\n", __FUNCTION__, ih, fbn);
+            soProbeHot(301, "%s(%d, %u)\n", __FUNCTION__, ih, fbn);
 
             /* change the following line by your code */
 
@@ -54,7 +59,7 @@ namespace sofs18
 
         static uint32_t soGetIndirectFileBlock(SOInode * ip, uint32_t afbn)
         {
-            soProbe(301, "%s(%d, ...)\n", __FUNCTION__, afbn);
+            soProbeHot(301, "%s(%d, ...)\n", __FUNCTION__, afbn);
 
             /* change the following line by your code */
 
@@ -77,7 +82,7 @@ namespace sofs18
 
         static uint32_t soGetDoubleIndirectFileBlock(SOInode * ip, uint32_t afbn)
         {
-            soProbe(301, "%s(%d, ...)\n", __FUNCTION__, afbn);
+            soProbeHot(301, "%s(%d, ...)\n", __FUNCTION__, afbn);
 
             /* change the following line by your code */
 
@@ -104,7 +109,94 @@ namespace sofs18
 
         }
 
+        /* ********************************************************* */
+
+        /*
+         * The range is split at the boundaries of the blocks of references,
+         * so every block of references covering the range is read once
+         * and a null reference to one of them maps all its file blocks to holes.
+         */
+        void soGetFileBlocks(int ih, uint32_t first, uint32_t count, uint32_t * out)
+        {
+            soProbeHot(316, "%s(%d, %u, %u, %p)\n", __FUNCTION__, ih, first, count, out);
+
+            uint32_t RPB = ReferencesPerBlock;
+            uint32_t IndirectBegin = N_DIRECT;
+            uint32_t DoubleIndirectBegin = N_INDIRECT * RPB + IndirectBegin;
+            uint32_t maxBlocks = N_DOUBLE_INDIRECT * RPB * RPB + DoubleIndirectBegin;
+            if (out == NULL or first >= maxBlocks or count > maxBlocks - first)
+                throw SOException(EINVAL, __FUNCTION__);
+
+            SOInode *ip = soITGetInodePointer(ih);
+            uint32_t i = 0;
+            uint32_t fbn = first;
+
+            /* direct references */
+            for (; i < count and fbn < IndirectBegin; i++, fbn++)
+                out[i] = ip->d[fbn];
+
+            /* single indirect references, one block of references at a time */
+            while (i < count and fbn < DoubleIndirectBegin)
+            {
+                uint32_t afbn = fbn - IndirectBegin;
+                uint32_t cnt = std::min(count - i, RPB - afbn % RPB);
+                soGetRefBlockRange(ip->i1[afbn / RPB], afbn % RPB, cnt, &out[i]);
+                i += cnt;
+                fbn += cnt;
+            }
+
+            /* double indirect references, one i2 entry at a time */
+            while (i < count)
+            {
+                uint32_t afbn = fbn - DoubleIndirectBegin;
+                uint32_t cnt = std::min(count - i, RPB * RPB - afbn % (RPB * RPB));
+                soGetDoubleRefBlockRange(ip->i2[afbn / (RPB * RPB)], afbn % (RPB * RPB), cnt, &out[i]);
+                i += cnt;
+                fbn += cnt;
+            }
+        }
+
+        /* ********************************************************* */
+
+        /* references [off, off + cnt) of block of references bn */
+        static void soGetRefBlockRange(uint32_t bn, uint32_t off, uint32_t cnt, uint32_t * out)
+        {
+            if (bn == NullReference)
+            {
+                for (uint32_t k = 0; k < cnt; k++)
+                    out[k] = NullReference;
+                return;
+            }
+
+            uint32_t ref[ReferencesPerBlock];
+            soReadDataBlock(bn, ref);
+            memcpy(out, &ref[off], cnt * sizeof(uint32_t));
+        }
+
+        /* ********************************************************* */
+
+        /* file blocks [off, off + cnt) below the block of references to blocks of references bn */
+        static void soGetDoubleRefBlockRange(uint32_t bn, uint32_t off, uint32_t cnt, uint32_t * out)
+        {
+            uint32_t RPB = ReferencesPerBlock;
+            if (bn == NullReference)
+            {
+                for (uint32_t k = 0; k < cnt; k++)
+                    out[k] = NullReference;
+                return;
+            }
+
+            uint32_t ref[ReferencesPerBlock];
+            soReadDataBlock(bn, ref);
+            for (uint32_t i = 0; i < cnt; )
+            {
+                uint32_t o = off + i;
+                uint32_t c = std::min(cnt - i, RPB - o % RPB);
+                soGetRefBlockRange(ref[o / RPB], o % RPB, c, &out[i]);
+                i += c;
+            }
+        }
+
     };
 
 };
-
@@ -7,6 +7,9 @@
 
 #include <string.h>
 #include <inttypes.h>
+#include <errno.h>
+
+#include <vector>
 
 namespace sofs18
 {
@@ -15,7 +18,7 @@ namespace sofs18
 
         void soReadFileBlock(int ih, uint32_t fbn, void *buf)
         {
-            soProbe(331, "%s(%d, %u, %p)\n", __FUNCTION__, ih, fbn, buf);
+            soProbeHot(331, "%s(%d, %u, %p)\n", __FUNCTION__, ih, fbn, buf);
 
             /* change the following line by your code */
             //bin::soReadFileBlock(ih, fbn, buf);
@@ -29,7 +32,47 @@ namespace sofs18
             	soReadDataBlock(nBlock, buf);
             }
             else {
-            	memset(buf,NullReference,BlockSize);
+            	memset(buf,0,BlockSize);
+            }
+        }
+
+        /* ********************************************************* */
+
+        /*
+         * The range is mapped once; every run of file blocks with data blocks
+         * is read with a single call, whose adjacent data blocks are transferred together,
+         * and every run of holes is zeroed at once.
+         */
+        void soReadFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf)
+        {
+            soProbeHot(333, "%s(%d, %u, %u, %p)\n", __FUNCTION__, ih, fbn, n, buf);
+
+            if (buf == NULL)
+                throw SOException(EINVAL, __FUNCTION__);
+            if (n == 0)
+                return;
+
+            std::vector<uint32_t> refs(n);
+            sofs18::soGetFileBlocks(ih, fbn, n, refs.data());
+
+            char *p = (char *)buf;
+            for (uint32_t i = 0, j; i < n; i = j)
+            {
+                bool hole = (refs[i] == NullReference);
+                for (j = i + 1; j < n and (refs[j] == NullReference) == hole; j++)
+                    ;
+
+                if (not hole)
+                {
+                    soReadDataBlocks(&refs[i], j - i, p + (size_t)i * BlockSize);
+                    continue;
+                }
+
+                memset(p + (size_t)i * BlockSize, 0, (size_t)(j - i) * BlockSize);
+
+                /* file blocks kept in memory have no data block yet */
+                for (uint32_t k = i; k < j; k++)
+                    soDelallocRead(ih, fbn + k, p + (size_t)k * BlockSize);
             }
         }
 
@@ -7,6 +7,9 @@
 
 #include <string.h>
 #include <inttypes.h>
+#include <errno.h>
+
+#include <vector>
 
 namespace sofs18
 {
@@ -15,7 +18,7 @@ namespace sofs18
 
         void soWriteFileBlock(int ih, uint32_t fbn, void *buf)
         {
-            soProbe(332, "%s(%d, %u, %p)\n", __FUNCTION__, ih, fbn, buf);
+            soProbeHot(332, "%s(%d, %u, %p)\n", __FUNCTION__, ih, fbn, buf);
 
             /* change the following line by your code */
             //bin::soWriteFileBlock(ih, fbn, buf);
@@ -33,6 +36,51 @@ namespace sofs18
 			soWriteDataBlock(nBlock, buf);
         }
 
+        /* ********************************************************* */
+
+        /*
+         * The range is mapped once.
+         * File blocks with no data block are first offered to delayed allocation;
+         * the others get their data blocks a run at a time, by soAllocFileBlocks,
+         * and every run is written with a single call, whose adjacent data blocks 
+         * are transferred together.
+         * A run is written as soon as it has its data blocks, so, if the disk fills up,
+         * no allocated data block is left with stale contents.
+         */
+        void soWriteFileBlocks(int ih, uint32_t fbn, uint32_t n, void *buf)
+        {
+            soProbeHot(334, "%s(%d, %u, %u, %p)\n", __FUNCTION__, ih, fbn, n, buf);
+
+            if (buf == NULL)
+                throw SOException(EINVAL, __FUNCTION__);
+            if (n == 0)
+                return;
+
+            std::vector<uint32_t> refs(n);
+            sofs18::soGetFileBlocks(ih, fbn, n, refs.data());
+
+            char *p = (char *)buf;
+            std::vector<bool> kept(n, false);
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (refs[i] == NullReference)
+                    kept[i] = sofs18::soDelallocWrite(ih, fbn + i, p + (size_t)i * BlockSize);
+            }
+
+            for (uint32_t i = 0, j; i < n; i = j)
+            {
+                bool hole = (refs[i] == NullReference);
+                for (j = i + 1; j < n and kept[j] == kept[i] and (refs[j] == NullReference) == hole; j++)
+                    ;
+                if (kept[i])
+                    continue;
+
+                if (hole)
+                    sofs18::soAllocFileBlocks(ih, fbn + i, j - i, &refs[i]);
+                soWriteDataBlocks(&refs[i], j - i, p + (size_t)i * BlockSize);
+            }
+        }
+
     };
 
 };
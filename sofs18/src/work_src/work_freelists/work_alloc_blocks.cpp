@@ -0,0 +1,71 @@
+/*
+ *  \brief Bulk allocation of data blocks
+ */
+
+#include "work_freelists.h"
+
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include "core.h"
+#include "dal.h"
+#include "freelists.h"
+
+namespace sofs18
+{
+    namespace work
+    {
+
+        uint32_t soAllocDataBlocks(uint32_t n, uint32_t *refs)
+        {
+            soProbe(445, "%s(%u, %p)\n", __FUNCTION__, n, refs);
+
+            if (refs == NULL)
+                throw SOException(EINVAL, __FUNCTION__);
+
+            SOSuperBlock *sb = soSBGetPointer();
+            if (n == 0)
+                return 0;
+            if (sb->dz_free == 0)
+                throw SOException(ENOSPC, __FUNCTION__);
+
+            /* take whole slices of the retrieval cache, replenishing it when empty */
+            uint32_t got = 0;
+            while (got < n and sb->dz_free > 0)
+            {
+                if (sb->brcache.idx == BLOCK_REFERENCE_CACHE_SIZE)
+                {
+                    sofs18::soReplenishBRCache();
+                    if (sb->brcache.idx == BLOCK_REFERENCE_CACHE_SIZE)
+                        break;
+                }
+
+                uint32_t cnt = BLOCK_REFERENCE_CACHE_SIZE - sb->brcache.idx;
+                if (cnt > n - got)
+                    cnt = n - got;
+                if (cnt > sb->dz_free)
+                    cnt = sb->dz_free;
+
+                uint32_t *src = &sb->brcache.ref[sb->brcache.idx];
+                memcpy(&refs[got], src, cnt * sizeof(uint32_t));
+                memset(src, 0xFF, cnt * sizeof(uint32_t));
+                sb->brcache.idx += cnt;
+                sb->dz_free -= cnt;
+                got += cnt;
+            }
+
+            /* free lists are kept mostly in ascending order, so sorting brings runs together */
+            std::sort(refs, refs + got);
+
+            soSBSave();
+
+            return got;
+        }
+
+    };
+
+};
+
@@ -0,0 +1,53 @@
+/*
+ *  \brief Bulk release of data blocks
+ */
+
+#include "work_freelists.h"
+
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "core.h"
+#include "dal.h"
+#include "freelists.h"
+
+namespace sofs18
+{
+    namespace work
+    {
+
+        void soFreeDataBlocks(const uint32_t *refs, uint32_t n)
+        {
+            soProbe(446, "%s(%p, %u)\n", __FUNCTION__, refs, n);
+
+            if (refs == NULL and n > 0)
+                throw SOException(EINVAL, __FUNCTION__);
+
+            SOSuperBlock *sb = soSBGetPointer();
+
+            /* fill whole slices of the insertion cache, depleting it when full */
+            uint32_t done = 0;
+            while (done < n)
+            {
+                if (sb->bicache.idx == BLOCK_REFERENCE_CACHE_SIZE)
+                    sofs18::soDepleteBICache();
+
+                uint32_t cnt = BLOCK_REFERENCE_CACHE_SIZE - sb->bicache.idx;
+                if (cnt > n - done)
+                    cnt = n - done;
+
+                memcpy(&sb->bicache.ref[sb->bicache.idx], &refs[done], cnt * sizeof(uint32_t));
+                sb->bicache.idx += cnt;
+                sb->dz_free += cnt;
+                done += cnt;
+            }
+
+            if (n > 0)
+                soSBSave();
+        }
+
+    };
+
+};
+
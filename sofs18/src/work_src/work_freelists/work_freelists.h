@@ -33,6 +33,10 @@ namespace sofs18
 
         void soFreeDataBlock(uint32_t cn);
 
+        uint32_t soAllocDataBlocks(uint32_t n, uint32_t *refs);
+
+        void soFreeDataBlocks(const uint32_t *refs, uint32_t n);
+
         void soDepleteIICache();
 
         void soDepleteBICache();
@@ -18,15 +18,17 @@ namespace sofs18
         {
             soProbe(605, "%s(%u, %u, %u)\n", __FUNCTION__, first_block, btotal, rdsize);
 
-            uint32_t blocktab [ReferencesPerBlock];
             uint32_t blocknumb = btotal / ReferencesPerBlock;
 
             if( btotal % ReferencesPerBlock != 0 ){
                 blocknumb = blocknumb+1;
             }
 
+            /* the table is built a chunk at a time and streamed to the disk */
+            SORawWriter out(first_block);
             for(uint32_t i=0 ; i<blocknumb ; i++){
 
+                uint32_t *blocktab = (uint32_t *)out.next();
                 for(uint32_t k=0 ; k<ReferencesPerBlock ; k++){
 
 					if( btotal > rdsize ){
@@ -36,10 +38,8 @@ namespace sofs18
 						blocktab [k] = NullReference;
 					}
                 }
-
-                soWriteRawBlock(first_block,&blocktab);
-                first_block++;
             }
+            out.finish();
 
             return blocknumb;
         }
@@ -22,33 +22,21 @@ namespace sofs18
 			//Number of blocks needed for all the inodes
 			uint32_t inodeBlocks = (itotal-1) / ReferencesPerBlock;
 
-			//Array that stores the inodes to write
-			uint32_t inodeRL[ReferencesPerBlock];
+			//Since inodeBlocks is an integer number, we need to account for the mod (division remainder)
+			if((itotal-1) % InodesPerBlock != 0){
+				inodeBlocks++;
+			}
 
+			/* the table is built a chunk at a time and streamed to the disk */
+			SORawWriter out(first_block);
 			uint32_t count = 1;
 			for (uint32_t i = 0; i < inodeBlocks; i++) {
-
+				uint32_t *inodeRL = (uint32_t *)out.next();
 				for (uint32_t j = 0; j < ReferencesPerBlock; j++) {
-
-					inodeRL[j] = count++;
+					inodeRL[j] = (count <= itotal-1) ? count++ : NullReference;
 				}
-				soWriteRawBlock(first_block + i,&inodeRL);
-			}
-
-			//Since inodeBlocks is an integer number, we need to account for the mod (division remainder)
-			if((itotal-1) % InodesPerBlock != 0){
-
-				for(uint32_t j = 0; j < ReferencesPerBlock; j++) {
-					if ((itotal-1) >= count) {
-						inodeRL[j] = count++;
-					}
-					else {
-						inodeRL[j] = NullReference;
-					}
-				}
-				soWriteRawBlock(first_block + inodeBlocks,&inodeRL);
-				inodeBlocks++;
 			}
+			out.finish();
 
 			return inodeBlocks;
         }
@@ -22,10 +22,13 @@ namespace sofs18
             soProbe(604, "%s(%u, %u, %u)\n", __FUNCTION__, first_block, itotal, rdsize);
             
             uint32_t nBlocks = itotal/InodesPerBlock;
-            SOInode inode[InodesPerBlock];
 
+            /* the table is built a chunk at a time and streamed to the disk */
+            SORawWriter out(first_block);
             for(uint32_t block_num = first_block ; block_num < first_block + nBlocks ; block_num++)
             {
+                SOInode *inode = (SOInode *)out.next();
+                memset(inode, 0, BlockSize);
             	for(uint32_t i = 0 ; i < InodesPerBlock ; i++)
             	{
                     inode[i].mode = INODE_FREE;
@@ -71,8 +74,8 @@ namespace sofs18
                         }
                     }
             	}
-            	soWriteRawBlock(block_num, &inode);
             }
+            out.finish();
 
             return nBlocks;
 
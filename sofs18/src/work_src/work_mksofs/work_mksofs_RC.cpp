@@ -20,13 +20,8 @@ namespace sofs18
             //bin::resetBlocks(first_block, cnt);
 
             // solution by Luis Moura, student 83808 DETI - UA
-            uint8_t reset [BlockSize];
-            memset(reset, 0, BlockSize);
-            
-            for (; first_block < cnt; first_block++) {
-                soWriteRawBlock(first_block, &reset);
-            }
-            
+            /* no data is transferred, if the supporting file system can drop the range */
+            soZeroRawBlocks(first_block, cnt);
         }
 
     };
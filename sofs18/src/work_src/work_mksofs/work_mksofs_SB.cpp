@@ -27,7 +27,10 @@ namespace sofs18
 
             // solution by Maria João Lavoura, student 84681 DETI - UA
             
-            SOSuperBlock sb;
+            /* the superblock may be smaller than a block */
+            union { SOSuperBlock sb; uint8_t data[BlockSize]; } block0;
+            memset(&block0, 0, sizeof(block0));
+            SOSuperBlock & sb = block0.sb;
 
             /* Header */
             sb.magic = 0xFFFF;
@@ -103,7 +106,7 @@ namespace sofs18
             sb.bicache = bic;
 
 
-			soWriteRawBlock(0, &sb);
+			soWriteRawBlock(0, &block0);
 
             /* change the following line by your code */
 			//bin::fillInSuperBlock(name, ntotal, itotal, rdsize);
@@ -0,0 +1,131 @@
+/*
+ *  \author Artur Pereira - 2016-2018
+ */
+
+#include "work_syscalls.h"
+
+#include "core.h"
+#include "dal.h"
+#include "fileblocks.h"
+#include "direntries.h"
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+namespace sofs18
+{
+    namespace work
+    {
+
+        /* ********************************************************* */
+
+        /*
+         * Zero part of a file block, [off, off + cnt);
+         * a hole is left alone, but a block kept in memory by delayed allocation is not a hole.
+         */
+        static void soZeroPartialBlock(int ih, uint32_t fbn, uint32_t off, uint32_t cnt)
+        {
+            char blk[BlockSize];
+            if (sofs18::soGetFileBlock(ih, fbn) != NullReference)
+                sofs18::soReadFileBlock(ih, fbn, blk);
+            else if (not soDelallocRead(ih, fbn, blk))
+                return;
+
+            memset(blk + off, 0, cnt);
+            sofs18::soWriteFileBlock(ih, fbn, blk);
+        }
+
+        /* ********************************************************* */
+
+        /*
+         * Only the part of the range before the end of file matters;
+         * the file blocks fully within it are freed at once, by soPunchFileBlocks,
+         * and a partial last block that holds the end of file is taken as full,
+         * as the bytes beyond it are not part of the file.
+         */
+        int soPunchHole(const char *path, off_t pos, off_t len)
+        {
+            soProbe(SOPROBE_MAGENTA, 115, "%s(\"%s\", %ld, %ld)\n", __FUNCTION__, path, (long)pos, (long)len);
+
+            int ih = -1;
+            try
+            {
+                if (pos < 0 or len <= 0)
+                    throw SOException(EINVAL, __FUNCTION__);
+                if (strlen(path) >= PATH_MAX)
+                    throw SOException(ENAMETOOLONG, __FUNCTION__);
+                char p[PATH_MAX];
+                strcpy(p, path);
+
+                uint32_t in = sofs18::soTraversePath(p);
+                if (in == (uint32_t)-1)
+                    throw SOException(ENOENT, __FUNCTION__);
+                ih = soITOpenInode(in);
+                if (not soCheckInodeAccess(ih, W_OK))
+                    throw SOException(EACCES, __FUNCTION__);
+                SOInode *ip = soITGetInodePointer(ih);
+                if ((ip->mode & S_IFMT) == S_IFDIR)
+                    throw SOException(EISDIR, __FUNCTION__);
+                if ((ip->mode & S_IFMT) != S_IFREG)
+                    throw SOException(EINVAL, __FUNCTION__);
+
+                uint64_t end = std::min((uint64_t)pos + len, (uint64_t)ip->size);
+                if ((uint64_t)pos >= end)
+                {
+                    soITCloseInode(ih);
+                    return 0;
+                }
+
+                uint32_t first = pos / BlockSize;
+                uint32_t last = (end - 1) / BlockSize;
+                uint32_t off = pos % BlockSize;
+                uint32_t tail = (end == ip->size) ? 0 : end % BlockSize;
+
+                /* the range within a single block */
+                if (first == last and (off != 0 or tail != 0))
+                {
+                    soZeroPartialBlock(ih, first, off, (tail == 0 ? BlockSize : tail) - off);
+                    first++;
+                }
+                else
+                {
+                    if (off != 0)
+                    {
+                        soZeroPartialBlock(ih, first, off, BlockSize - off);
+                        first++;
+                    }
+                    if (tail != 0)
+                    {
+                        soZeroPartialBlock(ih, last, 0, tail);
+                        last--;
+                    }
+                }
+
+                /* whole blocks */
+                if (first <= last)
+                    sofs18::soPunchFileBlocks(ih, first, last);
+
+                ip->mtime = ip->ctime = time(NULL);
+                soITSaveInode(ih);
+                soITCloseInode(ih);
+            }
+            catch (SOException & err)
+            {
+                soProbe(SOPROBE_RED, 115, "--%s\n", err.what());
+                if (ih != -1)
+                    soITCloseInode(ih);
+                return -err.en;
+            }
+
+            return 0;
+        }
+
+    };
+
+};
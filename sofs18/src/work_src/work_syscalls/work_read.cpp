@@ -0,0 +1,117 @@
+/*
+ *  \author Artur Pereira - 2016-2018
+ */
+
+#include "work_syscalls.h"
+
+#include "core.h"
+#include "dal.h"
+#include "fileblocks.h"
+#include "direntries.h"
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+namespace sofs18
+{
+    namespace work
+    {
+
+        /*
+         * The file blocks fully covered by the request are read in one go,
+         * by soReadFileBlocks, straight into the caller's buffer;
+         * only a partial first or last block goes through a block buffer.
+         */
+        int soRead(const char *path, void *buff, uint32_t count, int32_t pos)
+        {
+            soProbe(SOPROBE_MAGENTA, 108, "%s(\"%s\", %p, %u, %u)\n", __FUNCTION__, path, buff, count, pos);
+
+            int ih = -1;
+            try
+            {
+                if (buff == NULL or pos < 0)
+                    throw SOException(EINVAL, __FUNCTION__);
+                if (strlen(path) >= PATH_MAX)
+                    throw SOException(ENAMETOOLONG, __FUNCTION__);
+                char p[PATH_MAX];
+                strcpy(p, path);
+
+                uint32_t in = sofs18::soTraversePath(p);
+                if (in == (uint32_t)-1)
+                    throw SOException(ENOENT, __FUNCTION__);
+                ih = soITOpenInode(in);
+                if (not soCheckInodeAccess(ih, R_OK))
+                    throw SOException(EACCES, __FUNCTION__);
+                SOInode *ip = soITGetInodePointer(ih);
+                if ((ip->mode & S_IFMT) == S_IFDIR)
+                    throw SOException(EISDIR, __FUNCTION__);
+                if ((ip->mode & S_IFMT) != S_IFREG)
+                    throw SOException(EINVAL, __FUNCTION__);
+
+                /* nothing to read at or past the end of file */
+                if ((uint32_t)pos >= ip->size)
+                {
+                    soITCloseInode(ih);
+                    return 0;
+                }
+                count = std::min(count, ip->size - (uint32_t)pos);
+
+                char *dst = (char *)buff;
+                uint32_t left = count;
+                uint32_t fbn = pos / BlockSize;
+                uint32_t off = pos % BlockSize;
+                char blk[BlockSize];
+
+                /* partial first block */
+                if (off != 0 or left < BlockSize)
+                {
+                    uint32_t cnt = std::min(BlockSize - off, left);
+                    sofs18::soReadFileBlock(ih, fbn, blk);
+                    memcpy(dst, blk + off, cnt);
+                    dst += cnt;
+                    left -= cnt;
+                    fbn++;
+                }
+
+                /* whole blocks */
+                if (left >= BlockSize)
+                {
+                    uint32_t n = left / BlockSize;
+                    sofs18::soReadFileBlocks(ih, fbn, n, dst);
+                    dst += (size_t)n * BlockSize;
+                    left -= n * BlockSize;
+                    fbn += n;
+                }
+
+                /* partial last block */
+                if (left > 0)
+                {
+                    sofs18::soReadFileBlock(ih, fbn, blk);
+                    memcpy(dst, blk, left);
+                }
+
+                ip->atime = time(NULL);
+                soITSaveInode(ih);
+                soITCloseInode(ih);
+            }
+            catch (SOException & err)
+            {
+                soProbe(SOPROBE_RED, 108, "--%s\n", err.what());
+                if (ih != -1)
+                    soITCloseInode(ih);
+                return -err.en;
+            }
+
+            return count;
+        }
+
+    };
+
+};
+
@@ -0,0 +1,32 @@
+/*
+ *  \file 
+ *  \brief Group version of the system calls
+ *
+ *  \author Artur Pereira 2016-2018
+ *
+ *  \remarks See the main \c syscalls header file for documentation
+ */
+
+#ifndef __SOFS18_SYSCALLS_WORK__
+#define __SOFS18_SYSCALLS_WORK__
+
+#include <inttypes.h>
+#include <sys/types.h>
+
+namespace sofs18
+{
+    namespace work
+    {
+        int soRead(const char *path, void *buff, uint32_t count, int32_t pos);
+
+        int soWrite(const char *path, void *buff, uint32_t count, int32_t pos);
+
+        int soTruncate(const char *path, off_t length);
+
+        int soPunchHole(const char *path, off_t pos, off_t len);
+
+    };
+
+};
+
+#endif             /* __SOFS18_SYSCALLS_WORK__ */
@@ -0,0 +1,105 @@
+/*
+ *  \author Artur Pereira - 2016-2018
+ */
+
+#include "work_syscalls.h"
+
+#include "core.h"
+#include "dal.h"
+#include "fileblocks.h"
+#include "direntries.h"
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace sofs18
+{
+    namespace work
+    {
+
+        /* ********************************************************* */
+
+        /*
+         * The limit is the one of the file itself (see soMaxFileSize),
+         * so an extent-mapped file can grow beyond what the classic block map holds.
+         * On shrinking, the file blocks past the new end of file are freed,
+         * and the rest of the new last block is zeroed, so growing the file back
+         * exposes zeros and not old contents.
+         */
+        int soTruncate(const char *path, off_t length)
+        {
+            soProbe(SOPROBE_MAGENTA, 110, "%s(\"%s\", %ld)\n", __FUNCTION__, path, (long)length);
+
+            int ih = -1;
+            try
+            {
+                if (length < 0)
+                    throw SOException(EINVAL, __FUNCTION__);
+                if (strlen(path) >= PATH_MAX)
+                    throw SOException(ENAMETOOLONG, __FUNCTION__);
+                char p[PATH_MAX];
+                strcpy(p, path);
+
+                uint32_t in = sofs18::soTraversePath(p);
+                if (in == (uint32_t)-1)
+                    throw SOException(ENOENT, __FUNCTION__);
+                ih = soITOpenInode(in);
+                if (not soCheckInodeAccess(ih, W_OK))
+                    throw SOException(EACCES, __FUNCTION__);
+                SOInode *ip = soITGetInodePointer(ih);
+                if ((ip->mode & S_IFMT) == S_IFDIR)
+                    throw SOException(EISDIR, __FUNCTION__);
+                if ((ip->mode & S_IFMT) != S_IFREG)
+                    throw SOException(EINVAL, __FUNCTION__);
+
+                if ((uint64_t)length > sofs18::soMaxFileSize(ih))
+                    throw SOException(EFBIG, __FUNCTION__);
+
+                if ((uint32_t)length < ip->size)
+                {
+                    uint32_t fbn = (length + BlockSize - 1) / BlockSize;
+                    uint32_t off = length % BlockSize;
+
+                    if (fbn < (ip->size + BlockSize - 1) / BlockSize)
+                        sofs18::soFreeFileBlocks(ih, fbn);
+
+                    /* tail of the new last block; a hole is left alone */
+                    if (off != 0)
+                    {
+                        char blk[BlockSize];
+                        bool found = (sofs18::soGetFileBlock(ih, fbn - 1) != NullReference);
+                        if (found)
+                            sofs18::soReadFileBlock(ih, fbn - 1, blk);
+                        else
+                            found = soDelallocRead(ih, fbn - 1, blk);
+                        if (found)
+                        {
+                            memset(blk + off, 0, BlockSize - off);
+                            sofs18::soWriteFileBlock(ih, fbn - 1, blk);
+                        }
+                    }
+                }
+
+                ip->size = length;
+                ip->mtime = ip->ctime = time(NULL);
+                soITSaveInode(ih);
+                soITCloseInode(ih);
+            }
+            catch (SOException & err)
+            {
+                soProbe(SOPROBE_RED, 110, "--%s\n", err.what());
+                if (ih != -1)
+                    soITCloseInode(ih);
+                return -err.en;
+            }
+
+            return 0;
+        }
+
+    };
+
+};
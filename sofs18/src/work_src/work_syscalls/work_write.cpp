@@ -0,0 +1,144 @@
+/*
+ *  \author Artur Pereira - 2016-2018
+ */
+
+#include "work_syscalls.h"
+
+#include "core.h"
+#include "dal.h"
+#include "fileblocks.h"
+#include "direntries.h"
+
+#include <errno.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+namespace sofs18
+{
+    namespace work
+    {
+
+        /* ********************************************************* */
+
+        /*
+         * Write part of a file block, [off, off + cnt), keeping the rest of it;
+         * bytes of the block at or beyond the old end of file are zeroed,
+         * as they may hold leftovers of a previous truncate.
+         */
+        static void soWritePartialBlock(int ih, uint32_t fbn, uint32_t off, uint32_t cnt, 
+                const char *src, uint32_t size)
+        {
+            char blk[BlockSize];
+            sofs18::soReadFileBlock(ih, fbn, blk);
+
+            uint64_t start = (uint64_t)fbn * BlockSize;
+            if (size < start + BlockSize)
+            {
+                uint32_t keep = (size > start) ? size - start : 0;
+                memset(blk + keep, 0, BlockSize - keep);
+            }
+
+            memcpy(blk + off, src, cnt);
+            sofs18::soWriteFileBlock(ih, fbn, blk);
+        }
+
+        /* ********************************************************* */
+
+        /*
+         * The file blocks fully covered by the request are written in one go,
+         * by soWriteFileBlocks, straight from the caller's buffer, so their missing
+         * data blocks are allocated in bulk;
+         * only a partial first or last block is read, modified and written back.
+         */
+        int soWrite(const char *path, void *buff, uint32_t count, int32_t pos)
+        {
+            soProbe(SOPROBE_MAGENTA, 109, "%s(\"%s\", %p, %u, %u)\n", __FUNCTION__, path, buff, count, pos);
+
+            int ih = -1;
+            try
+            {
+                if (buff == NULL or pos < 0)
+                    throw SOException(EINVAL, __FUNCTION__);
+                if (strlen(path) >= PATH_MAX)
+                    throw SOException(ENAMETOOLONG, __FUNCTION__);
+                char p[PATH_MAX];
+                strcpy(p, path);
+
+                uint32_t in = sofs18::soTraversePath(p);
+                if (in == (uint32_t)-1)
+                    throw SOException(ENOENT, __FUNCTION__);
+                ih = soITOpenInode(in);
+                if (not soCheckInodeAccess(ih, W_OK))
+                    throw SOException(EACCES, __FUNCTION__);
+                SOInode *ip = soITGetInodePointer(ih);
+                if ((ip->mode & S_IFMT) == S_IFDIR)
+                    throw SOException(EISDIR, __FUNCTION__);
+                if ((ip->mode & S_IFMT) != S_IFREG)
+                    throw SOException(EINVAL, __FUNCTION__);
+
+                /* the write is cut at the maximum size of a file */
+                uint32_t maxSize = sofs18::soMaxFileSize(ih);
+                if (count > maxSize)
+                    throw SOException(EINVAL, __FUNCTION__);
+                count = ((uint32_t)pos >= maxSize) ? 0 : std::min(count, maxSize - (uint32_t)pos);
+                if (count == 0)
+                {
+                    soITCloseInode(ih);
+                    return 0;
+                }
+
+                const char *src = (const char *)buff;
+                uint32_t left = count;
+                uint32_t fbn = pos / BlockSize;
+                uint32_t off = pos % BlockSize;
+
+                /* partial first block */
+                if (off != 0 or left < BlockSize)
+                {
+                    uint32_t cnt = std::min(BlockSize - off, left);
+                    soWritePartialBlock(ih, fbn, off, cnt, src, ip->size);
+                    src += cnt;
+                    left -= cnt;
+                    fbn++;
+                }
+
+                /* whole blocks */
+                if (left >= BlockSize)
+                {
+                    uint32_t n = left / BlockSize;
+                    sofs18::soWriteFileBlocks(ih, fbn, n, (void *)src);
+                    src += (size_t)n * BlockSize;
+                    left -= n * BlockSize;
+                    fbn += n;
+                }
+
+                /* partial last block */
+                if (left > 0)
+                    soWritePartialBlock(ih, fbn, 0, left, src, ip->size);
+
+                if ((uint32_t)pos + count > ip->size)
+                    ip->size = pos + count;
+                ip->mtime = ip->ctime = time(NULL);
+                soITSaveInode(ih);
+                soITCloseInode(ih);
+            }
+            catch (SOException & err)
+            {
+                soProbe(SOPROBE_RED, 109, "--%s\n", err.what());
+                if (ih != -1)
+                    soITCloseInode(ih);
+                return -err.en;
+            }
+
+            return count;
+        }
+
+    };
+
+};
+